@@ -0,0 +1,574 @@
+// bench: microbenchmarks of logcie pipeline stages
+//
+//   bench [-t ms] [-o results.json] [name_filter]
+//
+// Measures every stage of a log on its own (disabled call site, filters,
+// printf formatter, printf writer) and the whole pipeline end to end. Every
+// benchmark is calibrated to run for about `ms` milliseconds (default 200), is
+// repeated BENCH_RUNS times, and the fastest run is reported as ns/op and ops/s
+// (lines/s for benchmarks that produce lines). With -o results are also written
+// as JSON, so numbers of different releases can be compared by a script.
+//
+// Only benchmarks which names contain `name_filter` are run.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define LOGCIE_IMPLEMENTATION
+#include "logcie.h"
+
+#define BENCH_RUNS 5
+
+static const char *logcie_module = "bench";
+
+/**
+ * @brief One benchmark
+ *
+ * @field name   Name of the benchmark (`stage/variant`)
+ * @field lines  Whether every operation produces a line of output
+ * @field setup  Optional. Prepares global state before the benchmark is run
+ * @field run    Runs `iterations` operations
+ */
+typedef struct Bench {
+  const char *name;
+  uint8_t     lines;
+  void (*setup)(void);
+  void (*run)(uint64_t iterations);
+} Bench;
+
+/**
+ * @brief Result of one benchmark
+ */
+typedef struct BenchResult {
+  const char *name;
+  uint8_t     lines;
+  uint64_t    iterations;
+  double      ns_per_op;
+} BenchResult;
+
+static const char line[] = "2026-10-18 12:00:00 [INFO] (bench) request 42 served in 137 us\n";
+
+// Results of operations are accumulated here, so they are not optimized out
+static volatile size_t bench_sink;
+
+static FILE *devnull_file;
+static FILE *regular_file;
+static FILE *pipe_file;
+
+#if defined(__unix__) || defined(__APPLE__)
+static pid_t pipe_reader = -1;
+#endif
+
+// -----------------------------------------------------------------------------
+// Disabled call site and end to end
+
+static Logcie_LogLevel warn_level = LOGCIE_LEVEL_WARN;
+static Logcie_Sink     pipeline_sink;
+
+static void setup_sink(FILE *file, Logcie_Filter filter) {
+  logcie_remove_all_sinks();
+
+  Logcie_Sink sink = {
+    .formatter = {logcie_printf_formatter, (void *)"$d $t [$L] ($M) $m"},
+    .writer    = {logcie_printf_writer, file, logcie_printf_writev, logcie_printf_flush},
+    .filter    = filter,
+    .dedup     = NULL,
+    .async     = NULL,
+  };
+  pipeline_sink = sink;
+  logcie_add_sink(&pipeline_sink);
+}
+
+static void setup_disabled(void) {
+  Logcie_Filter filter = {logcie_filter_level_min_fn, &warn_level};
+  setup_sink(devnull_file, filter);
+}
+
+static void setup_filtered_out(void) {
+  Logcie_Filter filter = {logcie_filter_module_eq_fn, (void *)"other"};
+  setup_sink(devnull_file, filter);
+}
+
+static void setup_devnull(void) {
+  Logcie_Filter filter = {NULL, NULL};
+  setup_sink(devnull_file, filter);
+}
+
+static void setup_file(void) {
+  Logcie_Filter filter = {NULL, NULL};
+  setup_sink(regular_file, filter);
+}
+
+static void setup_pipe(void) {
+  Logcie_Filter filter = {NULL, NULL};
+  setup_sink(pipe_file, filter);
+}
+
+static void run_disabled(uint64_t iterations) {
+  for (uint64_t i = 0; i < iterations; i++) {
+    LOGCIE_DEBUG("request %d served in %d us", (int)i, 137);
+  }
+}
+
+static void run_pipeline(uint64_t iterations) {
+  for (uint64_t i = 0; i < iterations; i++) {
+    LOGCIE_INFO("request %d served in %d us", (int)i, 137);
+
+    // Keeps the file small, so the benchmark measures logging and not the disk
+    if ((i & 0xFFFF) == 0xFFFF && pipeline_sink.writer.data == regular_file) {
+      rewind(regular_file);
+    }
+  }
+
+  logcie_flush();
+}
+
+// -----------------------------------------------------------------------------
+// Filters
+
+static Logcie_Log        filter_log;
+static Logcie_LogLevel   info_level  = LOGCIE_LEVEL_INFO;
+static Logcie_LogLevel   fatal_level = LOGCIE_LEVEL_FATAL;
+static Logcie_RateLimit  rate_limit  = {.burst = 1000, .per_second = 1000, .key = LOGCIE_RATE_LIMIT_GLOBAL};
+static Logcie_PatternSet format_patterns;
+static Logcie_PatternSet message_patterns;
+static Logcie_Regex      message_regex;
+
+static Logcie_FilterCombinationData and_data;
+static Logcie_FilterCombinationData or_data;
+static Logcie_Filter                not_data;
+
+// Filter is read through volatile pointer, so the call can't be hoisted out of the loop
+static Logcie_Filter *volatile bench_filter;
+
+static Logcie_Filter pass_filter;
+static Logcie_Filter level_min_filter;
+static Logcie_Filter level_max_filter;
+static Logcie_Filter module_eq_filter;
+static Logcie_Filter message_contains_filter;
+static Logcie_Filter custom_filter;
+static Logcie_Filter not_filter;
+static Logcie_Filter and_filter;
+static Logcie_Filter or_filter;
+static Logcie_Filter rate_limit_filter;
+static Logcie_Filter format_patterns_filter;
+static Logcie_Filter message_patterns_filter;
+static Logcie_Filter regex_filter;
+
+static uint8_t is_slow_request(Logcie_Log *log) {
+  return log->level >= LOGCIE_LEVEL_INFO && log->location.line > 100;
+}
+
+static void setup_filters(void) {
+  filter_log.level         = LOGCIE_LEVEL_INFO;
+  filter_log.msg           = "request %d served in %d us";
+  filter_log.time          = time(NULL);
+  filter_log.module        = "bench";
+  filter_log.location.file = __FILE__;
+  filter_log.location.line = __LINE__;
+  filter_log.message       = "request 42 served in 137 us";
+  filter_log.message_len   = strlen(filter_log.message);
+
+  static const char *const patterns[] = {"timeout", "refused", "served in"};
+  logcie_patterns_compile(&format_patterns, patterns, 3, 0);
+  logcie_patterns_compile(&message_patterns, patterns, 3, 1);
+  logcie_regex_compile(&message_regex, "served in [0-9]+ us$", LOGCIE_REGEX_MESSAGE);
+
+  pass_filter.filter             = logcie_filter_pass_fn;
+  level_min_filter.filter        = logcie_filter_level_min_fn;
+  level_min_filter.data          = &info_level;
+  level_max_filter.filter        = logcie_filter_level_max_fn;
+  level_max_filter.data          = &fatal_level;
+  module_eq_filter.filter        = logcie_filter_module_eq_fn;
+  module_eq_filter.data          = (void *)"bench";
+  message_contains_filter.filter = logcie_filter_message_contains_fn;
+  message_contains_filter.data   = (void *)"served";
+  custom_filter.filter           = logcie_filter_custom_fn;
+  custom_filter.data             = (void *)is_slow_request;
+
+  not_data          = module_eq_filter;
+  not_filter.filter = logcie_filter_not_fn;
+  not_filter.data   = &not_data;
+  and_data.a        = level_min_filter;
+  and_data.b        = module_eq_filter;
+  and_filter.filter = logcie_filter_and_fn;
+  and_filter.data   = &and_data;
+  or_data.a         = not_filter;
+  or_data.b         = level_min_filter;
+  or_filter.filter  = logcie_filter_or_fn;
+  or_filter.data    = &or_data;
+
+  rate_limit_filter       = logcie_filter_rate_limit(&rate_limit);
+  format_patterns_filter  = logcie_filter_patterns(&format_patterns);
+  message_patterns_filter = logcie_filter_patterns(&message_patterns);
+  regex_filter            = logcie_filter_regex(&message_regex);
+}
+
+static void run_filter(uint64_t iterations) {
+  size_t passed = 0;
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    Logcie_Filter *filter = bench_filter;
+    passed += filter->filter(filter->data, &filter_log);
+  }
+
+  bench_sink += passed;
+}
+
+#define FILTER_BENCH(variant)                                     \
+  static void setup_##variant##_filter(void) {                    \
+    bench_filter = &variant##_filter;                             \
+  }                                                               \
+  static void run_##variant##_filter(uint64_t iterations) {       \
+    run_filter(iterations);                                       \
+  }
+
+FILTER_BENCH(pass)
+FILTER_BENCH(level_min)
+FILTER_BENCH(level_max)
+FILTER_BENCH(module_eq)
+FILTER_BENCH(message_contains)
+FILTER_BENCH(custom)
+FILTER_BENCH(not)
+FILTER_BENCH(and)
+FILTER_BENCH(or)
+FILTER_BENCH(rate_limit)
+FILTER_BENCH(format_patterns)
+FILTER_BENCH(message_patterns)
+FILTER_BENCH(regex)
+
+// -----------------------------------------------------------------------------
+// Formatter
+
+static const char   *formatter_format;
+static char          formatter_memory[LOGCIE_LINE_MAX];
+static Logcie_Buffer formatter_buffer = {formatter_memory, 0, sizeof(formatter_memory), 0};
+
+static size_t format_log(Logcie_Writer *writer, Logcie_Log log, ...) {
+  va_list args;
+  va_start(args, log);
+  log.args      = &args;
+  size_t result = logcie_printf_formatter(writer, (void *)formatter_format, log, &args);
+  va_end(args);
+  return result;
+}
+
+static void run_formatter(uint64_t iterations) {
+  Logcie_Writer writer  = {logcie_buffer_writer, &formatter_buffer, logcie_buffer_writev, NULL};
+  size_t        written = 0;
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    Logcie_Log log       = filter_log;
+    log.message          = NULL;
+    log.message_len      = 0;
+    formatter_buffer.len = 0;
+    written += format_log(&writer, log, (int)i, 137);
+  }
+
+  bench_sink += written;
+}
+
+static void setup_formatter_message(void) {
+  formatter_format = "$m";
+}
+
+static void setup_formatter_default(void) {
+  formatter_format = LOGCIE_DEFAULT_SINK_FORMAT;
+}
+
+static void setup_formatter_timestamp(void) {
+  formatter_format = "$d $t $z [$L] ($M) $m";
+}
+
+static void setup_formatter_padded(void) {
+  formatter_format = "[$L]$<8 $M$<16 $f:$x:$<40 $m";
+}
+
+// -----------------------------------------------------------------------------
+// Writer
+
+static FILE *writer_file;
+
+static void setup_writer_devnull(void) {
+  writer_file = devnull_file;
+}
+
+static void setup_writer_file(void) {
+  writer_file = regular_file;
+}
+
+static void setup_writer_pipe(void) {
+  writer_file = pipe_file;
+}
+
+static void run_writer(uint64_t iterations) {
+  size_t written = 0;
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    written += logcie_printf_writer(writer_file, "%s", NULL, line);
+
+    if ((i & 0xFFFF) == 0xFFFF && writer_file == regular_file) {
+      rewind(regular_file);
+    }
+  }
+
+  fflush(writer_file);
+  bench_sink += written;
+}
+
+static void run_writev(uint64_t iterations) {
+  // Line split the way printf formatter passes it
+  const Logcie_Segment segments[] = {
+    {line, 10},
+    {line + 10, 1},
+    {line + 11, 8},
+    {line + 19, 2},
+    {line + 21, 4},
+    {line + 25, 3},
+    {line + 28, 5},
+    {line + 33, 2},
+    {line + 35, sizeof(line) - 36},
+    {"\n", 1},
+  };
+  size_t written = 0;
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    written += logcie_printf_writev(writer_file, segments, sizeof(segments) / sizeof(segments[0]));
+
+    if ((i & 0xFFFF) == 0xFFFF && writer_file == regular_file) {
+      rewind(regular_file);
+    }
+  }
+
+  fflush(writer_file);
+  bench_sink += written;
+}
+
+// -----------------------------------------------------------------------------
+
+static const Bench benches[] = {
+  {"disabled/level", 0, setup_disabled, run_disabled},
+  {"disabled/filter", 0, setup_filtered_out, run_pipeline},
+
+  {"filter/pass", 0, setup_pass_filter, run_pass_filter},
+  {"filter/level_min", 0, setup_level_min_filter, run_level_min_filter},
+  {"filter/level_max", 0, setup_level_max_filter, run_level_max_filter},
+  {"filter/module_eq", 0, setup_module_eq_filter, run_module_eq_filter},
+  {"filter/message_contains", 0, setup_message_contains_filter, run_message_contains_filter},
+  {"filter/custom", 0, setup_custom_filter, run_custom_filter},
+  {"filter/not", 0, setup_not_filter, run_not_filter},
+  {"filter/and", 0, setup_and_filter, run_and_filter},
+  {"filter/or", 0, setup_or_filter, run_or_filter},
+  {"filter/rate_limit", 0, setup_rate_limit_filter, run_rate_limit_filter},
+  {"filter/patterns_format", 0, setup_format_patterns_filter, run_format_patterns_filter},
+  {"filter/patterns_message", 0, setup_message_patterns_filter, run_message_patterns_filter},
+  {"filter/regex", 0, setup_regex_filter, run_regex_filter},
+
+  {"formatter/message", 1, setup_formatter_message, run_formatter},
+  {"formatter/default", 1, setup_formatter_default, run_formatter},
+  {"formatter/timestamp", 1, setup_formatter_timestamp, run_formatter},
+  {"formatter/padded", 1, setup_formatter_padded, run_formatter},
+
+  {"writer/devnull", 1, setup_writer_devnull, run_writer},
+  {"writer/file", 1, setup_writer_file, run_writer},
+  {"writer/pipe", 1, setup_writer_pipe, run_writer},
+  {"writev/devnull", 1, setup_writer_devnull, run_writev},
+  {"writev/file", 1, setup_writer_file, run_writev},
+  {"writev/pipe", 1, setup_writer_pipe, run_writev},
+
+  {"pipeline/devnull", 1, setup_devnull, run_pipeline},
+  {"pipeline/file", 1, setup_file, run_pipeline},
+  {"pipeline/pipe", 1, setup_pipe, run_pipeline},
+};
+
+static double run_once(const Bench *bench, uint64_t iterations) {
+  uint64_t start = logcie_now_ns();
+  bench->run(iterations);
+  return (double)(logcie_now_ns() - start);
+}
+
+static BenchResult measure(const Bench *bench, uint64_t target_ns) {
+  if (bench->setup) {
+    bench->setup();
+  }
+
+  // Grows number of iterations until a run takes at least a tenth of the target
+  uint64_t iterations = 1;
+  double   elapsed    = run_once(bench, iterations);
+
+  while (elapsed < (double)target_ns / 10 && iterations < (UINT64_MAX >> 4)) {
+    iterations *= 2;
+    elapsed = run_once(bench, iterations);
+  }
+
+  iterations = (uint64_t)((double)iterations * (double)target_ns / (elapsed > 1 ? elapsed : 1)) + 1;
+
+  BenchResult result = {bench->name, bench->lines, iterations, 0};
+
+  for (int i = 0; i < BENCH_RUNS; i++) {
+    double ns_per_op = run_once(bench, iterations) / (double)iterations;
+
+    if (i == 0 || ns_per_op < result.ns_per_op) {
+      result.ns_per_op = ns_per_op;
+    }
+  }
+
+  return result;
+}
+
+static uint8_t open_outputs(void) {
+#ifdef _WIN32
+  devnull_file = fopen("NUL", "w");
+#else
+  devnull_file = fopen("/dev/null", "w");
+#endif
+  regular_file = tmpfile();
+
+  if (devnull_file == NULL || regular_file == NULL) {
+    fprintf(stderr, "bench: can't open output files\n");
+    return 0;
+  }
+
+#if defined(__unix__) || defined(__APPLE__)
+  int fds[2];
+
+  if (pipe(fds) < 0) {
+    fprintf(stderr, "bench: can't create pipe\n");
+    return 0;
+  }
+
+  pipe_reader = fork();
+
+  if (pipe_reader < 0) {
+    fprintf(stderr, "bench: can't fork pipe reader\n");
+    return 0;
+  }
+
+  if (pipe_reader == 0) {
+    char buffer[65536];
+    close(fds[1]);
+
+    while (read(fds[0], buffer, sizeof(buffer)) > 0) {
+    }
+
+    _exit(0);
+  }
+
+  close(fds[0]);
+  pipe_file = fdopen(fds[1], "w");
+#endif
+
+  return 1;
+}
+
+static void close_outputs(void) {
+  fclose(devnull_file);
+  fclose(regular_file);
+
+#if defined(__unix__) || defined(__APPLE__)
+  if (pipe_file) {
+    fclose(pipe_file);
+    waitpid(pipe_reader, NULL, 0);
+  }
+#endif
+}
+
+static void write_json(FILE *out, const BenchResult *results, size_t count) {
+  fprintf(out, "{\n  \"version\": \"%s\",\n  \"time\": %ld,\n  \"results\": [\n", LOGCIE_VERSION_STRING, (long)time(NULL));
+
+  for (size_t i = 0; i < count; i++) {
+    fprintf(out, "    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f, \"%s\": %.0f}%s\n",
+            results[i].name,
+            (unsigned long long)results[i].iterations,
+            results[i].ns_per_op,
+            results[i].lines ? "lines_per_sec" : "ops_per_sec",
+            1e9 / results[i].ns_per_op,
+            i + 1 < count ? "," : "");
+  }
+
+  fprintf(out, "  ]\n}\n");
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: bench [-t ms] [-o results.json] [name_filter]\n");
+  fprintf(stderr, "  -t  Time of one run of a benchmark (default: 200 ms)\n");
+  fprintf(stderr, "  -o  Write results as JSON to the file\n");
+}
+
+int main(int argc, char **argv) {
+  uint64_t    target_ms = 200;
+  const char *output    = NULL;
+  const char *only      = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      target_ms = (uint64_t)atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    } else if (argv[i][0] != '-' && only == NULL) {
+      only = argv[i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  if (!open_outputs()) {
+    return 1;
+  }
+
+  setup_filters();
+
+  BenchResult results[sizeof(benches) / sizeof(benches[0])];
+  size_t      count = 0;
+
+  printf("%-26s %14s %10s %16s\n", "benchmark", "iterations", "ns/op", "ops/s");
+
+  for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+    if (only && strstr(benches[i].name, only) == NULL) {
+      continue;
+    }
+
+    // Pipes are available only on POSIX
+    if ((benches[i].setup == setup_writer_pipe || benches[i].setup == setup_pipe) && pipe_file == NULL) {
+      continue;
+    }
+
+    BenchResult result = measure(&benches[i], target_ms * 1000000ull);
+    results[count++]   = result;
+
+    printf("%-26s %14llu %10.2f %16.0f %s\n",
+           result.name,
+           (unsigned long long)result.iterations,
+           result.ns_per_op,
+           1e9 / result.ns_per_op,
+           result.lines ? "lines/s" : "");
+    fflush(stdout);
+  }
+
+  logcie_remove_all_sinks();
+  close_outputs();
+
+  if (output) {
+    FILE *out = fopen(output, "w");
+
+    if (out == NULL) {
+      fprintf(stderr, "bench: can't open %s\n", output);
+      return 1;
+    }
+
+    write_json(out, results, count);
+    fclose(out);
+  }
+
+  return 0;
+}
@@ -0,0 +1,515 @@
+// latency: tail latency of logging calls under contention
+//
+//   latency [-t threads] [-n calls] [-r rate] [-m mix] [-c configs] [-p policy] [-s path] [-o results.json]
+//
+// Runs 1, 2, 4, ... up to `threads` producer threads for every sink configuration.
+// Every thread makes `calls` logging calls with levels picked by `mix` and records
+// latency of every call into its own HDR-style histogram, histograms are merged
+// after the run. With `rate` every thread logs at fixed rate, and latency is measured
+// from the time a call was scheduled, so a stalled call also accounts for the calls
+// that were delayed by it (no coordinated omission).
+//
+// Sink configurations:
+//   stdout    logcie_printf_writer to stdout (redirect it, or use -s)
+//   file      logcie_fd_writer to a file, write(2) per line
+//   buffered  logcie_printf_writer to a file with 1 MiB stdio buffer
+//   async     Logcie_Async in front of the `file` configuration
+//
+// Report is printed to stderr, so stdout can be redirected for the `stdout` sink.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOGCIE_IMPLEMENTATION
+#include "logcie.h"
+
+#ifdef _LOGCIE_THREADS
+#include <sched.h>
+#include <unistd.h>
+
+static const char *logcie_module = "latency";
+
+// Values below 2^HIST_SUB_BITS are recorded exactly, larger ones with relative
+// error below 2^-(HIST_SUB_BITS - 1) (0.8%), up to 2^HIST_MAX_BITS ns (~18 minutes)
+#define HIST_SUB_BITS  8
+#define HIST_MAX_BITS  40
+#define HIST_HALF      (1u << (HIST_SUB_BITS - 1))
+#define HIST_BUCKETS   ((1u << HIST_SUB_BITS) + (HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_HALF)
+#define MAX_THREADS    64
+
+/**
+ * @brief Log-linear latency histogram (HdrHistogram layout with power of two buckets)
+ *
+ * @field count   Number of recorded values
+ * @field sum     Sum of recorded values
+ * @field max     Largest recorded value (exact)
+ * @field counts  Number of values in every bucket
+ */
+typedef struct Histogram {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t counts[HIST_BUCKETS];
+} Histogram;
+
+/**
+ * @brief Sink configuration under test
+ *
+ * @field name   Name used in report
+ * @field sink   Sink that is registered for the run
+ * @field async  Started before the run and stopped after it, if set
+ */
+typedef struct Config {
+  const char   *name;
+  Logcie_Sink   sink;
+  Logcie_Async *async;
+} Config;
+
+/**
+ * @brief State of one producer thread
+ */
+typedef struct Producer {
+  pthread_t thread;
+  uint64_t  seed;
+  Histogram histogram;
+} Producer;
+
+static uint64_t calls         = 100000;
+static uint64_t rate          = 0;
+static uint32_t mix[4]        = {0, 90, 9, 1};
+static uint32_t mix_total     = 100;
+static uint32_t start_threads = 0;
+
+static Producer producers[MAX_THREADS];
+static Histogram total;
+
+static int highest_bit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+  return 63 - __builtin_clzll(value);
+#else
+  int bit = 0;
+
+  while (value >>= 1) {
+    bit++;
+  }
+
+  return bit;
+#endif
+}
+
+static size_t histogram_index(uint64_t value) {
+  if (value < (1u << HIST_SUB_BITS)) {
+    return (size_t)value;
+  }
+
+  if (value >> HIST_MAX_BITS) {
+    value = (1ull << HIST_MAX_BITS) - 1;
+  }
+
+  // Top HIST_SUB_BITS bits of the value select the bucket
+  int shift = highest_bit(value) - (HIST_SUB_BITS - 1);
+  return (1u << HIST_SUB_BITS) + (size_t)(shift - 1) * HIST_HALF + (size_t)((value >> shift) - HIST_HALF);
+}
+
+// Largest value that falls into the bucket
+static uint64_t histogram_value(size_t index) {
+  if (index < (1u << HIST_SUB_BITS)) {
+    return index;
+  }
+
+  size_t   offset = index - (1u << HIST_SUB_BITS);
+  int      shift  = (int)(offset / HIST_HALF) + 1;
+  uint64_t sub    = offset % HIST_HALF + HIST_HALF;
+  return ((sub + 1) << shift) - 1;
+}
+
+static void histogram_record(Histogram *histogram, uint64_t value) {
+  histogram->counts[histogram_index(value)]++;
+  histogram->count++;
+  histogram->sum += value;
+
+  if (value > histogram->max) {
+    histogram->max = value;
+  }
+}
+
+static void histogram_merge(Histogram *into, const Histogram *from) {
+  for (size_t i = 0; i < HIST_BUCKETS; i++) {
+    into->counts[i] += from->counts[i];
+  }
+
+  into->count += from->count;
+  into->sum += from->sum;
+
+  if (from->max > into->max) {
+    into->max = from->max;
+  }
+}
+
+static uint64_t histogram_percentile(const Histogram *histogram, double percentile) {
+  uint64_t rank = (uint64_t)((double)histogram->count * percentile / 100.0 + 0.5);
+  uint64_t seen = 0;
+
+  if (rank == 0) {
+    rank = 1;
+  }
+
+  for (size_t i = 0; i < HIST_BUCKETS; i++) {
+    seen += histogram->counts[i];
+
+    if (seen >= rank) {
+      uint64_t value = histogram_value(i);
+      return value < histogram->max ? value : histogram->max;
+    }
+  }
+
+  return histogram->max;
+}
+
+// xorshift64*
+static uint32_t next_random(uint64_t *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return (uint32_t)((*state * 2685821657736338717ull) >> 32);
+}
+
+static void log_call(uint32_t pick, uint64_t i) {
+  if (pick < mix[0]) {
+    LOGCIE_DEBUG("request %llu: cache lookup", (unsigned long long)i);
+  } else if (pick < mix[0] + mix[1]) {
+    LOGCIE_INFO("request %llu served in %d us", (unsigned long long)i, 137);
+  } else if (pick < mix[0] + mix[1] + mix[2]) {
+    LOGCIE_WARN("request %llu is slow: %d ms", (unsigned long long)i, 250);
+  } else {
+    LOGCIE_ERROR("request %llu failed: %s", (unsigned long long)i, "connection reset by peer");
+  }
+}
+
+static void *produce(void *arg) {
+  Producer *producer = (Producer *)arg;
+  uint64_t  interval = rate ? 1000000000ull / rate : 0;
+
+  // Threads start together, so they contend from the first call
+  _LOGCIE_ATOMIC_ADD(&start_threads, 1);
+
+  while (_LOGCIE_ATOMIC_LOAD(&start_threads) != 0) {
+    sched_yield();
+  }
+
+  uint64_t scheduled = logcie_now_ns();
+
+  for (uint64_t i = 0; i < calls; i++) {
+    uint32_t pick  = next_random(&producer->seed) % mix_total;
+    uint64_t start = logcie_now_ns();
+
+    if (interval) {
+      // Sleeps while the next call is far, so waiting threads leave CPU to others
+      if (start + 200000 < scheduled) {
+        struct timespec pause = {0, (long)(scheduled - start - 100000)};
+        nanosleep(&pause, NULL);
+        start = logcie_now_ns();
+      }
+
+      while (start < scheduled) {
+        start = logcie_now_ns();
+      }
+
+      start = scheduled;
+      scheduled += interval;
+    }
+
+    log_call(pick, i);
+    histogram_record(&producer->histogram, logcie_now_ns() - start);
+  }
+
+  return NULL;
+}
+
+static uint8_t run(uint32_t threads, uint64_t *elapsed) {
+  start_threads = 0;
+
+  for (uint32_t i = 0; i < threads; i++) {
+    memset(&producers[i].histogram, 0, sizeof(producers[i].histogram));
+    producers[i].seed = 0x9E3779B97F4A7C15ull * (i + 1);
+
+    if (pthread_create(&producers[i].thread, NULL, produce, &producers[i]) != 0) {
+      fprintf(stderr, "latency: can't start thread\n");
+      _LOGCIE_ATOMIC_STORE(&start_threads, 0);
+
+      for (uint32_t j = 0; j < i; j++) {
+        pthread_join(producers[j].thread, NULL);
+      }
+
+      return 0;
+    }
+  }
+
+  while (_LOGCIE_ATOMIC_LOAD(&start_threads) != threads) {
+    sched_yield();
+  }
+
+  uint64_t start = logcie_now_ns();
+  _LOGCIE_ATOMIC_STORE(&start_threads, 0);
+
+  for (uint32_t i = 0; i < threads; i++) {
+    pthread_join(producers[i].thread, NULL);
+  }
+
+  logcie_flush();
+  *elapsed = logcie_now_ns() - start;
+
+  memset(&total, 0, sizeof(total));
+
+  for (uint32_t i = 0; i < threads; i++) {
+    histogram_merge(&total, &producers[i].histogram);
+  }
+
+  return 1;
+}
+
+static uint8_t parse_mix(const char *text) {
+  uint32_t parsed[4] = {0, 0, 0, 0};
+  int      count     = sscanf(text, "%u,%u,%u,%u", &parsed[0], &parsed[1], &parsed[2], &parsed[3]);
+
+  if (count != 4 || parsed[0] + parsed[1] + parsed[2] + parsed[3] == 0) {
+    return 0;
+  }
+
+  memcpy(mix, parsed, sizeof(mix));
+  mix_total = parsed[0] + parsed[1] + parsed[2] + parsed[3];
+  return 1;
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: latency [-t threads] [-n calls] [-r rate] [-m mix] [-c configs] [-p policy] [-s path] [-o results.json]\n");
+  fprintf(stderr, "  -t  Max number of producer threads, runs 1, 2, 4, ... up to it (default: 8)\n");
+  fprintf(stderr, "  -n  Logging calls per thread (default: 100000)\n");
+  fprintf(stderr, "  -r  Calls per second of every thread, 0 is as fast as possible (default: 0)\n");
+  fprintf(stderr, "  -m  Weights of DEBUG,INFO,WARN,ERROR calls, sinks accept INFO and above (default: 0,90,9,1)\n");
+  fprintf(stderr, "  -c  Comma separated sink configurations: stdout,file,buffered,async (default: all)\n");
+  fprintf(stderr, "  -p  Overflow policy of async sink: newest, oldest, block (default: newest)\n");
+  fprintf(stderr, "  -s  Redirect stdout to the file for the stdout sink\n");
+  fprintf(stderr, "  -o  Write results as JSON to the file\n");
+}
+
+int main(int argc, char **argv) {
+  uint32_t    max_threads = 8;
+  const char *only        = "stdout,file,buffered,async";
+  const char *output      = NULL;
+  const char *redirect    = NULL;
+
+  static Logcie_Async async;
+  async.policy = LOGCIE_OVERFLOW_DROP_NEWEST;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      max_threads = (uint32_t)atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      calls = (uint64_t)atoll(argv[++i]);
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      rate = (uint64_t)atoll(argv[++i]);
+    } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+      if (!parse_mix(argv[++i])) {
+        usage();
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+      only = argv[++i];
+    } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+      const char *policy = argv[++i];
+
+      if (strcmp(policy, "newest") == 0) {
+        async.policy = LOGCIE_OVERFLOW_DROP_NEWEST;
+      } else if (strcmp(policy, "oldest") == 0) {
+        async.policy = LOGCIE_OVERFLOW_DROP_OLDEST;
+      } else if (strcmp(policy, "block") == 0) {
+        async.policy = LOGCIE_OVERFLOW_BLOCK;
+      } else {
+        usage();
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      redirect = argv[++i];
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  if (max_threads == 0 || max_threads > MAX_THREADS || calls == 0) {
+    fprintf(stderr, "latency: threads must be in 1..%d and calls above 0\n", MAX_THREADS);
+    return 1;
+  }
+
+  if (redirect && freopen(redirect, "w", stdout) == NULL) {
+    fprintf(stderr, "latency: can't redirect stdout to %s\n", redirect);
+    return 1;
+  }
+
+  FILE *unbuffered = tmpfile();
+  FILE *buffered   = tmpfile();
+
+  if (unbuffered == NULL || buffered == NULL || setvbuf(buffered, NULL, _IOFBF, 1 << 20) != 0) {
+    fprintf(stderr, "latency: can't create output files\n");
+    return 1;
+  }
+
+  static Logcie_LogLevel info_level = LOGCIE_LEVEL_INFO;
+  const char            *format     = "$d $t [$L] ($M) $m";
+  Logcie_Filter          filter     = {logcie_filter_level_min_fn, &info_level};
+  void                  *fd         = (void *)(intptr_t)fileno(unbuffered);
+
+  Config configs[] = {
+    {"stdout", {{logcie_printf_formatter, (void *)format}, {logcie_printf_writer, stdout, logcie_printf_writev, logcie_printf_flush}, filter, NULL, NULL}, NULL},
+    {"file", {{logcie_printf_formatter, (void *)format}, {logcie_fd_writer, fd, logcie_fd_writev, NULL}, filter, NULL, NULL}, NULL},
+    {"buffered", {{logcie_printf_formatter, (void *)format}, {logcie_printf_writer, buffered, logcie_printf_writev, logcie_printf_flush}, filter, NULL, NULL}, NULL},
+    {"async", {{logcie_printf_formatter, (void *)format}, {logcie_fd_writer, fd, logcie_fd_writev, NULL}, filter, NULL, NULL}, &async},
+  };
+
+  FILE *json = NULL;
+
+  if (output) {
+    json = fopen(output, "w");
+
+    if (json == NULL) {
+      fprintf(stderr, "latency: can't open %s\n", output);
+      return 1;
+    }
+
+    fprintf(json, "{\n  \"version\": \"%s\",\n  \"time\": %ld,\n  \"calls\": %llu,\n  \"rate\": %llu,\n  \"results\": [",
+            LOGCIE_VERSION_STRING,
+            (long)time(NULL),
+            (unsigned long long)calls,
+            (unsigned long long)rate);
+  }
+
+  // Cost of reading the clock is included in every recorded latency
+  uint64_t clock_start = logcie_now_ns();
+
+  for (int i = 0; i < 1000; i++) {
+    logcie_now_ns();
+  }
+
+  fprintf(stderr, "clock overhead: %.1f ns, calls per thread: %llu, rate: %llu/s, mix: %u,%u,%u,%u\n\n",
+          (double)(logcie_now_ns() - clock_start) / 1000,
+          (unsigned long long)calls,
+          (unsigned long long)rate,
+          mix[0], mix[1], mix[2], mix[3]);
+  fprintf(stderr, "%-10s %7s %12s %9s %9s %9s %9s %10s %10s %10s\n",
+          "sink", "threads", "calls/s", "mean ns", "p50", "p99", "p99.9", "p99.99", "max", "dropped");
+
+  uint8_t first = 1;
+  size_t  ran   = 0;
+
+  for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+    Config     *config = &configs[c];
+    const char *found  = strstr(only, config->name);
+    size_t      len    = strlen(config->name);
+
+    if (found == NULL || (found != only && found[-1] != ',') || (found[len] != '\0' && found[len] != ',')) {
+      continue;
+    }
+
+    ran++;
+
+    for (uint32_t threads = 1;; threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+      if (config->async) {
+        memset(config->async, 0, sizeof(*config->async));
+        config->async->policy = async.policy;
+
+        if (!logcie_async_start(&config->sink, config->async)) {
+          fprintf(stderr, "latency: can't start async worker\n");
+          break;
+        }
+      }
+
+      logcie_remove_all_sinks();
+      logcie_add_sink(&config->sink);
+
+      uint64_t elapsed = 0;
+      uint8_t  ok      = run(threads, &elapsed);
+      uint64_t dropped = 0;
+
+      logcie_remove_all_sinks();
+
+      if (config->async) {
+        logcie_async_stop(config->async);
+        dropped = config->async->dropped;
+      }
+
+      // Files are emptied, so every run starts with the same state
+      fflush(buffered);
+      rewind(buffered);
+      rewind(unbuffered);
+      ftruncate(fileno(buffered), 0);
+      ftruncate(fileno(unbuffered), 0);
+
+      if (!ok) {
+        break;
+      }
+
+      double mean       = (double)total.sum / (double)total.count;
+      double throughput = (double)total.count * 1e9 / (double)elapsed;
+
+      fprintf(stderr, "%-10s %7u %12.0f %9.0f %9llu %9llu %9llu %10llu %10llu %10llu\n",
+              config->name,
+              threads,
+              throughput,
+              mean,
+              (unsigned long long)histogram_percentile(&total, 50),
+              (unsigned long long)histogram_percentile(&total, 99),
+              (unsigned long long)histogram_percentile(&total, 99.9),
+              (unsigned long long)histogram_percentile(&total, 99.99),
+              (unsigned long long)total.max,
+              (unsigned long long)dropped);
+
+      if (json) {
+        fprintf(json, "%s\n    {\"sink\": \"%s\", \"threads\": %u, \"calls_per_sec\": %.0f, \"mean_ns\": %.1f, "
+                      "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"p9999_ns\": %llu, \"max_ns\": %llu, \"dropped\": %llu}",
+                first ? "" : ",",
+                config->name,
+                threads,
+                throughput,
+                mean,
+                (unsigned long long)histogram_percentile(&total, 50),
+                (unsigned long long)histogram_percentile(&total, 99),
+                (unsigned long long)histogram_percentile(&total, 99.9),
+                (unsigned long long)histogram_percentile(&total, 99.99),
+                (unsigned long long)total.max,
+                (unsigned long long)dropped);
+        first = 0;
+      }
+
+      if (threads == max_threads) {
+        break;
+      }
+    }
+  }
+
+  if (json) {
+    fprintf(json, "\n  ]\n}\n");
+    fclose(json);
+  }
+
+  fclose(unbuffered);
+  fclose(buffered);
+
+  if (ran == 0) {
+    fprintf(stderr, "latency: no sink configuration matches '%s'\n", only);
+    return 1;
+  }
+
+  return 0;
+}
+#else
+int main(void) {
+  fprintf(stderr, "latency: needs threads (POSIX without LOGCIE_NO_THREADS)\n");
+  return 1;
+}
+#endif
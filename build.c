@@ -20,6 +20,7 @@ typedef intptr_t pid_t;
 
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 
 #define PATH_SEP "/"
 
@@ -57,6 +58,7 @@ pid_t run_cmd(char *const argv[]) {
 
   return result;
 #else
+  fflush(stdout);
   pid_t cpid = fork();
 
   if (cpid < 0) {
@@ -78,6 +80,26 @@ pid_t run_cmd(char *const argv[]) {
   return -1;
 }
 
+int wait_cmd(pid_t pid) {
+  int status = 0;
+
+#ifdef _WIN32
+  if (_cwait(&status, pid, 0) == -1) {
+    fprintf(stderr, "Could not wait for child process: %s\n", strerror(errno));
+    return -1;
+  }
+
+  return status;
+#else
+  if (waitpid(pid, &status, 0) < 0) {
+    fprintf(stderr, "Could not wait for child process: %s\n", strerror(errno));
+    return -1;
+  }
+
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+}
+
 int dir_exists(const char *path) {
 #ifdef _WIN32
   DWORD attr = GetFileAttributesA(path);
@@ -121,7 +143,43 @@ void explode(char *str, char **arr) {
     arr[i] = NULL;
 }
 
-int main(void) {
+// Builds benchmark with optimizations and runs it with `run` arguments
+int run_bench(char *source, char *binary, char *const run[]) {
+  char *compile[] = {"clang", "-Wall", "-Wextra", "-std=c11", "-O2", "-I.", "-o", binary, source, "-lpthread", NULL};
+
+  fprintf(stdout, "+ clang -Wall -Wextra -std=c11 -O2 -I. -o %s %s -lpthread\n", binary, source);
+
+  if (wait_cmd(run_cmd(compile)) != 0) {
+    return 1;
+  }
+
+  fprintf(stdout, "+");
+
+  for (size_t i = 0; run[i]; i++) {
+    fprintf(stdout, " %s", run[i]);
+  }
+
+  fprintf(stdout, "\n");
+  return wait_cmd(run_cmd(run)) != 0;
+}
+
+// Microbenchmarks of pipeline stages, results are also saved to out/bench.json
+int bench(void) {
+  char *run[] = {"out"PATH_SEP"bench", "-o", "out"PATH_SEP"bench.json", NULL};
+  return run_bench("bench"PATH_SEP"bench.c", "out"PATH_SEP"bench", run);
+}
+
+// Tail latency under contention, results are also saved to out/latency.json
+int latency(void) {
+#ifdef _WIN32
+  char *run[] = {"out"PATH_SEP"latency", "-s", "NUL", "-o", "out"PATH_SEP"latency.json", NULL};
+#else
+  char *run[] = {"out"PATH_SEP"latency", "-s", "/dev/null", "-o", "out"PATH_SEP"latency.json", NULL};
+#endif
+  return run_bench("bench"PATH_SEP"latency.c", "out"PATH_SEP"latency", run);
+}
+
+int main(int argc, char **argv) {
   LOGCIE_INFO("Build system started...");
 
   struct stat st = {0};
@@ -131,6 +189,19 @@ int main(void) {
     return 1;
   }
 
+  if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+    return bench();
+  }
+
+  if (argc > 1 && strcmp(argv[1], "latency") == 0) {
+    return latency();
+  }
+
+  if (argc > 1) {
+    fprintf(stderr, "Unknown target %s. Available targets: bench, latency\n", argv[1]);
+    return 1;
+  }
+
   char *examples[] = {
     "clang -Wall -Wextra -std=c11 -I. -o out"PATH_SEP"custom_colors    examples"PATH_SEP"custom_colors.c",
     "clang -Wall -Wextra -std=c11 -I. -o out"PATH_SEP"custom_formatter examples"PATH_SEP"custom_formatter.c",
@@ -139,7 +210,13 @@ int main(void) {
     "clang -Wall -Wextra -std=c99 -I. -o out"PATH_SEP"pedantic_99      examples"PATH_SEP"pedantic_99.c -pedantic",
     "clang -Wall -Wextra -std=c11 -I. -o out"PATH_SEP"simple           examples"PATH_SEP"simple.c",
     "clang -Wall -Wextra -std=c11 -I. -o out"PATH_SEP"sink             examples"PATH_SEP"sink.c",
+    "clang -Wall -Wextra -std=c11 -I. -o out"PATH_SEP"static_sinks     examples"PATH_SEP"static_sinks.c",
     "g++ -Wall -Wextra -I. -o ./out"PATH_SEP"cpp examples"PATH_SEP"cpp.cpp",
+    "g++ -Wall -Wextra -I. -o ./out"PATH_SEP"cpp_format examples"PATH_SEP"cpp_format.cpp",
+    "g++ -Wall -Wextra -I. -o ./out"PATH_SEP"cpp_pipeline examples"PATH_SEP"cpp_pipeline.cpp",
+#ifndef _WIN32
+    "clang -Wall -Wextra -std=c11 -I. -o out"PATH_SEP"logcie-tail      tools"PATH_SEP"logcie_tail.c",
+#endif
   };
 
   for (size_t i = 0; i < ARR_LEN(examples); i++) {
@@ -31,11 +31,13 @@ bool filter_timeout(void *data, Logcie_Log &log) {
 int main() {
   Logcie_Sink console = {
     .formatter = {logcie_printf_formatter, (void*)("[$M::$c$L$r] $m")},
-    .writer = {logcie_printf_writer, stdout},
+    .writer = {logcie_printf_writer, stdout, logcie_printf_writev, logcie_printf_flush},
     .filter = logcie_filter_or(
       logcie_filter_level_min(LOGCIE_LEVEL_INFO),
       logcie_filter_message_contains("IMPORTANT")
-    )
+    ),
+    .dedup = NULL,
+    .async = NULL,
   };
 
   logcie_add_sink(&console);
@@ -0,0 +1,56 @@
+#include <cstdio>
+#include <string>
+
+#define LOGCIE_IMPLEMENTATION
+#include <logcie.hpp>
+
+struct Point {
+  int x;
+  int y;
+};
+
+// Teach logcie how to print your own types
+namespace logcie {
+template <>
+struct formatter<Point> {
+  static constexpr Kind kind = Kind::Custom;
+
+  static void format(Logcie_Buffer &out, const Point &point, const FormatSpec &) {
+    format_to(out, LOGCIE_FMT("({}, {})"), point.x, point.y);
+  }
+};
+} // namespace logcie
+
+int main() {
+  Logcie_Sink console = {
+    {logcie_printf_formatter, (void*)("[$c$L$r] $f:$x $m")},
+    {logcie_printf_writer, stdout, logcie_printf_writev, logcie_printf_flush},
+    logcie_filter_level_min(LOGCIE_LEVEL_VERBOSE),
+    NULL,
+    NULL,
+  };
+
+  logcie_remove_all_sinks();
+  logcie_add_sink(&console);
+
+  std::string user   = "strongleong";
+  Point       cursor = {12, 7};
+
+  // Format is checked at compile time: wrong number of arguments or
+  // `{:x}` for a string would not compile
+  logcie::info(LOGCIE_FMT("Hello, {}!"), user);
+  logcie::verbose(LOGCIE_FMT("Cursor at {}, {:.1f}% done"), cursor, 42.25);
+  logcie::warn(LOGCIE_FMT("[{:>8}] [{:<8}] flags={:X}"), "right", "left", 0xBEEFu);
+  logcie::debug(LOGCIE_FMT("Filtered out, arguments are not even formatted: {}"), user);
+
+#if __cplusplus >= 202002L
+  // Since C++20 every literal is checked, no macro needed
+  logcie::error("Failed to open {} (errno {})", "config.ini", 2);
+#endif
+
+  // Formats that are not literals are checked while rendering
+  const char *fmt = "Runtime format {} {}";
+  logcie::info(logcie::runtime(fmt), 1);
+
+  return 0;
+}
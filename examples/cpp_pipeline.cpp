@@ -0,0 +1,47 @@
+#include <cstdio>
+
+#define LOGCIE_IMPLEMENTATION
+#include <logcie.hpp>
+
+// Formats can be named types too, so pipeline type can be spelled out
+struct ConsoleFormat {
+  static constexpr const char *value() {
+    return "$c$L$r$<7 $f:$x: $m";
+  }
+};
+
+// Any callable works as a filter
+struct OnlyErrors {
+  bool operator()(const Logcie_Log &log) const {
+    return log.level >= LOGCIE_LEVEL_ERROR;
+  }
+};
+
+typedef logcie::Pipeline<logcie::MinLevel<LOGCIE_LEVEL_INFO>, logcie::Format<ConsoleFormat>, logcie::FileWriter> ConsolePipeline;
+
+int main() {
+  char          memory[1024];
+  Logcie_Buffer errors_buffer = {memory, 0, sizeof(memory), 0};
+
+  ConsolePipeline console;
+  auto            errors = logcie::make_pipeline(OnlyErrors(),
+                                                 logcie::format(LOGCIE_FMT("$d $t [$L] ($M) $m")),
+                                                 logcie::FileWriter(stderr),
+                                                 logcie::BufferWriter(&errors_buffer));
+
+  // Pipelines live in the same sink list as C sinks
+  logcie_remove_all_sinks();
+  logcie_add_sink(console.sink());
+  logcie_add_sink(errors.sink());
+
+  LOGCIE_INFO("C macros reach pipelines: %d sinks", (int)logcie_get_sink_count());
+  logcie::info(LOGCIE_FMT("So does the C++ front-end, {}"), "as usual");
+  LOGCIE_DEBUG("Below MinLevel, this call site is disabled");
+  logcie::error(LOGCIE_FMT("Goes to console, stderr and memory"));
+
+  // Or skip the sink list and call a pipeline directly
+  console.log(LOGCIE_LEVEL_WARN, LOGCIE_FMT("Only console sees this"));
+
+  std::printf("Captured errors:\n%s", memory);
+  return 0;
+}
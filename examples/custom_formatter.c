@@ -12,8 +12,12 @@ size_t my_simple_formatter(Logcie_Writer *writer, void *user_data, Logcie_Log lo
   strftime(time_buf, sizeof(time_buf), "%H:%M:%S", tminfo);
 
   writer->write(writer->data, "[%s] [%s] (%s) ", NULL, time_buf, get_logcie_level_label_upper(log.level), log.module ? log.module : "none");
-  writer->write(writer->data, log.msg, args);
-  writer->write(writer->data, "\n", NULL);
+  // Message is already rendered once for all sinks. `writer->write(writer->data, log.msg, args)`
+  // would work too, but would expand it again
+  (void)args;
+  size_t      len;
+  const char *message = logcie_log_message(&log, &len);
+  writer->write(writer->data, "%.*s\n", NULL, (int)len, message);
 
   return 0;
 }
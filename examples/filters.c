@@ -88,10 +88,21 @@ int main(void) {
     .filter    = {filter_timout, &(TimeoutFilterData){.last_time = 0, .timeout_ms = 1000}}
   };
 
+  // Same idea, but built-in: thread-safe token bucket that allows bursts of 3 logs
+  // per module and then one log per second
+  static Logcie_RateLimit limit = {.burst = 3, .per_second = 1, .key = LOGCIE_RATE_LIMIT_PER_MODULE};
+
+  Logcie_Sink rate_limited = {
+    .formatter = {logcie_printf_formatter, "[rate limited] $L [$M] $m"},
+    .writer    = {logcie_printf_writer, stdout},
+    .filter    = logcie_filter_rate_limit(&limit)
+  };
+
   logcie_add_sink(&prod_console);
   logcie_add_sink(&faulty_module_supressor);
   logcie_add_sink(&debug_specific_module);
   logcie_add_sink(&max_one_log_per_second);
+  logcie_add_sink(&rate_limited);
 
   LOGCIE_TRACE("Logcie inited");
   LOGCIE_INFO("App started");
@@ -103,5 +114,7 @@ int main(void) {
   LOGCIE_INFO("Working good");
   LOGCIE_INFO("Shutdown");
 
+  printf("Rate limiter suppressed %llu logs\n", (unsigned long long)logcie_rate_limit_suppressed(&limit));
+
   return 0;
 }
@@ -15,8 +15,9 @@ int main(void) {
 
   Logcie_Sink file_sink = {
     .writer = {
-      .write = logcie_printf_writer,
-      .data  = logfile,
+      .write  = logcie_printf_writer,
+      .data   = logfile,
+      .writev = logcie_printf_writev, // Optional. Built-in formatter writes whole log with one call
     },
     // nice format: date, time, level, module, message
     .formatter = {logcie_printf_formatter, "$d $t [$L] ($M) $m"},
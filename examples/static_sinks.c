@@ -0,0 +1,38 @@
+#include <stdio.h>
+
+// Declarations first, static sinks refer to logcie types and functions
+#include <logcie.h>
+
+// Sinks that are known at build time are listed before the implementation,
+// so dispatcher calls their formatter and writer directly
+static const Logcie_LogLevel console_level = LOGCIE_LEVEL_INFO;
+static char                  memory[1024];
+static Logcie_Buffer         recent = {memory, 0, sizeof(memory), 0};
+
+#define LOGCIE_STATIC_SINKS(X)                                                                           \
+  X(logcie_filter_level_min_fn, &console_level, logcie_printf_formatter, "$c$L$r $f:$x: $m",             \
+    logcie_printf_writer, logcie_printf_writev, stdout)                                                  \
+  X(logcie_filter_pass_fn, NULL, logcie_printf_formatter, "$L $m", logcie_buffer_writer, logcie_buffer_writev, &recent)
+
+#define LOGCIE_IMPLEMENTATION
+#include <logcie.h>
+
+int main(void) {
+  LOGCIE_INFO("Static sinks need no setup");
+  LOGCIE_DEBUG("Console skips this one, memory keeps it");
+
+  // Dynamic sinks still work and are called after static ones
+  Logcie_Sink errors = {
+    .formatter = {logcie_printf_formatter, "!!! $m"},
+    .writer    = {logcie_printf_writer, stderr, logcie_printf_writev, logcie_printf_flush},
+    .filter    = logcie_filter_level_min(LOGCIE_LEVEL_ERROR),
+    .dedup     = NULL,
+    .async     = NULL,
+  };
+
+  logcie_add_sink(&errors);
+  LOGCIE_ERROR("Goes to all three sinks");
+
+  printf("Memory sink:\n%s", recent.data);
+  return 0;
+}
@@ -39,6 +39,9 @@
  *
  *   A combination of Formatter, Writer and Filter is called a Sink.
  *   You can have as many sinks as you want. Logcie will send logs to every sinks available.
+ *   Sinks with the same formatter (same function and data) share the output: log is
+ *   formatted once into a buffer and the buffer is passed to writer of each sink. So
+ *   formatter output should depend only on the log and formatter data, not on the writer.
  *
  *   Logcie itself is basically an array of Sinks and system of distributing logs to those Sinks.
  *
@@ -46,7 +49,7 @@
  *   It would not be that great if Logcie was just empty framework and you need to set it up by yourself,
  *   so Logcie comes with a couple of pre-defined functions:
  *
- *      - logcie_printf_writer    - built-in writer. Outputs logs in FILE* via vfprintf
+ *      - logcie_printf_writer    - built-in writer. Outputs logs in FILE* (printf formats are rendered by logcie_vformat)
  *      - logcie_printf_formatter - built-in formatter that provides rich formatting using $ tokens. Here is the list:
  *                                   `$m` - Log message with printf formatting
  *                                   `$f` - Source file name
@@ -93,6 +96,13 @@
  *   Ensure that any Sink you create remains valid for as long as it is in use.
  *   TIP: Just have them in main function, or in static/global scope.
  *
+ *   Logging never calls the allocator. Once the first log warmed up stdio buffers
+ *   and connections of the writers, logcie_log, filters, built-in formatters and
+ *   writers, async queues, scopes and flight recorder use only static, thread-local
+ *   or sink-owned memory. Only logcie_add_sink (it grows the sink array),
+ *   logcie_remove_all_sinks and logcie_remove_and_free_sink call malloc/realloc/free.
+ *   The test suite checks it with an interposed allocator.
+ *
  * Filters:
  *   Filters allow you to control which logs are emitted to a specific Sink.
  *   Each Sink can have its own filter, enabling fine-grained routing of logs.
@@ -124,6 +134,19 @@
  *        Allows logs based on user-provied predicate function. This exists to
  *        make it easier if you don't need custom data in your filter
  *
+ *    - logcie_filter_patterns(&set)
+ *        Allows logs which message contains any of the patterns compiled with
+ *        logcie_patterns_compile() into Logcie_PatternSet. All patterns are matched
+ *        in one pass, optionally over the rendered message (see logcie_log_message)
+ *
+ *    - logcie_filter_regex(&re)
+ *        Allows logs which message, module or file matches regular expression
+ *        compiled with logcie_regex_compile() (POSIX ERE subset, linear time)
+ *
+ *    - logcie_filter_rate_limit(&limit)
+ *        Allows logs while token bucket of Logcie_RateLimit has tokens. Buckets can
+ *        be global, per module or per call site. Lock-free and counts suppressed logs
+ *
  *   Combining filters:
  *
  *    - logcie_filter_and(a, b)
@@ -177,6 +200,129 @@
  *     - Be careful when using temporary data in filters (they rely on
  *       compound literals and must remain valid during logging).
  *
+ * Call sites:
+ *   Every LOGCIE_* macro expansion is a call site with its own static cache that remembers
+ *   whether any sink may be interested in it. Decision is made once using level filters
+ *   (`logcie_filter_level_min`, `logcie_filter_level_max` and their combinations), so a call
+ *   site that no sink accepts costs a single compare. Any other filter keeps call site enabled.
+ *
+ *   Cache is invalidated when sinks are added or removed. If you change `filter` of a sink
+ *   that is already registered, call `logcie_invalidate_callsites()`.
+ *
+ *   Call site descriptors are `static const` and on ELF targets (C only) are placed in
+ *   `logcie_callsites` linker section. This allows to enumerate every log statement of the program,
+ *   even ones that were never executed:
+ *     ```c
+ *     for (size_t i = 0; i < logcie_callsite_count(); i++) {
+ *       const Logcie_CallSite *site = logcie_callsite_get(i);
+ *       printf("%s:%u %s\n", site->file, site->line, site->fmt ? site->fmt : "?");
+ *     }
+ *     ```
+ *
+ *   Call sites can also be enabled or disabled in runtime:
+ *     ```c
+ *     logcie_callsite_set("net.c", 42, LOGCIE_CALLSITE_DISABLED); // Silence net.c:42
+ *     logcie_callsite_set("db.c", 0, LOGCIE_CALLSITE_DISABLED);   // Silence whole db.c
+ *     logcie_callsite_set("db.c", 0, LOGCIE_CALLSITE_DEFAULT);    // Remove the rule
+ *     ```
+ *
+ * Static sinks:
+ *   Sinks known at build time can be listed in LOGCIE_STATIC_SINKS X-macro before including
+ *   the implementation. Each entry is `X(filter, filter_data, formatter, formatter_data, write, writev, writer_data)`
+ *   and becomes a block of direct calls in the dispatcher instead of a pointer in the sink list,
+ *   so the compiler (or LTO) can inline the whole chain:
+ *     ```c
+ *     #include "logcie.h"
+ *
+ *     static const Logcie_LogLevel min_info = LOGCIE_LEVEL_INFO;
+ *     #define LOGCIE_STATIC_SINKS(X)                                                                 \
+ *       X(logcie_filter_level_min_fn, &min_info, logcie_printf_formatter, "[$L] $m",                   \
+ *         logcie_printf_writer, logcie_printf_writev, stdout)                                          \
+ *       X(logcie_filter_pass_fn, NULL, logcie_printf_formatter, "$d $t $L $f:$x $m",                  \
+ *         logcie_fd_writer, logcie_fd_writev, (intptr_t)log_fd)
+ *     #define LOGCIE_IMPLEMENTATION
+ *     #include "logcie.h"
+ *     ```
+ *   Static sinks are called first, in order, then sinks added with `logcie_add_sink`. They replace
+ *   the default stdout sink. Arguments are evaluated on every log, so they may be variables. Static
+ *   sinks have no duplicate suppression and can't be removed.
+ *
+ * Syslog:
+ *   On unix, logcie_syslog_sink sends logs to local syslog daemon (`/dev/log`) or journald
+ *   native socket as AF_UNIX datagrams, without libc `syslog()`. Records are batched and sent
+ *   with one `sendmmsg`, a missing or full socket only increments `dropped`. See Logcie_Syslog:
+ *     ```c
+ *     static Logcie_Syslog syslog_state = {.app_name = "myapp", .linger_ms = 100};
+ *     Logcie_Sink sink = logcie_syslog_sink(&syslog_state);
+ *     logcie_add_sink(&sink);
+ *     ```
+ *
+ *   logcie_net_sink forwards whole records to a TCP or UDP collector. Records are framed
+ *   (newline or length prefix), coalesced in a bounded buffer and sent without blocking.
+ *   See Logcie_Net.
+ *
+ * Shared memory:
+ *   Shared memory sink puts records into a POSIX shared memory ring without syscalls,
+ *   a separate process (tools/logcie_tail.c) formats and ships them. See Logcie_Shm:
+ *     ```c
+ *     static Logcie_Shm shm = {.name = "/myapp-logs"};
+ *     logcie_shm_open(&shm);
+ *     shm_sink = logcie_shm_sink(&shm);
+ *     ```
+ *   ```sh
+ *   logcie-tail -f '$d $t [$L] $m' /myapp-logs
+ *   ```
+ *
+ * Async sinks:
+ *   Writer of a slow sink can be moved to its own worker thread. Log is still filtered and
+ *   formatted on the logging thread, but the line goes to a bounded queue of the sink,
+ *   and other sinks and the caller don't wait for the writer. See Logcie_Async:
+ *     ```c
+ *     static Logcie_Async async = {.policy = LOGCIE_OVERFLOW_DROP_OLDEST};
+ *     logcie_async_start(&net_sink, &async);
+ *     logcie_add_sink(&net_sink);
+ *     ```
+ *   Threads are used on unix, define LOGCIE_NO_THREADS to build without them.
+ *
+ * Flight recorder:
+ *   Recorder sink keeps the last LOGCIE_FLIGHT_RECORDS formatted records in a lock-free ring
+ *   and writes them to a real sink only when an ERROR arrives. See Logcie_FlightRecorder:
+ *     ```c
+ *     static Logcie_FlightRecorder recorder = {.target = &stderr_sink};
+ *     static Logcie_Sink recorder_sink;
+ *     recorder_sink = logcie_flight_recorder_sink(&recorder);
+ *     logcie_add_sink(&recorder_sink);
+ *     ```
+ *
+ * Scopes:
+ *   Logs of a request can be held back and written only if the request fails:
+ *     ```c
+ *     logcie_scope_begin(LOGCIE_LEVEL_INFO); // TRACE and DEBUG of this thread are held
+ *     // ...
+ *     logcie_scope_end(ok);                  // Held logs are dropped if ok, written otherwise
+ *     ```
+ *   An ERROR inside the scope writes held logs at once. See logcie_scope_begin.
+ *
+ * Flushing and crashes:
+ *   logcie_flush() writes everything sinks keep in memory: async queues, syslog and
+ *   network batches, stdio buffers. It is called after every LOGCIE_FATAL, so fatal log
+ *   is out before the program aborts. On unix, logcie_install_crash_handler() does the
+ *   same with async-signal-safe calls when the program gets SIGSEGV, SIGABRT, etc.,
+ *   then lets the signal kill the program:
+ *     ```c
+ *     logcie_install_crash_handler();
+ *     ```
+ *
+ * Duplicate suppression:
+ *   Set `dedup` of a sink to collapse repeated logs (same call site and rendered message)
+ *   into one `last message repeated N times` log. See Logcie_Dedup:
+ *     ```c
+ *     static Logcie_Dedup dedup = {.window_ms = 0, .summary_every = 1000};
+ *     sink.dedup = &dedup;
+ *     // ...
+ *     logcie_dedup_flush(&sink); // Write pending summaries
+ *     ```
+ *
  * Modules:
  *   Logcie has another important concept: modules. A module is simply a string used
  *   to label a *scope* where the log originated.
@@ -322,6 +468,27 @@ extern "C" {
 #include <string.h>
 #include <time.h>
 
+// Async sinks need threads
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(LOGCIE_NO_THREADS)
+#define _LOGCIE_THREADS
+#include <pthread.h>
+#endif
+
+// Atomics. Without GCC builtins they degrade to plain (not thread-safe) operations
+#if defined(__GNUC__) || defined(__clang__)
+#define _LOGCIE_ATOMIC_LOAD(ptr)                   __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define _LOGCIE_ATOMIC_STORE(ptr, val)             __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#define _LOGCIE_ATOMIC_ADD(ptr, val)               __atomic_add_fetch(ptr, val, __ATOMIC_ACQ_REL)
+#define _LOGCIE_ATOMIC_CAS(ptr, expected, desired) __atomic_compare_exchange_n(ptr, expected, desired, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define _LOGCIE_ATOMIC_FENCE()                     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+#define _LOGCIE_ATOMIC_LOAD(ptr)                   (*(ptr))
+#define _LOGCIE_ATOMIC_STORE(ptr, val)             (*(ptr) = (val))
+#define _LOGCIE_ATOMIC_ADD(ptr, val)               (*(ptr) += (val))
+#define _LOGCIE_ATOMIC_CAS(ptr, expected, desired) (*(ptr) == *(expected) ? (*(ptr) = (desired), 1) : (*(expected) = *(ptr), 0))
+#define _LOGCIE_ATOMIC_FENCE()
+#endif
+
 /**
  * @enum Logcie_LogLevel
  * @brief Enumerates all available log severity levels.
@@ -388,6 +555,24 @@ typedef struct Logcie_Sink Logcie_Sink;
  */
 typedef struct Logcie_Log Logcie_Log;
 
+/**
+ * @brief Static descriptor of a single LOGCIE_* call site.
+ * @see struct Logcie_CallSite
+ */
+typedef struct Logcie_CallSite Logcie_CallSite;
+
+/**
+ * @brief Duplicate suppression state of a sink.
+ * @see struct Logcie_Dedup
+ */
+typedef struct Logcie_Dedup Logcie_Dedup;
+
+/**
+ * @brief Background writing state of a sink.
+ * @see struct Logcie_Async
+ */
+typedef struct Logcie_Async Logcie_Async;
+
 /**
  * @brief Writer function type signature
  *
@@ -402,17 +587,58 @@ typedef struct Logcie_Log Logcie_Log;
  */
 typedef size_t(Logcie_WriterFn)(void *user_data, const char *fmt, va_list *va, ...);
 
+/**
+ * @brief Piece of output passed to gather writer
+ *
+ * @field ptr  Start of the piece (not NUL-terminated)
+ * @field len  Length of the piece
+ */
+typedef struct Logcie_Segment {
+  const char *ptr;
+  size_t      len;
+} Logcie_Segment;
+
+/**
+ * @brief Gather writer function type signature
+ *
+ * Optional second entry point of a writer. Receives already formatted pieces of
+ * a log (literal parts of format string, level label, rendered message, etc.)
+ * without copying them into one buffer, so writer does not need to interpret
+ * printf formats. Maps directly onto `writev`.
+ *
+ * @param user_data  Data for writing logs (same as for Logcie_WriterFn)
+ * @param segments   Pieces to write in order
+ * @param count      Number of pieces
+ * @return Total number of characters written to the sink by writer
+ */
+typedef size_t(Logcie_WriterVFn)(void *user_data, const Logcie_Segment *segments, size_t count);
+
+/**
+ * @brief Writer flush function type signature
+ *
+ * Optional third entry point of a writer. Pushes out everything the writer keeps
+ * in memory (stdio buffer, batch of records, etc.). Called by logcie_flush, so
+ * also before LOGCIE_FATAL returns.
+ *
+ * @param user_data  Data for writing logs (same as for Logcie_WriterFn)
+ */
+typedef void(Logcie_WriterFlushFn)(void *user_data);
+
 /**
  * @brief Writer struct
  *
  * Stores writer function pointer and custom data for it
  *
- * @param write  Writer function pointer
- * @param data   Custom data for writer function
+ * @param write   Writer function pointer
+ * @param data    Custom data for writer function
+ * @param writev  Optional gather writer function pointer (see logcie_writer_writev)
+ * @param flush   Optional flush function pointer (see logcie_writer_flush)
  */
 typedef struct Logcie_Writer {
-  Logcie_WriterFn *write;
-  void            *data;
+  Logcie_WriterFn      *write;
+  void                 *data;
+  Logcie_WriterVFn     *writev;
+  Logcie_WriterFlushFn *flush;
 } Logcie_Writer;
 
 /**
@@ -479,11 +705,15 @@ typedef struct Logcie_Filter {
  * @field formatter  Formatter that will format logs
  * @field writer     Writer that will write logs
  * @field filter     Filter for filtering logs
+ * @field dedup      Optional duplicate suppression (see Logcie_Dedup)
+ * @field async      Optional background writing, set by logcie_async_start (see Logcie_Async)
  */
 struct Logcie_Sink {
   Logcie_Formatter formatter;
   Logcie_Writer    writer;
   Logcie_Filter    filter;
+  Logcie_Dedup    *dedup;
+  Logcie_Async    *async;
 };
 
 /**
@@ -510,14 +740,73 @@ typedef struct Logcie_LogLocation {
  * @field msg       Format string for the log message
  * @field time      Timestamp when the log was created
  * @field module    Optional module name for categorizing logs
- * @field location  Source file and line number where log was called
+ * @field location     Source file and line number where log was called
+ * @field callsite     Descriptor of the call site (NULL if log was not emitted by LOGCIE_* macros)
+ * @field message      Rendered message (NULL until rendered, see logcie_log_message)
+ * @field message_len  Length of rendered message
+ * @field args         Internal. Arguments of `msg`, valid only while log is dispatched
  */
 struct Logcie_Log {
+  Logcie_LogLevel        level;
+  const char            *msg;
+  time_t                 time;
+  const char            *module;
+  Logcie_LogLocation     location;
+  const Logcie_CallSite *callsite;
+  const char            *message;
+  size_t                 message_len;
+  va_list               *args;
+};
+
+#ifndef LOGCIE_MESSAGE_MAX
+#define LOGCIE_MESSAGE_MAX 1024
+#endif
+
+#ifndef LOGCIE_DEDUP_SLOTS
+#define LOGCIE_DEDUP_SLOTS 16
+#endif
+
+/**
+ * @brief One tracked message in Logcie_Dedup table
+ *
+ * @field hash      Hash of call site and rendered message
+ * @field since     Time (ns) when message was emitted last time
+ * @field repeated  Number of suppressed duplicates since then
+ * @field level     Level of the message (for summary)
+ * @field module    Module of the message (for summary)
+ * @field location  Location of the message (for summary)
+ */
+typedef struct Logcie_DedupEntry {
+  uint64_t           hash;
+  uint64_t           since;
+  uint32_t           repeated;
   Logcie_LogLevel    level;
-  const char        *msg;
-  time_t             time;
   const char        *module;
   Logcie_LogLocation location;
+} Logcie_DedupEntry;
+
+/**
+ * @brief Duplicate suppression state of a sink
+ *
+ * Logs that passed the filter are hashed by call site and rendered message.
+ * Duplicates are not formatted, but counted, and are replaced by a single
+ * `last message repeated N times` log.
+ *
+ * With `window_ms == 0` only consecutive duplicates are collapsed and summary is
+ * written when a different message arrives. Otherwise the last LOGCIE_DEDUP_SLOTS
+ * messages are tracked and a message is written again (after summary) once
+ * `window_ms` passed since it was written last time.
+ *
+ * Zero initialize it and set configuration fields. Not thread-safe.
+ *
+ * @field window_ms      Window of duplicates. 0 means only consecutive duplicates
+ * @field summary_every  Write summary after this many duplicates even if they continue. 0 means never
+ * @field entries        Internal. Table of tracked messages
+ */
+struct Logcie_Dedup {
+  uint32_t          window_ms;
+  uint32_t          summary_every;
+  Logcie_DedupEntry entries[LOGCIE_DEDUP_SLOTS];
 };
 
 // Helper macro for constructing a log message
@@ -541,37 +830,197 @@ struct Logcie_Log {
 #endif
 #endif
 
+/**
+ * @brief Mutable part of a call site: cached enable decision and parsed format.
+ *
+ * @field generation  Generation in which `enabled` was computed (0 - never computed)
+ * @field enabled     Cached decision: 1 if call site should reach sinks, 0 otherwise
+ * @field format      Internal. Parsed format string of the call site (NULL until first rendering)
+ */
+typedef struct Logcie_CallSiteCache {
+  uint32_t                        generation;
+  uint8_t                         enabled;
+  const struct Logcie_FormatPlan *format;
+} Logcie_CallSiteCache;
+
+/**
+ * @brief Static descriptor of a single LOGCIE_* call site.
+ *
+ * Every LOGCIE_* macro expansion emits one `static const` descriptor and passes
+ * only a pointer to it, instead of building the whole log on the caller side.
+ *
+ * On ELF targets (C only) descriptors are placed into `logcie_callsites` linker
+ * section, so every log statement of the program can be enumerated at startup
+ * (see logcie_callsite_count and logcie_callsite_get), even ones that were never executed.
+ *
+ * Descriptor also points to a cache that remembers whether any registered sink may be
+ * interested in logs from this call site, so a disabled call site costs one load
+ * and compare. The cache is invalidated by a global generation counter which is
+ * bumped every time sinks or call site rules change.
+ *
+ * @field level  Log level of the call site
+ * @field line   Line number of the call site
+ * @field file   Source file name of the call site
+ * @field fmt    Format string if it is a literal, NULL otherwise
+ * @field cache  Cached enable decision
+ */
+struct Logcie_CallSite {
+  Logcie_LogLevel       level;
+  uint32_t              line;
+  const char           *file;
+  const char           *fmt;
+  Logcie_CallSiteCache *cache;
+};
+
+/**
+ * @enum Logcie_CallSiteState
+ * @brief Runtime override for call sites (see logcie_callsite_set)
+ *
+ * @value LOGCIE_CALLSITE_DEFAULT   Call site is enabled if any sink may accept its level
+ * @value LOGCIE_CALLSITE_ENABLED   Call site always reaches sinks (sink filters still apply)
+ * @value LOGCIE_CALLSITE_DISABLED  Call site is never emitted
+ */
+typedef enum Logcie_CallSiteState {
+  LOGCIE_CALLSITE_DEFAULT,
+  LOGCIE_CALLSITE_ENABLED,
+  LOGCIE_CALLSITE_DISABLED,
+} Logcie_CallSiteState;
+
+#ifndef LOGCIE_CALLSITE_RULES_MAX
+#define LOGCIE_CALLSITE_RULES_MAX 32
+#endif
+
+/**
+ * @brief Global call site generation. Do not modify directly, use logcie_invalidate_callsites().
+ */
+LOGCIE_DEF uint32_t logcie_callsite_generation;
+
+/**
+ * @brief Recomputes cached decision of a call site. Called by logcie_callsite_enabled().
+ *
+ * @param site Call site to refresh
+ * @return 1 if call site is enabled, 0 otherwise
+ */
+LOGCIE_DEF uint8_t logcie_callsite_refresh(const Logcie_CallSite *site);
+
+/**
+ * @brief Checks if call site is enabled. Fast path is a single compare.
+ */
+static inline uint8_t logcie_callsite_enabled(const Logcie_CallSite *site) {
+  // Acquire pairs with release in logcie_callsite_refresh, so `enabled` is never older than `generation`
+  if (_LOGCIE_ATOMIC_LOAD(&site->cache->generation) == _LOGCIE_ATOMIC_LOAD(&logcie_callsite_generation)) {
+    return site->cache->enabled;
+  }
+
+  return logcie_callsite_refresh(site);
+}
+
+/**
+ * @brief Returns number of call sites in the program.
+ *
+ * Works only when call site descriptors are placed into the linker section
+ * (C on ELF targets, see LOGCIE_CALLSITE_SECTION). Returns 0 otherwise.
+ */
+LOGCIE_DEF size_t logcie_callsite_count(void);
+
+/**
+ * @brief Retrieves call site descriptor by index.
+ *
+ * Index is stable for the lifetime of the program, so it can be used as a
+ * compact call site id.
+ *
+ * @param index Zero-based index of the call site
+ * @return Pointer to descriptor or NULL if index is invalid
+ */
+LOGCIE_DEF const Logcie_CallSite *logcie_callsite_get(size_t index);
+
+/**
+ * @brief Enables or disables call sites by file:line at runtime.
+ *
+ * `file` is matched against the end of `__FILE__` of a call site, so both
+ * "src/net.c" and "net.c" will match call sites in "./src/net.c".
+ * Line 0 matches every call site in the file. Rule with exact line has
+ * priority over rule for the whole file.
+ *
+ * @param file  Source file name (must stay valid while rule is set)
+ * @param line  Line number or 0 for all lines
+ * @param state New state. LOGCIE_CALLSITE_DEFAULT removes the rule
+ * @return 1 if rule was set, 0 if there is no room for new rules (see LOGCIE_CALLSITE_RULES_MAX)
+ */
+LOGCIE_DEF uint8_t logcie_callsite_set(const char *file, uint32_t line, Logcie_CallSiteState state);
+
+/**
+ * @brief Removes all call site rules set by logcie_callsite_set()
+ */
+LOGCIE_DEF void logcie_callsite_reset(void);
+
+/**
+ * @brief Invalidates cached decisions of all call sites.
+ *
+ * Sink registration functions call it for you. Call it yourself if you modify
+ * `filter` of a sink that is already registered.
+ */
+LOGCIE_DEF void logcie_invalidate_callsites(void);
+
+#if !defined(LOGCIE_NO_CALLSITE_SECTION) && !defined(__cplusplus) && defined(__ELF__) && (defined(__GNUC__) || defined(__clang__))
+// C++ is excluded: statics of inline functions and templates would cause section type conflicts
+#define LOGCIE_CALLSITE_SECTION
+#define _LOGCIE_CALLSITE_ATTR __attribute__((section("logcie_callsites"), used, aligned(__alignof__(Logcie_CallSite))))
+#else
+#define _LOGCIE_CALLSITE_ATTR
+#endif
+
+// Format is stored in call site only if it is a literal, since
+// descriptor must be initialized with constant expressions
+#if defined(__GNUC__) || defined(__clang__)
+#define _LOGCIE_CALLSITE_FMT(msg) (__builtin_constant_p(msg) ? (msg) : NULL)
+#else
+#define _LOGCIE_CALLSITE_FMT(msg) NULL
+#endif
+
+// Helper macro for emitting log through a call site descriptor
+#define _LOGCIE_CALL(lvl, msg, ...)                                                                                                 \
+  do {                                                                                                                              \
+    static Logcie_CallSiteCache                        _logcie_callsite_cache = {0, 0, NULL};                                             \
+    static const Logcie_CallSite _LOGCIE_CALLSITE_ATTR _logcie_callsite       = {                                                   \
+      lvl, __LINE__, __FILE__, _LOGCIE_CALLSITE_FMT(msg), &_logcie_callsite_cache                                                   \
+    };                                                                                                                              \
+    if (logcie_callsite_enabled(&_logcie_callsite)) {                                                                               \
+      logcie_log_callsite(&_logcie_callsite, logcie_module, __VA_ARGS__);                                                           \
+    }                                                                                                                               \
+  } while (0)
+
 /**
  * @brief Convenience macros for each log level.
  * These use __FILE__ and __LINE__ to capture call site.
  */
 #if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 202311L)
-#define LOGCIE_TRACE(msg, ...)      logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_TRACE, msg, __FILE__, __LINE__), msg, __VA_OPT__(, ) __VA_ARGS__)
-#define LOGCIE_DEBUG(msg, ...)      logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_DEBUG, msg, __FILE__, __LINE__), msg, __VA_OPT__(, ) __VA_ARGS__)
-#define LOGCIE_VERBOSE(msg, ...)    logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_VERBOSE, msg, __FILE__, __LINE__), msg, __VA_OPT__(, ) __VA_ARGS__)
-#define LOGCIE_INFO(msg, ...)       logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_INFO, msg, __FILE__, __LINE__), msg, __VA_OPT__(, ) __VA_ARGS__)
-#define LOGCIE_WARN(msg, ...)       logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_WARN, msg, __FILE__, __LINE__), msg, __VA_OPT__(, ) __VA_ARGS__)
-#define LOGCIE_ERROR(msg, ...)      logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_ERROR, msg, __FILE__, __LINE__), msg, __VA_OPT__(, ) __VA_ARGS__)
-#define LOGCIE_FATAL(msg, ...)      logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_FATAL, msg, __FILE__, __LINE__), msg, __VA_OPT__(, ) __VA_ARGS__)
-#define LOGCIE_LOG(level, msg, ...) LOGCIE_##level(msg, __VA_OPT__(, ) __VA_ARGS__)
+#define LOGCIE_TRACE(msg, ...)      _LOGCIE_CALL(LOGCIE_LEVEL_TRACE, msg, msg __VA_OPT__(, ) __VA_ARGS__)
+#define LOGCIE_DEBUG(msg, ...)      _LOGCIE_CALL(LOGCIE_LEVEL_DEBUG, msg, msg __VA_OPT__(, ) __VA_ARGS__)
+#define LOGCIE_VERBOSE(msg, ...)    _LOGCIE_CALL(LOGCIE_LEVEL_VERBOSE, msg, msg __VA_OPT__(, ) __VA_ARGS__)
+#define LOGCIE_INFO(msg, ...)       _LOGCIE_CALL(LOGCIE_LEVEL_INFO, msg, msg __VA_OPT__(, ) __VA_ARGS__)
+#define LOGCIE_WARN(msg, ...)       _LOGCIE_CALL(LOGCIE_LEVEL_WARN, msg, msg __VA_OPT__(, ) __VA_ARGS__)
+#define LOGCIE_ERROR(msg, ...)      _LOGCIE_CALL(LOGCIE_LEVEL_ERROR, msg, msg __VA_OPT__(, ) __VA_ARGS__)
+#define LOGCIE_FATAL(msg, ...)      _LOGCIE_CALL(LOGCIE_LEVEL_FATAL, msg, msg __VA_OPT__(, ) __VA_ARGS__)
+#define LOGCIE_LOG(level, msg, ...) LOGCIE_##level(msg __VA_OPT__(, ) __VA_ARGS__)
 #else
 #if !defined(LOGCIE_PEDANTIC) && (defined(__GNUC__) || defined(__clang__))
-#define LOGCIE_TRACE(msg, ...)      logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_TRACE, msg, __FILE__, __LINE__), msg, ##__VA_ARGS__)
-#define LOGCIE_DEBUG(msg, ...)      logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_DEBUG, msg, __FILE__, __LINE__), msg, ##__VA_ARGS__)
-#define LOGCIE_VERBOSE(msg, ...)    logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_VERBOSE, msg, __FILE__, __LINE__), msg, ##__VA_ARGS__)
-#define LOGCIE_INFO(msg, ...)       logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_INFO, msg, __FILE__, __LINE__), msg, ##__VA_ARGS__)
-#define LOGCIE_WARN(msg, ...)       logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_WARN, msg, __FILE__, __LINE__), msg, ##__VA_ARGS__)
-#define LOGCIE_ERROR(msg, ...)      logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_ERROR, msg, __FILE__, __LINE__), msg, ##__VA_ARGS__)
-#define LOGCIE_FATAL(msg, ...)      logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_FATAL, msg, __FILE__, __LINE__), msg, ##__VA_ARGS__)
+#define LOGCIE_TRACE(msg, ...)      _LOGCIE_CALL(LOGCIE_LEVEL_TRACE, msg, msg, ##__VA_ARGS__)
+#define LOGCIE_DEBUG(msg, ...)      _LOGCIE_CALL(LOGCIE_LEVEL_DEBUG, msg, msg, ##__VA_ARGS__)
+#define LOGCIE_VERBOSE(msg, ...)    _LOGCIE_CALL(LOGCIE_LEVEL_VERBOSE, msg, msg, ##__VA_ARGS__)
+#define LOGCIE_INFO(msg, ...)       _LOGCIE_CALL(LOGCIE_LEVEL_INFO, msg, msg, ##__VA_ARGS__)
+#define LOGCIE_WARN(msg, ...)       _LOGCIE_CALL(LOGCIE_LEVEL_WARN, msg, msg, ##__VA_ARGS__)
+#define LOGCIE_ERROR(msg, ...)      _LOGCIE_CALL(LOGCIE_LEVEL_ERROR, msg, msg, ##__VA_ARGS__)
+#define LOGCIE_FATAL(msg, ...)      _LOGCIE_CALL(LOGCIE_LEVEL_FATAL, msg, msg, ##__VA_ARGS__)
 #define LOGCIE_LOG(level, msg, ...) LOGCIE_##level(msg, ##__VA_ARGS__)
 #else
-#define LOGCIE_TRACE(msg)      logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_TRACE, msg, __FILE__, __LINE__), msg)
-#define LOGCIE_DEBUG(msg)      logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_DEBUG, msg, __FILE__, __LINE__), msg)
-#define LOGCIE_VERBOSE(msg)    logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_VERBOSE, msg, __FILE__, __LINE__), msg)
-#define LOGCIE_INFO(msg)       logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_INFO, msg, __FILE__, __LINE__), msg)
-#define LOGCIE_WARN(msg)       logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_WARN, msg, __FILE__, __LINE__), msg)
-#define LOGCIE_ERROR(msg)      logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_ERROR, msg, __FILE__, __LINE__), msg)
-#define LOGCIE_FATAL(msg)      logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_FATAL, msg, __FILE__, __LINE__), msg)
+#define LOGCIE_TRACE(msg)      _LOGCIE_CALL(LOGCIE_LEVEL_TRACE, msg, msg)
+#define LOGCIE_DEBUG(msg)      _LOGCIE_CALL(LOGCIE_LEVEL_DEBUG, msg, msg)
+#define LOGCIE_VERBOSE(msg)    _LOGCIE_CALL(LOGCIE_LEVEL_VERBOSE, msg, msg)
+#define LOGCIE_INFO(msg)       _LOGCIE_CALL(LOGCIE_LEVEL_INFO, msg, msg)
+#define LOGCIE_WARN(msg)       _LOGCIE_CALL(LOGCIE_LEVEL_WARN, msg, msg)
+#define LOGCIE_ERROR(msg)      _LOGCIE_CALL(LOGCIE_LEVEL_ERROR, msg, msg)
+#define LOGCIE_FATAL(msg)      _LOGCIE_CALL(LOGCIE_LEVEL_FATAL, msg, msg)
 #define LOGCIE_LOG(level, msg) LOGCIE_##level(msg)
 #define LOGCIE_VA_LOGS
 #endif
@@ -579,13 +1028,13 @@ struct Logcie_Log {
 
 // Separate variadic logs for compilers that do not support optional variadics in macros
 #ifdef LOGCIE_VA_LOGS
-#define LOGCIE_TRACE_VA(msg, ...)      logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_TRACE, msg, __FILE__, __LINE__), msg, __VA_ARGS__)
-#define LOGCIE_DEBUG_VA(msg, ...)      logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_DEBUG, msg, __FILE__, __LINE__), msg, __VA_ARGS__)
-#define LOGCIE_VERBOSE_VA(msg, ...)    logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_VERBOSE, msg, __FILE__, __LINE__), msg, __VA_ARGS__)
-#define LOGCIE_INFO_VA(msg, ...)       logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_INFO, msg, __FILE__, __LINE__), msg, __VA_ARGS__)
-#define LOGCIE_WARN_VA(msg, ...)       logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_WARN, msg, __FILE__, __LINE__), msg, __VA_ARGS__)
-#define LOGCIE_ERROR_VA(msg, ...)      logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_ERROR, msg, __FILE__, __LINE__), msg, __VA_ARGS__)
-#define LOGCIE_FATAL_VA(msg, ...)      logcie_log(LOGCIE_CREATE_LOG(LOGCIE_LEVEL_FATAL, msg, __FILE__, __LINE__), msg, __VA_ARGS__)
+#define LOGCIE_TRACE_VA(msg, ...)      _LOGCIE_CALL(LOGCIE_LEVEL_TRACE, msg, msg, __VA_ARGS__)
+#define LOGCIE_DEBUG_VA(msg, ...)      _LOGCIE_CALL(LOGCIE_LEVEL_DEBUG, msg, msg, __VA_ARGS__)
+#define LOGCIE_VERBOSE_VA(msg, ...)    _LOGCIE_CALL(LOGCIE_LEVEL_VERBOSE, msg, msg, __VA_ARGS__)
+#define LOGCIE_INFO_VA(msg, ...)       _LOGCIE_CALL(LOGCIE_LEVEL_INFO, msg, msg, __VA_ARGS__)
+#define LOGCIE_WARN_VA(msg, ...)       _LOGCIE_CALL(LOGCIE_LEVEL_WARN, msg, msg, __VA_ARGS__)
+#define LOGCIE_ERROR_VA(msg, ...)      _LOGCIE_CALL(LOGCIE_LEVEL_ERROR, msg, msg, __VA_ARGS__)
+#define LOGCIE_FATAL_VA(msg, ...)      _LOGCIE_CALL(LOGCIE_LEVEL_FATAL, msg, msg, __VA_ARGS__)
 #define LOGCIE_LOG_VA(level, msg, ...) LOGCIE_##level##_VA(msg, __VA_ARGS__)
 #endif
 
@@ -605,6 +1054,165 @@ struct Logcie_Log {
  */
 LOGCIE_DEF size_t logcie_log(Logcie_Log log, const char *fmt, ...) PRINTF_TYPECHECK(2, 3);
 
+/**
+ * @brief Emit a log message from a call site descriptor.
+ *
+ * Same as logcie_log(), but log metadata is taken from static call site descriptor,
+ * so the caller passes only a pointer. Used by LOGCIE_* macros.
+ *
+ * @param site   Call site descriptor
+ * @param module Module name of the caller (logcie_module)
+ * @param fmt    Format string for the log message (supports printf-style formatting)
+ * @param ...    Variable arguments for format string placeholders
+ * @return Always returns 0 (reserved for future use)
+ */
+LOGCIE_DEF size_t logcie_log_callsite(const Logcie_CallSite *site, const char *module, const char *fmt, ...) PRINTF_TYPECHECK(3, 4);
+
+/**
+ * @brief Emit a log whose message is already rendered.
+ *
+ * Used by front-ends that do their own argument formatting (see logcie.hpp).
+ * Message is passed to sinks as is: `log.message` points to it and `log.msg`
+ * with `log.args` describe it as `"%.*s"`, so formatters that expand `msg`
+ * themselves produce the same text. `msg`, `message`, `message_len` and `args`
+ * of `log` are overwritten.
+ *
+ * @param log     Log metadata (level, time, module, location)
+ * @param message Rendered message (does not have to be NUL-terminated)
+ * @param len     Length of the message
+ * @return Always returns 0 (reserved for future use)
+ */
+LOGCIE_DEF size_t logcie_log_rendered(Logcie_Log log, const char *message, size_t len);
+
+// Size of a scope buffer. Every held log takes its message length plus sizeof(Logcie_Log)
+#ifndef LOGCIE_SCOPE_BUFFER
+#define LOGCIE_SCOPE_BUFFER 16384
+#endif
+
+// Number of scope buffers shared by all threads, at most 64
+#ifndef LOGCIE_SCOPE_BUFFERS
+#define LOGCIE_SCOPE_BUFFERS 16
+#endif
+
+/**
+ * @brief Starts holding back logs of the calling thread below `level`
+ *
+ * Until logcie_scope_end, logs below `level` are rendered into a buffer of the thread
+ * instead of going to sinks, logs at or above it go to sinks as usual. If an ERROR or
+ * FATAL is logged inside the scope, held logs are emitted before it and the rest of
+ * the scope is not held. Typical use is a request: TRACE details are written only if
+ * the request fails.
+ *
+ * Buffers are taken from a fixed pool of LOGCIE_SCOPE_BUFFERS, nothing is allocated.
+ * If the pool is empty, logs of the scope are not held. Logs that don't fit into
+ * the buffer are dropped, count of them is logged when the scope is emitted.
+ *
+ * Scopes can be nested, the outermost one holds logs for all of them.
+ *
+ *   ```c
+ *   logcie_scope_begin(LOGCIE_LEVEL_INFO);
+ *   LOGCIE_DEBUG("request %d: parsing headers", id);  // Held
+ *   uint8_t ok = handle(request);
+ *   logcie_scope_end(ok);                            // Discarded if ok, written otherwise
+ *   ```
+ *
+ * @param level  Logs below it are held
+ */
+LOGCIE_DEF void logcie_scope_begin(Logcie_LogLevel level);
+
+/**
+ * @brief Ends scope of logcie_scope_begin. Held logs are discarded on success, emitted otherwise
+ *
+ * Failure of a nested scope emits held logs at once, outer scope continues without holding.
+ *
+ * @param success  0 if the scope failed
+ * @return Number of held logs emitted during the scope
+ */
+LOGCIE_DEF size_t logcie_scope_end(uint8_t success);
+
+/**
+ * @brief Returns message of a log with printf arguments expanded.
+ *
+ * Message is rendered on first call into a per-thread buffer of LOGCIE_MESSAGE_MAX
+ * bytes (longer messages are truncated) and is reused by other filters and sinks
+ * of the same log: it is rendered once, before the first sink formats it, and
+ * formatters receive it in `log.message`/`log.message_len`. Pointer is valid
+ * until the next log is emitted by this thread. Can be called only from filters
+ * and formatters.
+ *
+ * @param log Log to render
+ * @param len Where to store length of the message (can be NULL)
+ * @return Rendered message
+ */
+LOGCIE_DEF const char *logcie_log_message(Logcie_Log *log, size_t *len);
+
+/**
+ * @brief printf-compatible formatting into a buffer (same contract as vsnprintf).
+ *
+ * Common conversions (`%d`, `%i`, `%u`, `%x`, `%X`, `%s`, `%c`, `%p`, `%f` with
+ * precision up to 9, with flags, width, precision and length modifiers) are
+ * rendered by built-in kernels without locale and stream overhead. Other
+ * conversions are formatted one by one with snprintf, and formats that can't be
+ * split (positional arguments, `%n`, wide characters) go to vsnprintf as a whole.
+ *
+ * @param buffer  Where to write (always NUL-terminated if size > 0)
+ * @param size    Size of the buffer
+ * @param fmt     printf format string
+ * @param args    Arguments
+ * @return Length of the whole output (can be >= size if it was truncated), negative on error
+ */
+LOGCIE_DEF int logcie_vformat(char *buffer, size_t size, const char *fmt, va_list args);
+
+/**
+ * @brief Variadic version of logcie_vformat
+ */
+LOGCIE_DEF int logcie_format(char *buffer, size_t size, const char *fmt, ...) PRINTF_TYPECHECK(3, 4);
+
+/**
+ * @brief Writes pending `last message repeated N times` summaries of a sink.
+ *
+ * Call it before removing a sink with duplicate suppression or at shutdown,
+ * so the count of the last suppressed duplicates is not lost.
+ *
+ * @param sink Sink to flush
+ */
+LOGCIE_DEF void logcie_dedup_flush(Logcie_Sink *sink);
+
+/**
+ * @brief Writes everything sinks keep in memory.
+ *
+ * Waits until async sinks wrote their queues and flushes writer of every
+ * registered sink. Static sinks have no flush function, only those with
+ * logcie_printf_writer are flushed. Called automatically after every LOGCIE_FATAL log.
+ */
+LOGCIE_DEF void logcie_flush(void);
+
+#if defined(__unix__) || defined(__APPLE__)
+/**
+ * @brief Installs handler of fatal signals (SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT)
+ *
+ * On a fatal signal the handler writes what sinks keep in memory using only
+ * async-signal-safe calls: queues of async sinks are written straight to fd,
+ * syslog and network writers send their batches. Then previous handler is
+ * restored and the signal is raised again, so the program still crashes (or
+ * handler installed before is called).
+ *
+ * Lines queued for printf writers are written directly to fd of stdout and stderr,
+ * other FILE* streams and custom writers can't be written safely and are skipped.
+ * Static sinks and stdio buffers are not flushed.
+ *
+ * Handler takes a queue from its worker first, a sink whose worker is in the middle of
+ * writing is skipped. Still unsafe: a producer that is pushing to a queue at that
+ * moment, and sync sinks whose writer is used by another thread at that moment.
+ *
+ * Handler uses alternate signal stack of the calling thread, so stack overflow
+ * in that thread is handled too.
+ *
+ * @return 1 on success, 0 if a handler could not be installed
+ */
+LOGCIE_DEF uint8_t logcie_install_crash_handler(void);
+#endif
+
 /**
  * @brief Gets the number of sinks currently registered in the logger.
  *
@@ -696,7 +1304,7 @@ LOGCIE_DEF void logcie_remove_all_sinks(void);
  *
  * Here is the list of all formatting tokens:
  *
- * `$m` - Log message with printf formatting
+ * `$m` - Log message with printf formatting (see logcie_log_message)
  * `$f` - Source file name
  * `$x` - Line number
  * `$M` - Module name
@@ -718,10 +1326,24 @@ LOGCIE_DEF void logcie_remove_all_sinks(void);
  */
 LOGCIE_DEF size_t logcie_printf_formatter(Logcie_Writer *writer, void *user_data, Logcie_Log log, va_list *args);
 
+/**
+ * @brief Returns text of a logcie_printf_formatter token for a log.
+ *
+ * Handles tokens that are plain strings: `$l`, `$L`, `$c`, `$r`, `$d`, `$t`, `$z`,
+ * `$f`, `$M` and `$$`. Date and time strings are valid until this thread formats
+ * a log with different time.
+ *
+ * @param log   Log to take values from
+ * @param token Token character (without `$`)
+ * @return Token text or NULL if token is not one of listed above
+ */
+LOGCIE_DEF const char *logcie_token_string(const Logcie_Log *log, char token);
+
 /**
  * @brief Default printf writer
  *
- * This is the built-in writer that writes logs using vfprintf
+ * This is the built-in writer that writes logs to FILE*. Formats are rendered
+ * with logcie_vformat, output longer than LOGCIE_LINE_MAX goes through vfprintf
  *
  * @param user_data  Pointer to FILE where logs would be written
  * @param fmt        String to output (can be printf format string)
@@ -730,62 +1352,1126 @@ LOGCIE_DEF size_t logcie_printf_formatter(Logcie_Writer *writer, void *user_data
  */
 LOGCIE_DEF size_t logcie_printf_writer(void *user_data, const char *fmt, va_list *va, ...);
 
-typedef struct Logcie_FilterCombinationData {
-  Logcie_Filter a;
-  Logcie_Filter b;
-} Logcie_FilterCombinationData;
-
 /**
- * @brief Filters out logs with two different filters combining them with 'or' function
- * @param data *Logcie_FilterCombinationData
+ * @brief Gather writer for FILE* (see logcie_printf_writer)
+ *
+ * @param user_data  Pointer to FILE where logs would be written
+ * @param segments   Pieces to write in order
+ * @param count      Number of pieces
+ * @return Total number of characters written
  */
-LOGCIE_DEF uint8_t logcie_filter_or_fn(void *data, Logcie_Log *log);
+LOGCIE_DEF size_t logcie_printf_writev(void *user_data, const Logcie_Segment *segments, size_t count);
 
 /**
- * @brief Filters out logs with two different filters combining them with 'and' function
- * @param data *Logcie_FilterCombinationData
+ * @brief Flushes FILE* of printf writer (stdout if NULL)
  */
-LOGCIE_DEF uint8_t logcie_filter_and_fn(void *data, Logcie_Log *log);
+LOGCIE_DEF void logcie_printf_flush(void *user_data);
 
 /**
- * @brief Negates result of a filter
- * @param data *Logcie_Filter
+ * @brief Writes segments with writer
+ *
+ * Uses `writer->writev` if writer has it, otherwise writes segments one by one
+ * with `writer->write`, so every writer can be used with segments.
+ *
+ * @param writer    Writer
+ * @param segments  Pieces to write in order
+ * @param count     Number of pieces
+ * @return Total number of characters written
  */
-LOGCIE_DEF uint8_t logcie_filter_not_fn(void *data, Logcie_Log *log);
+LOGCIE_DEF size_t logcie_writer_writev(Logcie_Writer *writer, const Logcie_Segment *segments, size_t count);
 
 /**
- * @brief Filters out logs if log level is less than specified level
- * @param data *Logcie_LogLevel
+ * @brief Flushes writer if it has flush function
  */
-LOGCIE_DEF uint8_t logcie_filter_level_min_fn(void *data, Logcie_Log *log);
+LOGCIE_DEF void logcie_writer_flush(Logcie_Writer *writer);
 
+#if defined(__unix__) || defined(__APPLE__)
 /**
- * @brief Filters out logs if log level is more than specified level
- * @param data *Logcie_LogLevel
+ * @brief Writer to file descriptor
+ *
+ * Expects file descriptor in `data`: `{logcie_fd_writer, (void *)(intptr_t)fd, logcie_fd_writev}`.
+ * Every call is a single write(2) (formatted output longer than LOGCIE_LINE_MAX is truncated).
+ *
+ * @param user_data  File descriptor cast to pointer
+ * @param fmt        String to output (can be printf format string)
+ * @param va         List of arguments. Can be null, and arguments can be provided as variadics
+ * @return Total number of characters written
  */
-LOGCIE_DEF uint8_t logcie_filter_level_max_fn(void *data, Logcie_Log *log);
+LOGCIE_DEF size_t logcie_fd_writer(void *user_data, const char *fmt, va_list *va, ...);
 
 /**
- * @brief Filters out logs if log module is equal to specified string
- * @param data cosnt char*
+ * @brief Gather writer to file descriptor. Writes all segments with single writev(2)
+ *
+ * @param user_data  File descriptor cast to pointer
+ * @param segments   Pieces to write in order
+ * @param count      Number of pieces
+ * @return Total number of characters written
  */
-LOGCIE_DEF uint8_t logcie_filter_module_eq_fn(void *data, Logcie_Log *log);
+LOGCIE_DEF size_t logcie_fd_writev(void *user_data, const Logcie_Segment *segments, size_t count);
+#endif
 
-/**
- * @brief Filters out logs if log messages contains specified string
- * @param data const char*
- */
-LOGCIE_DEF uint8_t logcie_filter_message_contains_fn(void *data, Logcie_Log *log);
+#ifndef LOGCIE_LINE_MAX
+#define LOGCIE_LINE_MAX 4096
+#endif
 
-typedef uint8_t(Logcie_FilterCustomPredicateFn)(Logcie_Log *log);
+// Max number of segments formatter collects before writing them
+#ifndef LOGCIE_SEGMENTS_MAX
+#define LOGCIE_SEGMENTS_MAX 32
+#endif
 
 /**
- * @brief Filters out logs if specified function returns 0
- * @param data *Logcie_FilterCustomPredicateFn
+ * @brief Memory buffer for logcie_buffer_writer
+ *
+ * @field data      Memory to write to
+ * @field len       Number of bytes written (without terminating NUL)
+ * @field capacity  Size of `data`
+ * @field overflow  Set when output did not fit, `data` then holds truncated output
  */
-LOGCIE_DEF uint8_t logcie_filter_custom_fn(void *data, Logcie_Log *log);
-
-// Some handy filter "constructors"
+typedef struct Logcie_Buffer {
+  char   *data;
+  size_t  len;
+  size_t  capacity;
+  uint8_t overflow;
+} Logcie_Buffer;
+
+/**
+ * @brief Writer that appends to memory buffer
+ *
+ * @param user_data  Pointer to Logcie_Buffer
+ * @param fmt        String to output (can be printf format string)
+ * @param va         List of arguments. Can be null, and arguments can be provided as variadics
+ * @return Total number of characters that output has
+ */
+LOGCIE_DEF size_t logcie_buffer_writer(void *user_data, const char *fmt, va_list *va, ...);
+
+/**
+ * @brief Gather writer that appends to memory buffer (see logcie_buffer_writer)
+ */
+LOGCIE_DEF size_t logcie_buffer_writev(void *user_data, const Logcie_Segment *segments, size_t count);
+
+#if defined(__unix__) || defined(__APPLE__)
+// Number of records syslog sink collects before sending them with one call
+#ifndef LOGCIE_SYSLOG_BATCH
+#define LOGCIE_SYSLOG_BATCH 16
+#endif
+
+// Max size of one syslog record (datagram), longer records are truncated
+#ifndef LOGCIE_SYSLOG_RECORD_MAX
+#define LOGCIE_SYSLOG_RECORD_MAX 2048
+#endif
+
+/**
+ * @enum Logcie_SyslogProtocol
+ * @brief Wire format of Logcie_Syslog records
+ *
+ * @value LOGCIE_SYSLOG_RFC5424  RFC 5424 line for syslog daemon (default socket `/dev/log`)
+ * @value LOGCIE_SYSLOG_JOURNAL  journald native protocol (default socket `/run/systemd/journal/socket`)
+ */
+typedef enum Logcie_SyslogProtocol {
+  LOGCIE_SYSLOG_RFC5424,
+  LOGCIE_SYSLOG_JOURNAL,
+} Logcie_SyslogProtocol;
+
+/**
+ * @brief Local syslog / journald sink state (see logcie_syslog_sink)
+ *
+ * Records are sent as AF_UNIX datagrams without libc `syslog()`. They are collected
+ * into a batch of LOGCIE_SYSLOG_BATCH and sent with a single `sendmmsg` (on Linux)
+ * when batch is full, `linger_ms` passed since the first record of the batch,
+ * or a log of level WARN or higher arrives. Socket is never blocked on: if it is
+ * absent or full, records are counted in `dropped` and connection is retried
+ * at most once a second.
+ *
+ * Zero initialize it and set configuration fields. Not thread-safe.
+ *   ```c
+ *   static Logcie_Syslog syslog_state = {.app_name = "myapp", .linger_ms = 100};
+ *   Logcie_Sink sink = logcie_syslog_sink(&syslog_state);
+ *   logcie_add_sink(&sink);
+ *   // ...
+ *   logcie_syslog_close(&syslog_state); // Sends what is left and closes socket
+ *   ```
+ *
+ * @field path         Socket path. NULL means default socket of the protocol
+ * @field app_name     APP-NAME / SYSLOG_IDENTIFIER. NULL means "logcie"
+ * @field protocol     Wire format of records
+ * @field facility     Syslog facility (0-23). 0 (kern) is not allowed for programs, so it means user (1)
+ * @field linger_ms    How long a record may wait in a batch. 0 means records are sent at once.
+ *                     There is no timer: expired batch is sent by the next log, flush or close
+ * @field sent         Number of records sent
+ * @field dropped      Number of records lost because socket was absent, full or rejected them, or journal record was too long
+ * @field fd           Internal. Socket, valid when `connected` is set
+ * @field connected    Internal. Socket is open
+ * @field retry_ns     Internal. Time when the next connection attempt is allowed
+ * @field header_time  Internal. Second the cached header was rendered for
+ * @field header       Internal. Cached part of RFC 5424 header after PRI
+ * @field header_len   Internal. Length of `header`
+ * @field first_ns     Internal. Time the first record of the batch was added
+ * @field count        Internal. Number of records in the batch
+ * @field lengths      Internal. Lengths of records in the batch
+ * @field records      Internal. Records of the batch
+ */
+typedef struct Logcie_Syslog {
+  const char           *path;
+  const char           *app_name;
+  Logcie_SyslogProtocol protocol;
+  uint8_t               facility;
+  uint32_t              linger_ms;
+  uint64_t              sent;
+  uint64_t              dropped;
+  int                   fd;
+  uint8_t               connected;
+  uint64_t              retry_ns;
+  time_t                header_time;
+  char                  header[192];
+  size_t                header_len;
+  uint64_t              first_ns;
+  size_t                count;
+  size_t                lengths[LOGCIE_SYSLOG_BATCH];
+  char                  records[LOGCIE_SYSLOG_BATCH][LOGCIE_SYSLOG_RECORD_MAX];
+} Logcie_Syslog;
+
+/**
+ * @brief Returns syslog severity (0-7) of log level
+ */
+LOGCIE_DEF uint8_t logcie_syslog_severity(Logcie_LogLevel level);
+
+/**
+ * @brief Formats a log as one syslog or journald record
+ *
+ * RFC 5424: `<PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID - - MESSAGE`, where everything
+ * between PRI and MESSAGE is rendered once per second. Timestamp is UTC.
+ *
+ * Journal: `PRIORITY`, `SYSLOG_FACILITY`, `SYSLOG_IDENTIFIER`, `CODE_FILE`, `CODE_LINE`
+ * and `MESSAGE` fields. Multi-line messages use the binary form of the field.
+ *
+ * Messages longer than LOGCIE_MESSAGE_MAX are expanded again, as `$m` does, and
+ * cut so the record fits LOGCIE_SYSLOG_RECORD_MAX. Record is passed to the writer
+ * with a single writev call.
+ *
+ * @param writer     Pointer to writer (see Logcie_Writer)
+ * @param user_data  Pointer to Logcie_Syslog
+ * @param log        Log to format
+ * @param args       Variadic arguments of the log
+ * @return Number of characters written to the sink
+ */
+LOGCIE_DEF size_t logcie_syslog_formatter(Logcie_Writer *writer, void *user_data, Logcie_Log log, va_list *args);
+
+/**
+ * @brief Writer that adds a record to the batch of Logcie_Syslog
+ *
+ * Every call is one record. Use it with logcie_syslog_formatter, other formatters
+ * may split one log into several writes.
+ *
+ * @param user_data  Pointer to Logcie_Syslog
+ * @param fmt        String to output (can be printf format string)
+ * @param va         List of arguments. Can be null, and arguments can be provided as variadics
+ * @return Total number of characters added
+ */
+LOGCIE_DEF size_t logcie_syslog_writer(void *user_data, const char *fmt, va_list *va, ...);
+
+/**
+ * @brief Gather writer that adds segments as one record to the batch of Logcie_Syslog
+ *
+ * Records longer than LOGCIE_SYSLOG_RECORD_MAX are cut, journal ones are dropped
+ * instead, since cut record may be malformed.
+ */
+LOGCIE_DEF size_t logcie_syslog_writev(void *user_data, const Logcie_Segment *segments, size_t count);
+
+/**
+ * @brief Sends batched records. Connects to the socket if needed
+ * @return Number of records sent
+ */
+LOGCIE_DEF size_t logcie_syslog_flush(Logcie_Syslog *state);
+
+/**
+ * @brief Writer flush function for Logcie_Syslog (see logcie_syslog_flush)
+ */
+LOGCIE_DEF void logcie_syslog_flush_fn(void *user_data);
+
+/**
+ * @brief Sends batched records and closes the socket. State can be used again after it
+ */
+LOGCIE_DEF void logcie_syslog_close(Logcie_Syslog *state);
+
+/**
+ * @brief Creates sink with syslog formatter and writer. `state` must stay valid while sink is used
+ */
+LOGCIE_DEF Logcie_Sink logcie_syslog_sink(Logcie_Syslog *state);
+
+// Size of network sink buffer. Records that don't fit are dropped
+#ifndef LOGCIE_NET_BUFFER
+#define LOGCIE_NET_BUFFER 65536
+#endif
+
+// Max size of datagram network sink packs records into (Ethernet MTU without IPv4 and UDP headers)
+#ifndef LOGCIE_NET_DATAGRAM_MAX
+#define LOGCIE_NET_DATAGRAM_MAX 1472
+#endif
+
+/**
+ * @enum Logcie_NetTransport
+ * @brief Transport of Logcie_Net
+ *
+ * @value LOGCIE_NET_TCP  Stream, records are sent in as large chunks as socket accepts
+ * @value LOGCIE_NET_UDP  Datagrams of whole records, up to LOGCIE_NET_DATAGRAM_MAX bytes each
+ */
+typedef enum Logcie_NetTransport {
+  LOGCIE_NET_TCP,
+  LOGCIE_NET_UDP,
+} Logcie_NetTransport;
+
+/**
+ * @enum Logcie_NetFraming
+ * @brief How records of Logcie_Net are separated
+ *
+ * @value LOGCIE_NET_NEWLINE        Record ends with '\n' (added if missing). Messages should not contain newlines
+ * @value LOGCIE_NET_LENGTH_PREFIX  Record is preceded by its length as 32-bit big-endian integer
+ */
+typedef enum Logcie_NetFraming {
+  LOGCIE_NET_NEWLINE,
+  LOGCIE_NET_LENGTH_PREFIX,
+} Logcie_NetFraming;
+
+/**
+ * @brief Network sink state (see logcie_net_sink)
+ *
+ * Every write is one record (logcie_net_formatter renders a log in one write). Records are framed and appended to a buffer of
+ * LOGCIE_NET_BUFFER bytes, which is sent with as few `send` calls as possible
+ * once it is half full or `linger_ms` passed since the oldest unsent record.
+ * Socket is non-blocking, so logging thread never waits for the network: when
+ * socket can't take more, records stay in the buffer, and records that don't fit
+ * into the buffer are dropped and counted.
+ *
+ * Lost connection is reconnected with exponential backoff from `backoff_ms` up to
+ * `backoff_max_ms`. Record that was partially sent when connection was lost is dropped,
+ * so collector never gets a broken frame.
+ *
+ * Zero initialize it and set configuration fields. Not thread-safe.
+ *   ```c
+ *   static Logcie_Net net = {.host = "10.0.0.5", .port = 5170, .framing = LOGCIE_NET_LENGTH_PREFIX, .linger_ms = 200};
+ *   Logcie_Sink sink = logcie_net_sink(&net, "$d $t $L $M $f:$x $m");
+ *   logcie_add_sink(&sink);
+ *   // ...
+ *   logcie_net_close(&net); // Sends what socket accepts without waiting and closes it
+ *   ```
+ *
+ * @field host            Numeric IPv4 or IPv6 address. Names are not resolved, since it could block
+ * @field port            Port
+ * @field transport       TCP or UDP
+ * @field framing         How records are separated
+ * @field linger_ms       How long a record may wait in the buffer. 0 means it is sent at once.
+ *                        There is no timer: expired buffer is sent by the next log, flush or close
+ * @field backoff_ms      First reconnection delay. 0 means 100
+ * @field backoff_max_ms  Max reconnection delay. 0 means 30000
+ * @field sent            Number of records sent
+ * @field dropped         Number of records lost: buffer was full, connection was lost or datagram was rejected
+ * @field dropped_bytes   Number of bytes (with framing) of dropped records
+ * @field connects        Number of established connections
+ * @field fd              Internal. Socket, valid when `state` is not 0
+ * @field state           Internal. 0 - closed, 1 - connecting, 2 - connected
+ * @field retry_ns        Internal. Time when the next connection attempt is allowed
+ * @field delay_ms        Internal. Next reconnection delay
+ * @field first_ns        Internal. Time the oldest unsent record was added
+ * @field head            Internal. Start of unsent data in `buffer`
+ * @field len             Internal. End of data in `buffer`
+ * @field frame_left      Internal. Unsent bytes of the record at `head` that was partially sent
+ * @field buffer          Internal. Framed records
+ */
+typedef struct Logcie_Net {
+  const char         *host;
+  uint16_t            port;
+  Logcie_NetTransport transport;
+  Logcie_NetFraming   framing;
+  uint32_t            linger_ms;
+  uint32_t            backoff_ms;
+  uint32_t            backoff_max_ms;
+  uint64_t            sent;
+  uint64_t            dropped;
+  uint64_t            dropped_bytes;
+  uint64_t            connects;
+  int                 fd;
+  uint8_t             state;
+  uint64_t            retry_ns;
+  uint32_t            delay_ms;
+  uint64_t            first_ns;
+  size_t              head;
+  size_t              len;
+  size_t              frame_left;
+  char                buffer[LOGCIE_NET_BUFFER];
+} Logcie_Net;
+
+/**
+ * @brief Writer that adds a record to the buffer of Logcie_Net
+ *
+ * Every call is one record, so formatter must write a log with one call
+ * (see logcie_net_formatter).
+ *
+ * @param user_data  Pointer to Logcie_Net
+ * @param fmt        String to output (can be printf format string)
+ * @param va         List of arguments. Can be null, and arguments can be provided as variadics
+ * @return Total number of characters added, 0 if record was dropped
+ */
+LOGCIE_DEF size_t logcie_net_writer(void *user_data, const char *fmt, va_list *va, ...);
+
+/**
+ * @brief Gather writer that adds segments as one record to the buffer of Logcie_Net
+ */
+LOGCIE_DEF size_t logcie_net_writev(void *user_data, const Logcie_Segment *segments, size_t count);
+
+/**
+ * @brief printf formatter that passes the whole line to the writer with one call
+ *
+ * logcie_printf_formatter writes a line in several calls when message is longer
+ * than LOGCIE_MESSAGE_MAX or format has more than LOGCIE_SEGMENTS_MAX pieces, which
+ * network writer would frame as separate records. Line is rendered into a thread-local
+ * buffer first, lines longer than LOGCIE_LINE_MAX are truncated.
+ *
+ * @param user_data  Format string (same as for logcie_printf_formatter)
+ */
+LOGCIE_DEF size_t logcie_net_formatter(Logcie_Writer *writer, void *user_data, Logcie_Log log, va_list *args);
+
+/**
+ * @brief Sends as much of the buffer as socket accepts without blocking. Connects if needed
+ * @return Number of bytes sent
+ */
+LOGCIE_DEF size_t logcie_net_flush(Logcie_Net *net);
+
+/**
+ * @brief Writer flush function for Logcie_Net (see logcie_net_flush)
+ */
+LOGCIE_DEF void logcie_net_flush_fn(void *user_data);
+
+/**
+ * @brief Flushes the buffer without blocking and closes the socket. Records that were not sent stay in the buffer
+ */
+LOGCIE_DEF void logcie_net_close(Logcie_Net *net);
+
+/**
+ * @brief Creates sink with logcie_net_formatter and network writer. `net` must stay valid while sink is used
+ */
+LOGCIE_DEF Logcie_Sink logcie_net_sink(Logcie_Net *net, const char *format);
+
+// Default size of shared memory ring, without the control block
+#ifndef LOGCIE_SHM_CAPACITY
+#define LOGCIE_SHM_CAPACITY (1 << 20)
+#endif
+
+// Max size of a shared memory record. Larger records are dropped
+#ifndef LOGCIE_SHM_RECORD_MAX
+#define LOGCIE_SHM_RECORD_MAX 4096
+#endif
+
+/**
+ * @brief Header of a record in shared memory ring
+ *
+ * Followed by NUL-terminated module and file (if present) and message.
+ * Records start at multiples of 8. Size LOGCIE_SHM_WRAP marks the unused
+ * end of the ring, next record is at its beginning.
+ *
+ * @field size         Size of the record with header, multiple of 8
+ * @field level        Level of the log
+ * @field sequence     Number of the record. Gap in numbers means lost records
+ * @field time         Time of the log
+ * @field line         Source line
+ * @field module_len   Length of module with NUL, 0 if there is no module
+ * @field file_len     Length of file with NUL, 0 if there is no file
+ * @field message_len  Length of message
+ * @field reserved     Always 0
+ */
+typedef struct Logcie_ShmRecord {
+  uint32_t size;
+  uint32_t level;
+  uint64_t sequence;
+  int64_t  time;
+  uint32_t line;
+  uint16_t module_len;
+  uint16_t file_len;
+  uint32_t message_len;
+  uint32_t reserved;
+} Logcie_ShmRecord;
+
+#define LOGCIE_SHM_MAGIC   0x53434c4cu  // "LLCS"
+#define LOGCIE_SHM_VERSION 1
+#define LOGCIE_SHM_WRAP    0xffffffffu
+
+/**
+ * @brief Control block at the start of shared memory, ring data follows it
+ *
+ * Only the sink writes it. `tail` is moved before bytes are overwritten and
+ * `head` after a record is complete, so a reader that copied a record at
+ * position `p` knows the copy is valid if `tail` is still at or before `p`.
+ *
+ * @field magic     LOGCIE_SHM_MAGIC once control block is initialized
+ * @field version   LOGCIE_SHM_VERSION
+ * @field capacity  Size of ring data in bytes
+ * @field epoch     Incremented every time the ring is created again, readers start over
+ * @field head      Bytes written so far. Records before it are complete
+ * @field tail      Position of the oldest record that is not overwritten
+ * @field reserved  Padding up to 64 bytes
+ */
+typedef struct Logcie_ShmHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t capacity;
+  uint64_t epoch;
+  uint64_t head;
+  uint64_t tail;
+  uint64_t reserved[3];
+} Logcie_ShmHeader;
+
+/**
+ * @brief Sink that writes logs into a POSIX shared memory ring (see logcie_shm_sink)
+ *
+ * Record is copied into memory shared with reader processes (see logcie-tail),
+ * logging makes no syscalls. Reader formats and ships logs on its own. The sink
+ * never waits for readers: the oldest records are overwritten, readers that
+ * fell behind notice it and count lost records. Records are in the ring until
+ * overwritten, so they survive a crash of the program.
+ *
+ * Zero initialize it, set configuration fields and open it:
+ *   ```c
+ *   static Logcie_Shm shm = {.name = "/myapp-logs"};
+ *   static Logcie_Sink shm_sink;
+ *   logcie_shm_open(&shm);
+ *   shm_sink = logcie_shm_sink(&shm);
+ *   logcie_add_sink(&shm_sink);
+ *   ```
+ *
+ * @field name      Name of shared memory object ("/name", see shm_open)
+ * @field capacity  Size of the ring in bytes. 0 means LOGCIE_SHM_CAPACITY
+ * @field written   Number of written records
+ * @field dropped   Number of records larger than LOGCIE_SHM_RECORD_MAX or the ring
+ * @field fd        Internal. Shared memory object
+ * @field header    Internal. Mapped control block
+ * @field data      Internal. Mapped ring data
+ * @field lock      Internal. Spin lock of threads that write to the ring
+ * @field sequence  Internal. Number of the next record
+ */
+typedef struct Logcie_Shm {
+  const char       *name;
+  size_t            capacity;
+  uint64_t          written;
+  uint64_t          dropped;
+  int               fd;
+  Logcie_ShmHeader *header;
+  char             *data;
+  uint32_t          lock;
+  uint64_t          sequence;
+} Logcie_Shm;
+
+/**
+ * @brief Reader of a shared memory ring (see logcie_shm_read)
+ *
+ * Zero initialize it and set `name`. Not thread-safe.
+ *
+ * @field name      Name of shared memory object
+ * @field lost      Number of records overwritten before they were read
+ * @field fd        Internal. Shared memory object
+ * @field header    Internal. Mapped control block
+ * @field data      Internal. Mapped ring data
+ * @field capacity  Internal. Size of mapped ring data
+ * @field epoch     Internal. Epoch of the ring `position` belongs to
+ * @field position  Internal. Position of the next record
+ * @field sequence  Internal. Number of the next record, UINT64_MAX if unknown
+ * @field record    Internal. Copy of the last read record
+ */
+typedef struct Logcie_ShmReader {
+  const char             *name;
+  uint64_t                lost;
+  int                     fd;
+  const Logcie_ShmHeader *header;
+  const char             *data;
+  uint64_t                capacity;
+  uint64_t                epoch;
+  uint64_t                position;
+  uint64_t                sequence;
+  char                    record[LOGCIE_SHM_RECORD_MAX];
+} Logcie_ShmReader;
+
+/**
+ * @brief Creates (or resets) shared memory object and maps it
+ * @return 1 on success, 0 on error (errno is set)
+ */
+LOGCIE_DEF uint8_t logcie_shm_open(Logcie_Shm *shm);
+
+/**
+ * @brief Unmaps shared memory. Object stays until shm_unlink, so readers can finish reading
+ */
+LOGCIE_DEF void logcie_shm_close(Logcie_Shm *shm);
+
+/**
+ * @brief Formatter that turns log into a shared memory record (see Logcie_ShmRecord)
+ *
+ * Messages longer than LOGCIE_MESSAGE_MAX are expanded again, as `$m` does, and
+ * cut so the record fits LOGCIE_SHM_RECORD_MAX.
+ */
+LOGCIE_DEF size_t logcie_shm_formatter(Logcie_Writer *writer, void *user_data, Logcie_Log log, va_list *args);
+
+/**
+ * @brief Shared memory writer. Written text is stored as message of a TRACE record
+ */
+LOGCIE_DEF size_t logcie_shm_writer(void *user_data, const char *fmt, va_list *va, ...);
+
+/**
+ * @brief Gather writer that puts a record of logcie_shm_formatter into the ring
+ *
+ * Segments that are not such a record are stored as message of a TRACE record.
+ */
+LOGCIE_DEF size_t logcie_shm_writev(void *user_data, const Logcie_Segment *segments, size_t count);
+
+/**
+ * @brief Creates sink with shared memory formatter and writer. `shm` must stay valid while sink is used
+ */
+LOGCIE_DEF Logcie_Sink logcie_shm_sink(Logcie_Shm *shm);
+
+/**
+ * @brief Maps shared memory of a ring for reading, starting from the oldest record
+ * @return 1 on success, 0 if object does not exist or is not a ring yet
+ */
+LOGCIE_DEF uint8_t logcie_shm_reader_open(Logcie_ShmReader *reader);
+
+/**
+ * @brief Reads the next record into `log`
+ *
+ * Module, file and message of `log` point into the reader and stay valid until
+ * the next call. If the writer overwrote records the reader has not read yet,
+ * reading continues from the oldest remaining record and `lost` is increased.
+ *
+ * If the ring was created again, reading starts from its oldest record. If it
+ * was created with other capacity, reader has to be opened again.
+ *
+ * @return 1 if a record was read, 0 if there are no new records
+ */
+LOGCIE_DEF uint8_t logcie_shm_read(Logcie_ShmReader *reader, Logcie_Log *log);
+
+/**
+ * @brief Unmaps shared memory of a reader
+ */
+LOGCIE_DEF void logcie_shm_reader_close(Logcie_ShmReader *reader);
+#endif
+
+#ifdef _LOGCIE_THREADS
+// Size of async sink queue. Every queued log takes its formatted length plus 8 bytes
+#ifndef LOGCIE_ASYNC_BUFFER
+#define LOGCIE_ASYNC_BUFFER 65536
+#endif
+
+/**
+ * @enum Logcie_OverflowPolicy
+ * @brief What async sink does with a log when its queue is full
+ *
+ * Queued line is never replaced by a less severe log: if the oldest line is more
+ * severe than the new log, the new log is dropped instead.
+ *
+ * @value LOGCIE_OVERFLOW_DROP_NEWEST       New log is dropped
+ * @value LOGCIE_OVERFLOW_DROP_OLDEST       Oldest queued logs are dropped to make room
+ * @value LOGCIE_OVERFLOW_BLOCK             Logging thread waits until worker makes room, at most `block_timeout_ms`
+ * @value LOGCIE_OVERFLOW_DROP_BELOW_LEVEL  Logs below `level` are dropped, others replace oldest queued logs
+ */
+typedef enum Logcie_OverflowPolicy {
+  LOGCIE_OVERFLOW_DROP_NEWEST,
+  LOGCIE_OVERFLOW_DROP_OLDEST,
+  LOGCIE_OVERFLOW_BLOCK,
+  LOGCIE_OVERFLOW_DROP_BELOW_LEVEL,
+} Logcie_OverflowPolicy;
+
+/**
+ * @brief Background writer of a sink (see logcie_async_start)
+ *
+ * Logs are filtered and formatted on the logging thread as usual, but formatted line
+ * is put into a bounded queue of LOGCIE_ASYNC_BUFFER bytes instead of being written.
+ * Worker thread of the sink takes lines from the queue and passes them to the writer
+ * one by one, so a slow writer (network, disk) delays neither logging thread nor other
+ * sinks. Sinks without `async` are written inline.
+ *
+ * Logs at or above `level` can use the whole queue, less severe logs only
+ * LOGCIE_ASYNC_BUFFER - `reserve` bytes of it. So under overload TRACE and DEBUG
+ * are dropped first, while WARN and ERROR still have room.
+ *
+ * Writer of the sink is called only from the worker. Counters are updated by
+ * several threads, read them after logcie_async_flush or logcie_async_stop, or
+ * with logcie_async_dropped.
+ *
+ * Zero initialize it, set configuration fields and start it:
+ *   ```c
+ *   static Logcie_Async net_async = {.policy = LOGCIE_OVERFLOW_DROP_BELOW_LEVEL, .level = LOGCIE_LEVEL_WARN};
+ *   logcie_async_start(&net_sink, &net_async);
+ *   logcie_add_sink(&net_sink);
+ *   // ...
+ *   logcie_remove_sink(&net_sink);
+ *   logcie_async_stop(&net_async); // Writes queued lines and joins the worker
+ *   ```
+ *
+ * @field policy            What to do with a log when queue is full
+ * @field level             Logs at or above it are important: can use `reserve` and are not dropped by LOGCIE_OVERFLOW_DROP_BELOW_LEVEL
+ * @field reserve           Bytes of the queue only important logs can use
+ * @field block_timeout_ms  Max wait of LOGCIE_OVERFLOW_BLOCK, then log is dropped. 0 means no limit
+ * @field written           Number of lines written by the worker
+ * @field dropped           Number of dropped logs
+ * @field dropped_levels    Number of dropped logs of every level
+ * @field truncated         Number of lines cut to LOGCIE_LINE_MAX, the longest line the queue takes
+ * @field sink       Internal. Sink the worker writes to
+ * @field thread     Internal. Worker thread
+ * @field lock       Internal. Protects everything below
+ * @field not_empty  Internal. Signaled when a line is queued or worker should stop
+ * @field not_full   Internal. Signaled when worker takes a line or becomes idle
+ * @field running    Internal. Worker is started
+ * @field stopping   Internal. Worker should exit once queue is empty
+ * @field busy       Internal. Worker is writing a line or taking it from the queue
+ * @field crashing   Internal. Crash handler took the queue, worker and producers leave it alone
+ * @field flushing   Internal. Worker should flush the writer once queue is empty
+ * @field head       Internal. Offset where the next line is queued
+ * @field tail       Internal. Offset of the oldest queued line
+ * @field buffer     Internal. Queued lines
+ */
+struct Logcie_Async {
+  Logcie_OverflowPolicy policy;
+  Logcie_LogLevel       level;
+  size_t                reserve;
+  uint32_t              block_timeout_ms;
+  uint64_t              written;
+  uint64_t              dropped;
+  uint64_t              dropped_levels[Count_LOGCIE_LEVEL];
+  uint64_t              truncated;
+  Logcie_Sink          *sink;
+  pthread_t             thread;
+  pthread_mutex_t       lock;
+  pthread_cond_t        not_empty;
+  pthread_cond_t        not_full;
+  uint8_t               running;
+  uint8_t               stopping;
+  uint8_t               busy;
+  uint8_t               crashing;
+  uint8_t               flushing;
+  size_t                head;
+  size_t                tail;
+  char                  buffer[LOGCIE_ASYNC_BUFFER];
+};
+
+/**
+ * @brief Starts worker thread of a sink and makes the sink asynchronous
+ *
+ * Call it before the sink is added or while no thread logs. `async` must stay
+ * valid until logcie_async_stop.
+ *
+ * @param sink   Sink to write in background
+ * @param async  Zero initialized state with configuration fields set
+ * @return 1 on success, 0 if thread could not be started (sink stays synchronous)
+ */
+LOGCIE_DEF uint8_t logcie_async_start(Logcie_Sink *sink, Logcie_Async *async);
+
+/**
+ * @brief Waits until worker wrote every queued line and flushed the writer
+ */
+LOGCIE_DEF void logcie_async_flush(Logcie_Async *async);
+
+/**
+ * @brief Writes queued lines, stops the worker and makes the sink synchronous again
+ *
+ * Producers are not excluded: remove the sink with logcie_remove_sink and make sure
+ * no thread is still logging to it before calling this, state is destroyed here.
+ */
+LOGCIE_DEF void logcie_async_stop(Logcie_Async *async);
+
+/**
+ * @brief Returns number of dropped logs of a level. Count_LOGCIE_LEVEL returns number of all dropped logs
+ */
+LOGCIE_DEF uint64_t logcie_async_dropped(Logcie_Async *async, Logcie_LogLevel level);
+#endif
+
+// Number of records kept by a flight recorder
+#ifndef LOGCIE_FLIGHT_RECORDS
+#define LOGCIE_FLIGHT_RECORDS 256
+#endif
+
+// Max length of a flight recorder record, longer records are truncated
+#ifndef LOGCIE_FLIGHT_RECORD_MAX
+#define LOGCIE_FLIGHT_RECORD_MAX 256
+#endif
+
+/**
+ * @brief Record slot of Logcie_FlightRecorder
+ *
+ * @field sequence  Internal. 2 * number of the record + 1 while it is written, + 2 when it is complete
+ * @field level     Internal. Level of the record
+ * @field len       Internal. Length of the line
+ * @field line      Internal. Formatted line
+ */
+typedef struct Logcie_FlightRecord {
+  uint64_t sequence;
+  uint32_t level;
+  uint32_t len;
+  char     line[LOGCIE_FLIGHT_RECORD_MAX];
+} Logcie_FlightRecord;
+
+/**
+ * @brief Keeps the last LOGCIE_FLIGHT_RECORDS records in memory and writes them out on error
+ *
+ * Recording formats the log straight into a slot of a fixed ring, without locks
+ * or syscalls, so even TRACE logs can be recorded all the time. When a log at or
+ * above `dump_level` is recorded, or logcie_flight_recorder_dump is called, records
+ * not dumped yet are written to `target` sink, oldest first. Records overwritten
+ * before the dump are lost.
+ *
+ * Filter of the recorder sink decides what is recorded, as for any sink. Target
+ * gets already formatted lines, its formatter and filter are not used, so target
+ * doesn't have to be registered.
+ *
+ * Zero initialize it and set configuration fields:
+ *   ```c
+ *   static Logcie_FlightRecorder recorder = {.format = "$d $t $L $m", .target = &stderr_sink};
+ *   static Logcie_Sink recorder_sink;
+ *   recorder_sink = logcie_flight_recorder_sink(&recorder);
+ *   logcie_add_sink(&recorder_sink);
+ *   ```
+ *
+ * @field format          Format of records (see logcie_printf_formatter). NULL means "$L $m"
+ * @field target          Sink dumped records are written to
+ * @field dump_level      Recording a log at or above it dumps the ring. Used only if `dump_level_set` is set
+ * @field dump_level_set  Use `dump_level` instead of LOGCIE_LEVEL_ERROR (zero is TRACE, so it can't mean unset)
+ * @field dumps           Number of dumps
+ * @field dumped          Number of dumped records
+ * @field next            Internal. Number of the next record
+ * @field dump_from       Internal. Number of the first record not dumped yet
+ * @field dumping         Internal. Dump is in progress
+ * @field records         Internal. Ring of records
+ */
+typedef struct Logcie_FlightRecorder {
+  const char         *format;
+  Logcie_Sink        *target;
+  Logcie_LogLevel     dump_level;
+  uint8_t             dump_level_set;
+  uint64_t            dumps;
+  uint64_t            dumped;
+  uint64_t            next;
+  uint64_t            dump_from;
+  uint32_t            dumping;
+  Logcie_FlightRecord records[LOGCIE_FLIGHT_RECORDS];
+} Logcie_FlightRecorder;
+
+/**
+ * @brief Flight recorder formatter: records formatted log, dumps the ring on severe logs
+ *
+ * Writer other than the recorder one (async queue, shared formatting) gets
+ * the line formatted with `format` instead.
+ *
+ * @param user_data  *Logcie_FlightRecorder
+ */
+LOGCIE_DEF size_t logcie_flight_recorder_formatter(Logcie_Writer *writer, void *user_data, Logcie_Log log, va_list *args);
+
+/**
+ * @brief Flight recorder writer. Records written text as a TRACE log, it never triggers a dump
+ */
+LOGCIE_DEF size_t logcie_flight_recorder_writer(void *user_data, const char *fmt, va_list *va, ...);
+
+/**
+ * @brief Gather variant of logcie_flight_recorder_writer
+ */
+LOGCIE_DEF size_t logcie_flight_recorder_writev(void *user_data, const Logcie_Segment *segments, size_t count);
+
+/**
+ * @brief Writes records not dumped yet to target sink and flushes it
+ *
+ * Safe to call from any thread. If another thread is dumping, returns 0 at once.
+ *
+ * @return Number of dumped records
+ */
+LOGCIE_DEF size_t logcie_flight_recorder_dump(Logcie_FlightRecorder *recorder);
+
+/**
+ * @brief Creates flight recorder sink. `recorder` must stay valid while sink is used
+ */
+LOGCIE_DEF Logcie_Sink logcie_flight_recorder_sink(Logcie_FlightRecorder *recorder);
+
+typedef struct Logcie_FilterCombinationData {
+  Logcie_Filter a;
+  Logcie_Filter b;
+} Logcie_FilterCombinationData;
+
+/**
+ * @brief Filters out logs with two different filters combining them with 'or' function
+ * @param data *Logcie_FilterCombinationData
+ */
+LOGCIE_DEF uint8_t logcie_filter_or_fn(void *data, Logcie_Log *log);
+
+/**
+ * @brief Filters out logs with two different filters combining them with 'and' function
+ * @param data *Logcie_FilterCombinationData
+ */
+LOGCIE_DEF uint8_t logcie_filter_and_fn(void *data, Logcie_Log *log);
+
+/**
+ * @brief Negates result of a filter
+ * @param data *Logcie_Filter
+ */
+LOGCIE_DEF uint8_t logcie_filter_not_fn(void *data, Logcie_Log *log);
+
+/**
+ * @brief Filters out logs if log level is less than specified level
+ * @param data *Logcie_LogLevel
+ */
+LOGCIE_DEF uint8_t logcie_filter_level_min_fn(void *data, Logcie_Log *log);
+
+/**
+ * @brief Filters out logs if log level is more than specified level
+ * @param data *Logcie_LogLevel
+ */
+LOGCIE_DEF uint8_t logcie_filter_level_max_fn(void *data, Logcie_Log *log);
+
+/**
+ * @brief Filters out logs if log module is equal to specified string
+ * @param data cosnt char*
+ */
+LOGCIE_DEF uint8_t logcie_filter_module_eq_fn(void *data, Logcie_Log *log);
+
+/**
+ * @brief Filters out logs if log messages contains specified string
+ * @param data const char*
+ */
+LOGCIE_DEF uint8_t logcie_filter_message_contains_fn(void *data, Logcie_Log *log);
+
+typedef uint8_t(Logcie_FilterCustomPredicateFn)(Logcie_Log *log);
+
+/**
+ * @brief Filters out logs if specified function returns 0
+ * @param data *Logcie_FilterCustomPredicateFn
+ */
+LOGCIE_DEF uint8_t logcie_filter_custom_fn(void *data, Logcie_Log *log);
+
+/**
+ * @brief Accepts every log. For places that need a filter function, like LOGCIE_STATIC_SINKS
+ */
+LOGCIE_DEF uint8_t logcie_filter_pass_fn(void *data, Logcie_Log *log);
+
+#ifndef LOGCIE_RATE_LIMIT_SLOTS
+#define LOGCIE_RATE_LIMIT_SLOTS 64
+#endif
+
+/**
+ * @enum Logcie_RateLimitKey
+ * @brief What logs share the same token bucket in Logcie_RateLimit
+ *
+ * @value LOGCIE_RATE_LIMIT_GLOBAL        One bucket for every log
+ * @value LOGCIE_RATE_LIMIT_PER_MODULE    Bucket per module
+ * @value LOGCIE_RATE_LIMIT_PER_CALLSITE  Bucket per call site (LOGCIE_* macro expansion)
+ */
+typedef enum Logcie_RateLimitKey {
+  LOGCIE_RATE_LIMIT_GLOBAL,
+  LOGCIE_RATE_LIMIT_PER_MODULE,
+  LOGCIE_RATE_LIMIT_PER_CALLSITE,
+} Logcie_RateLimitKey;
+
+/**
+ * @brief Token bucket rate limiter state (see logcie_filter_rate_limit)
+ *
+ * Every bucket allows `burst` logs at once and refills with `per_second` tokens
+ * per second. Buckets are lock-free, so the same limiter can be shared by threads.
+ * Keys are hashed into LOGCIE_RATE_LIMIT_SLOTS buckets, so on collision
+ * different modules or call sites share one bucket.
+ *
+ * Zero initialize it and set configuration fields:
+ *   ```c
+ *   static Logcie_RateLimit limit = {.burst = 20, .per_second = 5, .key = LOGCIE_RATE_LIMIT_PER_CALLSITE};
+ *   ```
+ *
+ * @field burst       Maximum number of logs that can pass at once (0 is treated as 1)
+ * @field per_second  Refill rate. 0 means bucket never refills
+ * @field key         What logs share the same bucket
+ * @field suppressed  Number of suppressed logs (see logcie_rate_limit_suppressed)
+ * @field tat         Internal. Theoretical arrival time of the next log for each bucket
+ */
+typedef struct Logcie_RateLimit {
+  uint32_t            burst;
+  uint32_t            per_second;
+  Logcie_RateLimitKey key;
+  uint64_t            suppressed;
+  uint64_t            tat[LOGCIE_RATE_LIMIT_SLOTS];
+} Logcie_RateLimit;
+
+/**
+ * @brief Filters out logs that exceed rate limit
+ * @param data *Logcie_RateLimit
+ */
+LOGCIE_DEF uint8_t logcie_filter_rate_limit_fn(void *data, Logcie_Log *log);
+
+/**
+ * @brief Creates rate limiting filter. `limit` must stay valid while filter is used
+ */
+LOGCIE_DEF Logcie_Filter logcie_filter_rate_limit(Logcie_RateLimit *limit);
+
+/**
+ * @brief Returns number of logs suppressed by rate limiter so far
+ */
+LOGCIE_DEF uint64_t logcie_rate_limit_suppressed(Logcie_RateLimit *limit);
+
+#ifndef LOGCIE_PATTERNS_MAX_STATES
+#define LOGCIE_PATTERNS_MAX_STATES 128
+#endif
+
+#ifndef LOGCIE_PATTERNS_MAX_CLASSES
+#define LOGCIE_PATTERNS_MAX_CLASSES 32
+#endif
+
+#if LOGCIE_PATTERNS_MAX_STATES > 65535
+#error "LOGCIE_PATTERNS_MAX_STATES can't be above 65535: states are numbered with uint16_t"
+#endif
+
+#if LOGCIE_PATTERNS_MAX_CLASSES > 255
+#error "LOGCIE_PATTERNS_MAX_CLASSES can't be above 255: byte classes are numbered with uint8_t"
+#endif
+
+/**
+ * @brief Set of substrings compiled into Aho-Corasick automaton
+ *
+ * Automaton is a full DFA over byte classes (every distinct byte of the patterns
+ * is a class, the rest share class 0), so matching is a single pass with one
+ * table lookup per byte. While automaton is in the root state, message is skipped
+ * up to the next byte that can start a pattern (16 bytes at a time with SSE2 when
+ * there are at most 4 such bytes).
+ *
+ * Everything is stored inline (no allocations). Capacity is limited by
+ * LOGCIE_PATTERNS_MAX_STATES (total length of patterns + 1) and
+ * LOGCIE_PATTERNS_MAX_CLASSES (distinct bytes + 1). Use logcie_patterns_compile()
+ * to fill it.
+ *
+ * @field rendered    Match rendered message instead of format string
+ * @field states      Number of states
+ * @field classes     Number of byte classes
+ * @field first_len   Number of bytes in `first` (0 if there are more than 4 of them)
+ * @field first       Bytes that can start a pattern (for SIMD scanning)
+ * @field byte_class  Class of every byte
+ * @field match       Whether state ends some pattern
+ * @field next        Transition table
+ */
+typedef struct Logcie_PatternSet {
+  uint8_t  rendered;
+  uint16_t states;
+  uint8_t  classes;
+  uint8_t  first_len;
+  uint8_t  first[4];
+  uint8_t  byte_class[256];
+  uint8_t  match[LOGCIE_PATTERNS_MAX_STATES];
+  uint16_t next[LOGCIE_PATTERNS_MAX_STATES][LOGCIE_PATTERNS_MAX_CLASSES];
+} Logcie_PatternSet;
+
+/**
+ * @brief Compiles patterns into pattern set
+ *
+ * @param set       Pattern set to fill
+ * @param patterns  Substrings to look for
+ * @param count     Number of patterns
+ * @param rendered  1 to match rendered message (see logcie_log_message), 0 to match format string
+ * @return 1 on success, 0 if patterns do not fit into LOGCIE_PATTERNS_MAX_* limits
+ */
+LOGCIE_DEF uint8_t logcie_patterns_compile(Logcie_PatternSet *set, const char *const *patterns, size_t count, uint8_t rendered);
+
+/**
+ * @brief Checks whether text contains any pattern of the set
+ */
+LOGCIE_DEF uint8_t logcie_patterns_match(const Logcie_PatternSet *set, const char *text, size_t len);
+
+/**
+ * @brief Allows logs which message contains any of the patterns
+ * @param data *Logcie_PatternSet
+ */
+LOGCIE_DEF uint8_t logcie_filter_patterns_fn(void *data, Logcie_Log *log);
+
+/**
+ * @brief Creates multi-pattern message filter. `set` must stay valid while filter is used
+ */
+LOGCIE_DEF Logcie_Filter logcie_filter_patterns(Logcie_PatternSet *set);
+
+#ifndef LOGCIE_REGEX_MAX_STATES
+#define LOGCIE_REGEX_MAX_STATES 64
+#endif
+
+#ifndef LOGCIE_REGEX_MAX_CLASSES
+#define LOGCIE_REGEX_MAX_CLASSES 32
+#endif
+
+#if LOGCIE_REGEX_MAX_STATES > 255
+#error "LOGCIE_REGEX_MAX_STATES can't be above 255: states are numbered with uint8_t"
+#endif
+
+#if LOGCIE_REGEX_MAX_CLASSES > 255
+#error "LOGCIE_REGEX_MAX_CLASSES can't be above 255: byte classes are numbered with uint8_t"
+#endif
+
+/**
+ * @enum Logcie_RegexTarget
+ * @brief Which part of a log is matched by Logcie_Regex
+ *
+ * @value LOGCIE_REGEX_MESSAGE  Rendered message (see logcie_log_message)
+ * @value LOGCIE_REGEX_FORMAT   Format string of the message
+ * @value LOGCIE_REGEX_MODULE   Module name
+ * @value LOGCIE_REGEX_FILE     Source file name
+ */
+typedef enum Logcie_RegexTarget {
+  LOGCIE_REGEX_MESSAGE,
+  LOGCIE_REGEX_FORMAT,
+  LOGCIE_REGEX_MODULE,
+  LOGCIE_REGEX_FILE,
+} Logcie_RegexTarget;
+
+/**
+ * @brief Regular expression compiled to a DFA
+ *
+ * Supported subset of POSIX ERE:
+ *   - literals, `.`, `\` escapes (`\d`, `\w`, `\s`, `\D`, `\W`, `\S`, `\.` and any other escaped char)
+ *   - bracket expressions: `[a-z_]`, `[^0-9]`, `[[:digit:]]` (and other POSIX character classes)
+ *   - grouping `( )`, alternation `|`, repetition `*`, `+`, `?`
+ *   - anchors `^` and `$` only at the beginning and at the end of the whole pattern
+ * Not supported: intervals `{n,m}`, backreferences, at most 63 characters/sets in a pattern.
+ *
+ * Pattern is compiled once (see logcie_regex_compile), matching is a single pass
+ * with one table lookup per byte: no backtracking and no allocations.
+ * Without `^` pattern matches anywhere in the text.
+ *
+ * @field target        Part of a log to match
+ * @field anchored_end  Pattern ends with `$`
+ * @field states        Number of DFA states
+ * @field classes       Number of byte classes
+ * @field byte_class    Class of every byte
+ * @field accept        Whether state is accepting
+ * @field next          Transition table
+ */
+typedef struct Logcie_Regex {
+  Logcie_RegexTarget target;
+  uint8_t            anchored_end;
+  uint8_t            states;
+  uint8_t            classes;
+  uint8_t            byte_class[256];
+  uint8_t            accept[LOGCIE_REGEX_MAX_STATES];
+  uint8_t            next[LOGCIE_REGEX_MAX_STATES][LOGCIE_REGEX_MAX_CLASSES];
+} Logcie_Regex;
+
+/**
+ * @brief Compiles regular expression
+ *
+ * @param re       Regex to fill
+ * @param pattern  Pattern (see Logcie_Regex for supported syntax)
+ * @param target   Part of a log to match
+ * @return 1 on success, 0 if pattern is invalid, unsupported or does not fit into LOGCIE_REGEX_MAX_* limits
+ */
+LOGCIE_DEF uint8_t logcie_regex_compile(Logcie_Regex *re, const char *pattern, Logcie_RegexTarget target);
+
+/**
+ * @brief Checks whether text matches the regex
+ */
+LOGCIE_DEF uint8_t logcie_regex_match(const Logcie_Regex *re, const char *text, size_t len);
+
+/**
+ * @brief Allows logs which target (message, module, file) matches the regex
+ * @param data *Logcie_Regex
+ */
+LOGCIE_DEF uint8_t logcie_filter_regex_fn(void *data, Logcie_Log *log);
+
+/**
+ * @brief Creates regex filter. `re` must stay valid while filter is used
+ */
+LOGCIE_DEF Logcie_Filter logcie_filter_regex(Logcie_Regex *re);
+
+// Some handy filter "constructors"
 
 LOGCIE_DEF Logcie_Filter logcie_filter_and(Logcie_Filter a, Logcie_Filter b) {
   static Logcie_FilterCombinationData storage;
@@ -794,469 +2480,4413 @@ LOGCIE_DEF Logcie_Filter logcie_filter_and(Logcie_Filter a, Logcie_Filter b) {
   return (Logcie_Filter){logcie_filter_and_fn, &storage};
 }
 
-LOGCIE_DEF Logcie_Filter logcie_filter_or(Logcie_Filter a, Logcie_Filter b) {
-  static Logcie_FilterCombinationData storage;
-  storage.a = a;
-  storage.b = b;
-  return (Logcie_Filter){logcie_filter_or_fn, &storage};
+LOGCIE_DEF Logcie_Filter logcie_filter_or(Logcie_Filter a, Logcie_Filter b) {
+  static Logcie_FilterCombinationData storage;
+  storage.a = a;
+  storage.b = b;
+  return (Logcie_Filter){logcie_filter_or_fn, &storage};
+}
+
+LOGCIE_DEF Logcie_Filter logcie_filter_not(Logcie_Filter const filter) {
+  static Logcie_Filter storage;
+  storage = filter;
+  return (Logcie_Filter){logcie_filter_not_fn, &storage};
+}
+
+LOGCIE_DEF Logcie_Filter logcie_filter_level_min(Logcie_LogLevel level) {
+  static Logcie_LogLevel storage;
+  storage = level;
+  return (Logcie_Filter){logcie_filter_level_min_fn, &storage};
+}
+
+LOGCIE_DEF Logcie_Filter logcie_filter_level_max(Logcie_LogLevel level) {
+  static Logcie_LogLevel storage;
+  storage = level;
+  return (Logcie_Filter){logcie_filter_level_max_fn, &storage};
+}
+
+LOGCIE_DEF Logcie_Filter logcie_filter_module_eq(const char *module) {
+  return (Logcie_Filter){logcie_filter_message_contains_fn, (void *)module};
+}
+
+LOGCIE_DEF Logcie_Filter logcie_filter_message_contains(const char *substr) {
+  return (Logcie_Filter){logcie_filter_message_contains_fn, (void *)substr};
+}
+
+LOGCIE_DEF Logcie_Filter logcie_filter_custom(Logcie_FilterCustomPredicateFn *fn) {
+  return (Logcie_Filter){logcie_filter_custom_fn, &fn};
+}
+
+/**
+ * @brief Allows customization of log level colors. Must be array of size Count_LOGCIE_LEVEL.
+ *
+ * Override the default ANSI color codes for each log level. The array must
+ * contain exactly Count_LOGCIE_LEVEL (7) elements. Pass NULL to reset to defaults.
+ *
+ * @param colors Array of ANSI color code strings, one per log level in order:
+ *               [TRACE, DEBUG, VERBOSE, INFO, WARN, ERROR, FATAL]
+ *               or NULL to reset to defaults
+ * @note Colors are applied globally to all sinks using the default formatter
+ * @note Custom formatters may ignore these colors
+ * @note I can not check if colors array is valid in runtime. I did what I can,
+ *       but still try to compile if -fsanitize=address to check if everything is all right
+ */
+LOGCIE_DEF void logcie_set_colors(const char **colors);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* end of include guard: LOGCIE */
+
+/* --------------------------------------------- */
+
+#ifdef LOGCIE_IMPLEMENTATION
+
+#include <assert.h>
+#include <ctype.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+#endif
+
+#if !defined(LOGCIE_NO_SIMD) && defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define _LOGCIE_SSE2
+#include <emmintrin.h>
+#endif
+
+static const char *default_module = "Logcie";
+
+#ifndef _LOGCIE_ASSERT
+#define _LOGCIE_ASSERT(bool, msg) assert(bool &&msg)
+#endif
+
+#ifdef _LOGCIE_DEBUG
+#if __STDC_VERSION__ >= 201112L  // Check for C11 support
+#define _LOGCIE_DEBUG_ASSERT(bool, msg) static_assert(bool, msg)
+#else
+#define _LOGCIE_DEBUG_ASSERT(bool, msg) _LOGCIE_ASSERT(bool, msg)
+#endif
+#else
+#define _LOGCIE_DEBUG_ASSERT(bool, msg)
+#endif
+
+#ifndef _LOGCIE_ARR_LEN
+#define _LOGCIE_ARR_LEN(array) ((int)sizeof(array) / (int)sizeof((array)[0]))
+#endif
+
+// Monotonic time in nanoseconds. Strict C99 without POSIX has only
+// time(), so precision there is one second
+static uint64_t logcie_now_ns(void) {
+#if defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#elif defined(TIME_UTC)
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#else
+  return (uint64_t)time(NULL) * 1000000000ull;
+#endif
+}
+
+// FNV-1a
+static uint64_t logcie_hash_bytes(uint64_t hash, const void *data, size_t len) {
+  const unsigned char *bytes = (const unsigned char *)data;
+
+  for (size_t i = 0; i < len; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+
+  return hash;
+}
+
+#define _LOGCIE_HASH_INIT 14695981039346656037ull
+
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define _LOGCIE_THREAD_LOCAL thread_local
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define _LOGCIE_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__) || defined(__clang__)
+#define _LOGCIE_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define _LOGCIE_THREAD_LOCAL __declspec(thread)
+#else
+#define _LOGCIE_THREAD_LOCAL
+#endif
+
+static const char *logcie_level_label[] = {
+  "trace",
+  "debug",
+  "verb",
+  "info",
+  "warn",
+  "error",
+  "fatal",
+};
+
+static inline const char *get_logcie_level_label(Logcie_LogLevel level) {
+  _LOGCIE_DEBUG_ASSERT(Count_LOGCIE_LEVEL == 7, "Forgot to update get_logcie_level_label, you dummy dumb fuck");
+  _LOGCIE_ASSERT(level < Count_LOGCIE_LEVEL, "Unexpected log level");
+  return logcie_level_label[level];
+}
+
+static const char *logcie_level_label_upper[] = {
+  "TRACE",
+  "DEBUG",
+  "VERB",
+  "INFO",
+  "WARN",
+  "ERROR",
+  "FATAL",
+};
+
+static inline const char *get_logcie_level_label_upper(Logcie_LogLevel level) {
+  _LOGCIE_DEBUG_ASSERT(Count_LOGCIE_LEVEL == 7, "Forgot to update get_logcie_level_label, you dummy dumb fuck");
+  _LOGCIE_ASSERT(level < Count_LOGCIE_LEVEL, "Unexpected log level");
+  return logcie_level_label_upper[level];
+}
+
+static const char *logcie_default_level_color[] = {
+  LOGCIE_COLOR_GRAY,
+  LOGCIE_COLOR_GRAY,
+  LOGCIE_COLOR_GRAY,
+  LOGCIE_COLOR_BLUE,
+  LOGCIE_COLOR_YELLOW,
+  LOGCIE_COLOR_RED,
+  LOGCIE_COLOR_BRIGHT_RED,
+};
+
+static const char **logcie_level_color = logcie_default_level_color;
+
+void logcie_set_colors(const char **colors) {
+  if (colors) {
+    // If compiled with -fsanitize=address and colors array is wrong it will crash
+    // If it is compiled without -fsanitize=address then color would be NULL (I hope)
+    const char *color = colors[Count_LOGCIE_LEVEL - 1];
+    _LOGCIE_ASSERT(color != NULL, "Size of array of colors in logcie_set_colors is not equal to Count_LOGCIE_LEVEL");
+    logcie_level_color = colors;
+  } else {
+    logcie_level_color = logcie_default_level_color;
+  }
+}
+
+static inline const char *get_logcie_level_color(Logcie_LogLevel level) {
+  _LOGCIE_DEBUG_ASSERT(Count_LOGCIE_LEVEL == 7, "Forgot to update get_logcie_level_label, you dummy dumb fuck");
+  _LOGCIE_ASSERT(level < Count_LOGCIE_LEVEL, "Unexpected log level");
+  return logcie_level_color[level];
+}
+
+static Logcie_Sink default_stdout_sink = {
+  .formatter = {logcie_printf_formatter, (void *)("$c$L$r " LOGCIE_COLOR_GRAY "$f:$x$r: $m")},
+  .writer    = {logcie_printf_writer, NULL, logcie_printf_writev, logcie_printf_flush},
+  .filter    = {NULL, NULL},
+  .dedup     = NULL,
+  .async     = NULL,
+};
+
+static Logcie_Sink *default_stdout_sink_ptr = &default_stdout_sink;
+
+#if defined(__has_attribute) && __has_attribute(constructor)
+#define __L_ATTR_CONSTRUCT
+#endif
+
+#ifdef __L_ATTR_CONSTRUCT
+__attribute__((constructor)) void init_default_stdout_sink(void) {
+  default_stdout_sink.writer.data = stdout;
+}
+#endif
+
+typedef struct Logcie_Logger {
+  Logcie_Sink **sinks;
+  size_t        sinks_len;
+  size_t        sinks_cap;
+} Logcie_Logger;
+
+// INFO: By default there is one default sink to allow logging right
+//       after includnig Logcie without initializing anything.
+//       Static sinks replace it
+static Logcie_Logger logcie_logger = {
+  .sinks = &default_stdout_sink_ptr,
+#ifdef LOGCIE_STATIC_SINKS
+  .sinks_len = 0,
+#else
+  .sinks_len = 1,
+#endif
+  .sinks_cap = 1,
+};
+
+size_t logcie_get_sink_count(void) {
+  return logcie_logger.sinks_len;
+}
+
+Logcie_Sink *logcie_get_sink(size_t index) {
+  if (index >= logcie_logger.sinks_len) {
+    return NULL;
+  }
+
+  return logcie_logger.sinks[index];
+}
+
+uint8_t logcie_add_sink(Logcie_Sink *sink) {
+  if (sink == NULL) {
+    return 0;
+  }
+
+#ifndef __L_ATTR_CONSTRUCT
+  if (sink->writer.data == NULL)
+    sink->writer.data = stdout;
+#endif
+
+  if (logcie_logger.sinks_cap == 1) {
+    logcie_logger.sinks_cap = 8;
+    logcie_logger.sinks_len = 0;
+    logcie_logger.sinks     = (Logcie_Sink **)malloc(sizeof(*logcie_logger.sinks) * logcie_logger.sinks_cap);
+  }
+
+  if (logcie_logger.sinks_cap == logcie_logger.sinks_len) {
+    logcie_logger.sinks_cap *= 2;
+    logcie_logger.sinks = (Logcie_Sink **)realloc(logcie_logger.sinks, sizeof(*logcie_logger.sinks) * logcie_logger.sinks_cap);
+  }
+
+  logcie_logger.sinks[logcie_logger.sinks_len] = sink;
+  logcie_logger.sinks_len++;
+
+  logcie_invalidate_callsites();
+  return 1;
+}
+
+uint8_t logcie_remove_sink(Logcie_Sink *sink) {
+  if (sink == &default_stdout_sink) {
+    return 0;  // unreachable
+  }
+
+  for (size_t i = 0; i < logcie_logger.sinks_len; i++) {
+    if (logcie_logger.sinks[i] == sink) {
+      return logcie_remove_sink_by_index(i);
+    }
+  }
+
+  return 0;
+}
+
+uint8_t logcie_remove_sink_by_index(size_t index) {
+  if (index >= logcie_logger.sinks_len) {
+    return 0;
+  }
+
+  if (logcie_logger.sinks_cap == 1 && index == 0) {
+    return 0;
+  }
+
+  for (size_t i = index; i < logcie_logger.sinks_len; i++) {
+    logcie_logger.sinks[i] = logcie_logger.sinks[i + 1];
+  }
+
+  logcie_logger.sinks_len--;
+  logcie_invalidate_callsites();
+  return 1;
+}
+
+uint8_t logcie_remove_and_free_sink(Logcie_Sink *sink) {
+  if (logcie_remove_sink(sink)) {
+    free(sink);
+    return 1;
+  }
+
+  return 0;
+}
+
+void logcie_remove_all_sinks(void) {
+  if (logcie_logger.sinks_cap > 1) {
+    free(logcie_logger.sinks);
+    logcie_logger.sinks_cap = 1;
+    logcie_logger.sinks_len = 1;
+    logcie_logger.sinks     = &default_stdout_sink_ptr;
+    logcie_invalidate_callsites();
+    return;
+  }
+}
+
+uint32_t logcie_callsite_generation = 1;
+
+typedef struct Logcie_CallSiteRule {
+  const char          *file;
+  uint32_t             line;
+  Logcie_CallSiteState state;
+} Logcie_CallSiteRule;
+
+static Logcie_CallSiteRule logcie_callsite_rules[LOGCIE_CALLSITE_RULES_MAX];
+static size_t              logcie_callsite_rules_len = 0;
+
+void logcie_invalidate_callsites(void) {
+  uint32_t generation = logcie_callsite_generation + 1;
+
+  // 0 is reserved for call sites that were never evaluated
+  _LOGCIE_ATOMIC_STORE(&logcie_callsite_generation, generation == 0 ? 1 : generation);
+}
+
+// Checks if `file` is equal to `pattern` or ends with "/pattern"
+static uint8_t logcie_callsite_file_matches(const char *file, const char *pattern) {
+  size_t file_len    = strlen(file);
+  size_t pattern_len = strlen(pattern);
+
+  if (pattern_len > file_len || strcmp(file + file_len - pattern_len, pattern) != 0) {
+    return 0;
+  }
+
+  if (pattern_len == file_len) {
+    return 1;
+  }
+
+  char sep = file[file_len - pattern_len - 1];
+  return sep == '/' || sep == '\\';
+}
+
+uint8_t logcie_callsite_set(const char *file, uint32_t line, Logcie_CallSiteState state) {
+  if (file == NULL) {
+    return 0;
+  }
+
+  for (size_t i = 0; i < logcie_callsite_rules_len; i++) {
+    Logcie_CallSiteRule *rule = &logcie_callsite_rules[i];
+
+    if (rule->line != line || strcmp(rule->file, file) != 0) {
+      continue;
+    }
+
+    if (state == LOGCIE_CALLSITE_DEFAULT) {
+      *rule = logcie_callsite_rules[--logcie_callsite_rules_len];
+    } else {
+      rule->state = state;
+    }
+
+    logcie_invalidate_callsites();
+    return 1;
+  }
+
+  if (state == LOGCIE_CALLSITE_DEFAULT) {
+    return 1;
+  }
+
+  if (logcie_callsite_rules_len == LOGCIE_CALLSITE_RULES_MAX) {
+    return 0;
+  }
+
+  logcie_callsite_rules[logcie_callsite_rules_len++] = (Logcie_CallSiteRule){file, line, state};
+  logcie_invalidate_callsites();
+  return 1;
+}
+
+void logcie_callsite_reset(void) {
+  logcie_callsite_rules_len = 0;
+  logcie_invalidate_callsites();
+}
+
+typedef enum Logcie_FilterVerdict {
+  LOGCIE_VERDICT_FAIL,
+  LOGCIE_VERDICT_PASS,
+  LOGCIE_VERDICT_UNKNOWN,
+} Logcie_FilterVerdict;
+
+// Evaluates filter knowing only the log level. Filters that depend on anything
+// else (module, message, time, custom predicates) are UNKNOWN, so call site
+// is disabled only when every sink provably rejects the level.
+static Logcie_FilterVerdict logcie_filter_level_verdict(const Logcie_Filter *filter, Logcie_LogLevel level) {
+  if (filter->filter == NULL || filter->filter == logcie_filter_pass_fn) {
+    return LOGCIE_VERDICT_PASS;
+  }
+
+  if (filter->filter == logcie_filter_level_min_fn) {
+    return level >= *(Logcie_LogLevel *)filter->data ? LOGCIE_VERDICT_PASS : LOGCIE_VERDICT_FAIL;
+  }
+
+  if (filter->filter == logcie_filter_level_max_fn) {
+    return level <= *(Logcie_LogLevel *)filter->data ? LOGCIE_VERDICT_PASS : LOGCIE_VERDICT_FAIL;
+  }
+
+  if (filter->filter == logcie_filter_not_fn) {
+    Logcie_FilterVerdict v = logcie_filter_level_verdict((Logcie_Filter *)filter->data, level);
+    return v == LOGCIE_VERDICT_UNKNOWN ? v : (v == LOGCIE_VERDICT_PASS ? LOGCIE_VERDICT_FAIL : LOGCIE_VERDICT_PASS);
+  }
+
+  if (filter->filter == logcie_filter_and_fn || filter->filter == logcie_filter_or_fn) {
+    Logcie_FilterCombinationData *d = (Logcie_FilterCombinationData *)filter->data;
+    Logcie_FilterVerdict          a = logcie_filter_level_verdict(&d->a, level);
+    Logcie_FilterVerdict          b = logcie_filter_level_verdict(&d->b, level);
+
+    // Swapping PASS and FAIL turns 'or' into 'and'
+    Logcie_FilterVerdict dominant = filter->filter == logcie_filter_and_fn ? LOGCIE_VERDICT_FAIL : LOGCIE_VERDICT_PASS;
+
+    if (a == dominant || b == dominant) {
+      return dominant;
+    }
+
+    return a == LOGCIE_VERDICT_UNKNOWN || b == LOGCIE_VERDICT_UNKNOWN ? LOGCIE_VERDICT_UNKNOWN : a;
+  }
+
+  return LOGCIE_VERDICT_UNKNOWN;
+}
+
+#ifdef LOGCIE_STATIC_SINKS
+#define _LOGCIE_STATIC_SINK_VERDICT(filter_fn, filter_data, format_fn, format_data, write_fn, writev_fn, write_data) \
+  {                                                                                                             \
+    Logcie_Filter filter = {filter_fn, (void *)(filter_data)};                                                  \
+    enabled |= logcie_filter_level_verdict(&filter, level) != LOGCIE_VERDICT_FAIL;                              \
+  }
+
+static uint8_t logcie_static_sinks_verdict(Logcie_LogLevel level) {
+  uint8_t enabled = 0;
+  LOGCIE_STATIC_SINKS(_LOGCIE_STATIC_SINK_VERDICT)
+  return enabled;
+}
+#endif
+
+uint8_t logcie_callsite_refresh(const Logcie_CallSite *site) {
+  // Read before the decision, so invalidation during it is not lost
+  uint32_t             generation = _LOGCIE_ATOMIC_LOAD(&logcie_callsite_generation);
+  Logcie_CallSiteState state      = LOGCIE_CALLSITE_DEFAULT;
+  uint8_t              exact_rule = 0;
+
+  for (size_t i = 0; i < logcie_callsite_rules_len && !exact_rule; i++) {
+    Logcie_CallSiteRule *rule = &logcie_callsite_rules[i];
+
+    if ((rule->line == 0 || rule->line == site->line) && logcie_callsite_file_matches(site->file, rule->file)) {
+      state      = rule->state;
+      exact_rule = rule->line != 0;
+    }
+  }
+
+  uint8_t enabled = state == LOGCIE_CALLSITE_ENABLED;
+
+  if (state == LOGCIE_CALLSITE_DEFAULT) {
+#ifdef LOGCIE_STATIC_SINKS
+    enabled = logcie_static_sinks_verdict(site->level);
+#endif
+
+    for (size_t i = 0; i < logcie_logger.sinks_len && !enabled; i++) {
+      enabled = logcie_filter_level_verdict(&logcie_logger.sinks[i]->filter, site->level) != LOGCIE_VERDICT_FAIL;
+    }
+  }
+
+  site->cache->enabled = enabled;
+  _LOGCIE_ATOMIC_STORE(&site->cache->generation, generation);
+  return enabled;
+}
+
+#ifdef LOGCIE_CALLSITE_SECTION
+// Provided by linker for sections with C identifier names. Weak, since
+// there is no section at all if program has no call sites
+extern const Logcie_CallSite __start_logcie_callsites[] __attribute__((weak));
+extern const Logcie_CallSite __stop_logcie_callsites[] __attribute__((weak));
+
+size_t logcie_callsite_count(void) {
+  if (__start_logcie_callsites == NULL) {
+    return 0;
+  }
+
+  return (size_t)(__stop_logcie_callsites - __start_logcie_callsites);
+}
+
+const Logcie_CallSite *logcie_callsite_get(size_t index) {
+  if (index >= logcie_callsite_count()) {
+    return NULL;
+  }
+
+  return &__start_logcie_callsites[index];
+}
+#else
+size_t logcie_callsite_count(void) {
+  return 0;
+}
+
+const Logcie_CallSite *logcie_callsite_get(size_t index) {
+  (void)index;
+  return NULL;
+}
+#endif
+
+#ifdef _LOGCIE_THREADS
+// Every queued line starts with 8 byte header: length and level. Line that does not
+// fit before the end of the buffer is queued from the start, after a wrap marker
+#define _LOGCIE_ASYNC_WRAP UINT32_MAX
+#define _LOGCIE_ASYNC_RECORD_SIZE(len) (8 + (((len) + 7) & ~(size_t)7))
+
+typedef struct Logcie_AsyncHeader {
+  uint32_t len;
+  uint32_t level;
+} Logcie_AsyncHeader;
+
+// Returns header of the oldest line. Expects queue to be locked and not empty
+static Logcie_AsyncHeader logcie_async_oldest(Logcie_Async *async) {
+  Logcie_AsyncHeader header;
+  memcpy(&header, async->buffer + async->tail % LOGCIE_ASYNC_BUFFER, sizeof(header));
+
+  if (header.len == _LOGCIE_ASYNC_WRAP) {
+    async->tail += LOGCIE_ASYNC_BUFFER - async->tail % LOGCIE_ASYNC_BUFFER;
+    memcpy(&header, async->buffer, sizeof(header));
+  }
+
+  return header;
+}
+
+// Removes the oldest line from the queue. Expects queue to be locked and not empty
+static Logcie_AsyncHeader logcie_async_pop(Logcie_Async *async, char *line) {
+  Logcie_AsyncHeader header = logcie_async_oldest(async);
+  _LOGCIE_ASSERT(header.len <= LOGCIE_LINE_MAX, "Queued line is longer than worker buffer");
+
+  if (line) {
+    memcpy(line, async->buffer + async->tail % LOGCIE_ASYNC_BUFFER + sizeof(header), header.len);
+  }
+
+  async->tail += _LOGCIE_ASYNC_RECORD_SIZE(header.len);
+
+  if (async->tail == async->head) {
+    async->tail = 0;
+    async->head = 0;
+  }
+
+  return header;
+}
+
+static void logcie_async_drop(Logcie_Async *async, uint32_t level) {
+  async->dropped++;
+  async->dropped_levels[level]++;
+}
+
+// Absolute CLOCK_REALTIME time `ms` from now, as pthread_cond_timedwait expects
+static struct timespec logcie_async_deadline(uint32_t ms) {
+  struct timespec deadline;
+#if defined(CLOCK_REALTIME)
+  clock_gettime(CLOCK_REALTIME, &deadline);
+#elif defined(TIME_UTC)
+  timespec_get(&deadline, TIME_UTC);
+#else
+  deadline.tv_sec  = time(NULL);
+  deadline.tv_nsec = 0;
+#endif
+  uint64_t nsec     = (uint64_t)deadline.tv_nsec + (uint64_t)(ms % 1000) * 1000000ull;
+  deadline.tv_sec  += (time_t)(ms / 1000 + nsec / 1000000000ull);
+  deadline.tv_nsec  = (long)(nsec % 1000000000ull);
+  return deadline;
+}
+
+// `cut` tells that line was already cut when it was formatted
+static void logcie_async_push(Logcie_Async *async, Logcie_LogLevel level, const char *line, size_t len, uint8_t cut) {
+  // Worker copies a line to its own buffer, longer one is cut and still ends with a newline
+  uint8_t truncated = cut || len > LOGCIE_LINE_MAX;
+
+  if (len > LOGCIE_LINE_MAX) {
+    len = LOGCIE_LINE_MAX;
+  }
+
+  size_t          size    = _LOGCIE_ASYNC_RECORD_SIZE(len);
+  uint8_t         waited  = 0;
+  struct timespec deadline;
+
+  // Reserved part of the queue is kept for important logs
+  size_t limit = LOGCIE_ASYNC_BUFFER;
+
+  if (level < async->level) {
+    limit = async->reserve < LOGCIE_ASYNC_BUFFER ? LOGCIE_ASYNC_BUFFER - async->reserve : 0;
+  }
+
+  pthread_mutex_lock(&async->lock);
+
+  // Crash handler reads the queue without the lock, it is not changed after that
+  if (_LOGCIE_ATOMIC_LOAD(&async->crashing)) {
+    logcie_async_drop(async, (uint32_t)level);
+    pthread_mutex_unlock(&async->lock);
+    return;
+  }
+
+  for (;;) {
+    size_t offset = async->head % LOGCIE_ASYNC_BUFFER;
+    size_t wrap   = LOGCIE_ASYNC_BUFFER - offset < size ? LOGCIE_ASYNC_BUFFER - offset : 0;
+
+    if (async->head - async->tail + wrap + size <= limit) {
+      break;
+    }
+
+    // Empty queue starts from the beginning, so line that does not fit now never fits
+    uint8_t fits = size <= limit && async->head != async->tail;
+
+    if (fits && async->policy == LOGCIE_OVERFLOW_BLOCK) {
+      if (async->block_timeout_ms == 0) {
+        pthread_cond_wait(&async->not_full, &async->lock);
+        continue;
+      }
+
+      if (!waited) {
+        deadline = logcie_async_deadline(async->block_timeout_ms);
+        waited   = 1;
+      }
+
+      if (pthread_cond_timedwait(&async->not_full, &async->lock, &deadline) != ETIMEDOUT) {
+        continue;
+      }
+    }
+
+    if (fits && (async->policy == LOGCIE_OVERFLOW_DROP_OLDEST || (async->policy == LOGCIE_OVERFLOW_DROP_BELOW_LEVEL && level >= async->level))) {
+      // Log never replaces more severe one
+      if (logcie_async_oldest(async).level <= (uint32_t)level) {
+        logcie_async_drop(async, logcie_async_pop(async, NULL).level);
+        continue;
+      }
+    }
+
+    logcie_async_drop(async, (uint32_t)level);
+    pthread_mutex_unlock(&async->lock);
+    return;
+  }
+
+  size_t offset = async->head % LOGCIE_ASYNC_BUFFER;
+
+  if (LOGCIE_ASYNC_BUFFER - offset < size) {
+    Logcie_AsyncHeader wrap = {_LOGCIE_ASYNC_WRAP, 0};
+    memcpy(async->buffer + offset, &wrap, sizeof(wrap));
+    async->head += LOGCIE_ASYNC_BUFFER - offset;
+    offset = 0;
+  }
+
+  Logcie_AsyncHeader header = {(uint32_t)len, (uint32_t)level};
+  memcpy(async->buffer + offset, &header, sizeof(header));
+  memcpy(async->buffer + offset + sizeof(header), line, len);
+  async->head += size;
+
+  if (truncated && len > 0) {
+    async->buffer[offset + sizeof(header) + len - 1] = '\n';
+  }
+
+  async->truncated += truncated;
+
+  pthread_cond_signal(&async->not_empty);
+  pthread_mutex_unlock(&async->lock);
+}
+
+// Worker marks itself busy before it takes a line or calls the writer, crash handler
+// marks the queue taken before it reads it. With full fences between, at most one of
+// them goes on. Worker that lost stays busy and exits
+static uint8_t logcie_async_claim(Logcie_Async *async) {
+  _LOGCIE_ATOMIC_STORE(&async->busy, 1);
+  _LOGCIE_ATOMIC_FENCE();
+  return !_LOGCIE_ATOMIC_LOAD(&async->crashing);
+}
+
+static void *logcie_async_worker(void *data) {
+  Logcie_Async *async = (Logcie_Async *)data;
+  char          line[LOGCIE_LINE_MAX];
+
+  pthread_mutex_lock(&async->lock);
+
+  for (;;) {
+    while (async->head == async->tail && !async->stopping && !async->flushing) {
+      pthread_cond_wait(&async->not_empty, &async->lock);
+    }
+
+    if (async->head == async->tail && async->flushing) {
+      if (!logcie_async_claim(async)) {
+        break;
+      }
+
+      pthread_mutex_unlock(&async->lock);
+
+      logcie_writer_flush(&async->sink->writer);
+
+      pthread_mutex_lock(&async->lock);
+      _LOGCIE_ATOMIC_STORE(&async->busy, 0);
+      async->flushing = 0;
+      pthread_cond_broadcast(&async->not_full);
+      continue;
+    }
+
+    if (async->head == async->tail) {
+      break;
+    }
+
+    if (!logcie_async_claim(async)) {
+      break;
+    }
+
+    // Line is copied out, so queue is not locked while writer works
+    Logcie_AsyncHeader header = logcie_async_pop(async, line);
+    pthread_cond_broadcast(&async->not_full);
+    pthread_mutex_unlock(&async->lock);
+
+    Logcie_Segment segment = {line, header.len};
+    logcie_writer_writev(&async->sink->writer, &segment, 1);
+
+    pthread_mutex_lock(&async->lock);
+    _LOGCIE_ATOMIC_STORE(&async->busy, 0);
+    async->written++;
+
+    if (async->head == async->tail) {
+      pthread_cond_broadcast(&async->not_full);
+    }
+  }
+
+  pthread_mutex_unlock(&async->lock);
+  return NULL;
+}
+
+uint8_t logcie_async_start(Logcie_Sink *sink, Logcie_Async *async) {
+  _LOGCIE_ASSERT(sink && async, "Async sink needs sink and state");
+  async->sink     = sink;
+  async->stopping = 0;
+  async->busy     = 0;
+  async->crashing = 0;
+  async->flushing = 0;
+  async->head     = 0;
+  async->tail     = 0;
+
+  pthread_mutex_init(&async->lock, NULL);
+  pthread_cond_init(&async->not_empty, NULL);
+  pthread_cond_init(&async->not_full, NULL);
+
+  // State is published before the worker exists, so it never sees it half set
+  pthread_mutex_lock(&async->lock);
+  async->running = 1;
+  sink->async    = async;
+  pthread_mutex_unlock(&async->lock);
+
+  if (pthread_create(&async->thread, NULL, logcie_async_worker, async) != 0) {
+    async->running = 0;
+    sink->async    = NULL;
+    pthread_cond_destroy(&async->not_full);
+    pthread_cond_destroy(&async->not_empty);
+    pthread_mutex_destroy(&async->lock);
+    return 0;
+  }
+
+  return 1;
+}
+
+void logcie_async_flush(Logcie_Async *async) {
+  if (!async->running) {
+    return;
+  }
+
+  pthread_mutex_lock(&async->lock);
+  async->flushing = 1;
+  pthread_cond_signal(&async->not_empty);
+
+  while (async->head != async->tail || async->busy || async->flushing) {
+    pthread_cond_wait(&async->not_full, &async->lock);
+  }
+
+  pthread_mutex_unlock(&async->lock);
+}
+
+void logcie_async_stop(Logcie_Async *async) {
+  if (!async->running) {
+    return;
+  }
+
+  for (size_t i = 0; i < logcie_logger.sinks_len; i++) {
+    _LOGCIE_ASSERT(logcie_logger.sinks[i] != async->sink, "Async sink must be removed before it is stopped");
+  }
+
+  pthread_mutex_lock(&async->lock);
+  async->sink->async = NULL;
+  async->stopping    = 1;
+  pthread_cond_signal(&async->not_empty);
+  pthread_mutex_unlock(&async->lock);
+
+  pthread_join(async->thread, NULL);
+  pthread_cond_destroy(&async->not_full);
+  pthread_cond_destroy(&async->not_empty);
+  pthread_mutex_destroy(&async->lock);
+  async->running = 0;
+}
+
+uint64_t logcie_async_dropped(Logcie_Async *async, Logcie_LogLevel level) {
+  _LOGCIE_ASSERT(level <= Count_LOGCIE_LEVEL, "Unexpected log level");
+
+  if (async->running) {
+    pthread_mutex_lock(&async->lock);
+  }
+
+  uint64_t dropped = level == Count_LOGCIE_LEVEL ? async->dropped : async->dropped_levels[level];
+
+  if (async->running) {
+    pthread_mutex_unlock(&async->lock);
+  }
+
+  return dropped;
+}
+#endif
+
+// Records are guarded by a sequence lock: odd sequence while record is written,
+// so dump skips records that are being written or were overwritten during copy
+static Logcie_FlightRecord *logcie_flight_recorder_begin(Logcie_FlightRecorder *recorder, uint64_t *number) {
+  *number                     = _LOGCIE_ATOMIC_ADD(&recorder->next, 1) - 1;
+  Logcie_FlightRecord *record = &recorder->records[*number % LOGCIE_FLIGHT_RECORDS];
+  _LOGCIE_ATOMIC_STORE(&record->sequence, 2 * *number + 1);
+  _LOGCIE_ATOMIC_FENCE();
+  return record;
+}
+
+static void logcie_flight_recorder_end(Logcie_FlightRecord *record, uint64_t number, Logcie_LogLevel level, Logcie_Buffer *buffer) {
+  // Truncated record still ends with newline
+  if (buffer->overflow && buffer->len > 0) {
+    buffer->data[buffer->len - 1] = '\n';
+  }
+
+  record->level = (uint32_t)level;
+  record->len   = (uint32_t)buffer->len;
+  _LOGCIE_ATOMIC_STORE(&record->sequence, 2 * number + 2);
+}
+
+size_t logcie_flight_recorder_formatter(Logcie_Writer *writer, void *user_data, Logcie_Log log, va_list *args) {
+  _LOGCIE_ASSERT(user_data, "Flight recorder formatter needs Logcie_FlightRecorder");
+  Logcie_FlightRecorder *recorder = (Logcie_FlightRecorder *)user_data;
+  const char            *format   = recorder->format ? recorder->format : "$L $m";
+
+  if (writer->writev != logcie_flight_recorder_writev || writer->data != user_data) {
+    return logcie_printf_formatter(writer, (void *)format, log, args);
+  }
+
+  // Log is formatted right into the ring
+  uint64_t             number;
+  Logcie_FlightRecord *record = logcie_flight_recorder_begin(recorder, &number);
+  Logcie_Buffer        buffer = {record->line, 0, sizeof(record->line), 0};
+  Logcie_Writer        line   = {logcie_buffer_writer, &buffer, logcie_buffer_writev, NULL};
+  logcie_printf_formatter(&line, (void *)format, log, args);
+  logcie_flight_recorder_end(record, number, log.level, &buffer);
+
+  Logcie_LogLevel dump_level = recorder->dump_level_set ? recorder->dump_level : LOGCIE_LEVEL_ERROR;
+
+  if (log.level >= dump_level) {
+    logcie_flight_recorder_dump(recorder);
+  }
+
+  return buffer.len;
+}
+
+size_t logcie_flight_recorder_writer(void *user_data, const char *fmt, va_list *va, ...) {
+  char    line[LOGCIE_FLIGHT_RECORD_MAX];
+  va_list args;
+
+  if (va != NULL) {
+    va_copy(args, *va);
+  } else {
+    va_start(args, va);
+  }
+
+  int len = logcie_vformat(line, sizeof(line), fmt, args);
+
+  va_end(args);
+
+  if (len <= 0) {
+    return 0;
+  }
+
+  Logcie_Segment segment = {line, (size_t)len < sizeof(line) ? (size_t)len : sizeof(line) - 1};
+  return logcie_flight_recorder_writev(user_data, &segment, 1);
+}
+
+size_t logcie_flight_recorder_writev(void *user_data, const Logcie_Segment *segments, size_t count) {
+  _LOGCIE_ASSERT(user_data, "Flight recorder writer needs Logcie_FlightRecorder");
+  uint64_t             number;
+  Logcie_FlightRecord *record = logcie_flight_recorder_begin((Logcie_FlightRecorder *)user_data, &number);
+  Logcie_Buffer        buffer = {record->line, 0, sizeof(record->line), 0};
+  size_t               len    = logcie_buffer_writev(&buffer, segments, count);
+  logcie_flight_recorder_end(record, number, LOGCIE_LEVEL_TRACE, &buffer);
+  return len;
+}
+
+size_t logcie_flight_recorder_dump(Logcie_FlightRecorder *recorder) {
+  uint32_t idle = 0;
+
+  // Weak CAS may fail spuriously, then `idle` stays 0
+  while (!_LOGCIE_ATOMIC_CAS(&recorder->dumping, &idle, 1)) {
+    if (idle != 0) {
+      return 0;
+    }
+  }
+
+  Logcie_Sink *target = recorder->target;
+  uint64_t     end    = _LOGCIE_ATOMIC_LOAD(&recorder->next);
+  uint64_t     number = recorder->dump_from;
+  size_t       dumped = 0;
+  char         line[LOGCIE_FLIGHT_RECORD_MAX];
+
+  if (end - number > LOGCIE_FLIGHT_RECORDS) {
+    number = end - LOGCIE_FLIGHT_RECORDS;
+  }
+
+  for (; target && number < end; number++) {
+    Logcie_FlightRecord *record   = &recorder->records[number % LOGCIE_FLIGHT_RECORDS];
+    uint64_t             sequence = _LOGCIE_ATOMIC_LOAD(&record->sequence);
+
+    if (sequence != 2 * number + 2) {
+      continue;
+    }
+
+    uint32_t level = record->level;
+    uint32_t len   = record->len < sizeof(line) ? record->len : (uint32_t)sizeof(line);
+    memcpy(line, record->line, len);
+    _LOGCIE_ATOMIC_FENCE();
+
+    if (_LOGCIE_ATOMIC_LOAD(&record->sequence) != sequence) {
+      continue;
+    }
+
+    dumped++;
+
+#ifdef _LOGCIE_THREADS
+    if (target->async) {
+      logcie_async_push(target->async, (Logcie_LogLevel)level, line, len, 0);
+      continue;
+    }
+#endif
+
+    (void)level;
+    Logcie_Segment segment = {line, len};
+    logcie_writer_writev(&target->writer, &segment, 1);
+  }
+
+  if (target && !target->async) {
+    logcie_writer_flush(&target->writer);
+  }
+
+  recorder->dump_from = end;
+  recorder->dumps++;
+  recorder->dumped += dumped;
+  _LOGCIE_ATOMIC_STORE(&recorder->dumping, 0);
+  return dumped;
+}
+
+Logcie_Sink logcie_flight_recorder_sink(Logcie_FlightRecorder *recorder) {
+  Logcie_Sink sink = {
+    .formatter = {logcie_flight_recorder_formatter, recorder},
+    .writer    = {logcie_flight_recorder_writer, recorder, logcie_flight_recorder_writev, NULL},
+    .filter    = {NULL, NULL},
+    .dedup     = NULL,
+    .async     = NULL,
+  };
+  return sink;
+}
+
+// Formats short internal message. It is rendered on stack, since per-thread buffer
+// still holds message of the log that is being dispatched
+static size_t logcie_sink_format(Logcie_Sink *sink, Logcie_Log log, const char *fmt, ...) {
+  char    message[128];
+  va_list args;
+  va_start(args, fmt);
+
+  va_list args_copy;
+  va_copy(args_copy, args);
+  int written = logcie_vformat(message, sizeof(message), fmt, args_copy);
+  va_end(args_copy);
+
+  log.msg         = fmt;
+  log.message     = message;
+  log.message_len = written < 0 ? 0 : ((size_t)written < sizeof(message) ? (size_t)written : sizeof(message) - 1);
+  log.args        = &args;
+
+#ifdef _LOGCIE_THREADS
+  if (sink->async) {
+    char          line[LOGCIE_LINE_MAX];
+    Logcie_Buffer buffer = {line, 0, sizeof(line), 0};
+    Logcie_Writer writer = {logcie_buffer_writer, &buffer, logcie_buffer_writev, NULL};
+    size_t        output = sink->formatter.format(&writer, sink->formatter.data, log, &args);
+    logcie_async_push(sink->async, log.level, line, buffer.len, buffer.overflow);
+
+    va_end(args);
+    return output;
+  }
+#endif
+
+  size_t output = sink->formatter.format(&sink->writer, sink->formatter.data, log, &args);
+
+  va_end(args);
+  return output;
+}
+
+static void logcie_dedup_summary(Logcie_Sink *sink, Logcie_DedupEntry *entry) {
+  Logcie_Log log = {
+    .level       = entry->level,
+    .msg         = NULL,
+    .time        = time(NULL),
+    .module      = entry->module,
+    .location    = entry->location,
+    .callsite    = NULL,
+    .message     = NULL,
+    .message_len = 0,
+    .args        = NULL,
+  };
+
+  logcie_sink_format(sink, log, "last message repeated %u times", entry->repeated);
+  entry->repeated = 0;
+}
+
+// Returns 1 if log is a duplicate and should not be formatted
+static uint8_t logcie_dedup_check(Logcie_Sink *sink, Logcie_Log *log, uint64_t hash) {
+  Logcie_Dedup *dedup = sink->dedup;
+  uint64_t      now   = logcie_now_ns();
+
+  size_t             slot  = dedup->window_ms ? hash % LOGCIE_DEDUP_SLOTS : 0;
+  Logcie_DedupEntry *entry = &dedup->entries[slot];
+
+  uint8_t in_window = dedup->window_ms == 0 || now - entry->since < (uint64_t)dedup->window_ms * 1000000ull;
+
+  if (entry->since != 0 && entry->hash == hash && in_window) {
+    entry->repeated++;
+
+    if (dedup->summary_every && entry->repeated >= dedup->summary_every) {
+      logcie_dedup_summary(sink, entry);
+    }
+
+    return 1;
+  }
+
+  if (entry->repeated > 0) {
+    logcie_dedup_summary(sink, entry);
+  }
+
+  *entry = (Logcie_DedupEntry){
+    .hash     = hash,
+    .since    = now ? now : 1,
+    .repeated = 0,
+    .level    = log->level,
+    .module   = log->module,
+    .location = log->location,
+  };
+
+  return 0;
+}
+
+void logcie_dedup_flush(Logcie_Sink *sink) {
+  if (sink == NULL || sink->dedup == NULL) {
+    return;
+  }
+
+  for (size_t i = 0; i < LOGCIE_DEDUP_SLOTS; i++) {
+    if (sink->dedup->entries[i].repeated > 0) {
+      logcie_dedup_summary(sink, &sink->dedup->entries[i]);
+    }
+  }
+}
+
+#ifndef LOGCIE_FORMAT_SPECS_MAX
+#define LOGCIE_FORMAT_SPECS_MAX 16
+#endif
+
+#ifndef LOGCIE_FORMAT_CACHE_SIZE
+#define LOGCIE_FORMAT_CACHE_SIZE 128
+#endif
+
+#define _LOGCIE_FORMAT_LEFT  1
+#define _LOGCIE_FORMAT_ZERO  2
+#define _LOGCIE_FORMAT_PLUS  4
+#define _LOGCIE_FORMAT_SPACE 8
+#define _LOGCIE_FORMAT_ALT   16
+
+// Width or precision that is passed as an argument ('*')
+#define _LOGCIE_FORMAT_FROM_ARG (-2)
+
+// One conversion specification of a format string. Length modifiers are
+// stored as single char: 'H' is "hh" and 'q' is "ll"
+typedef struct Logcie_FormatSpec {
+  uint16_t offset;
+  uint16_t end;
+  uint8_t  flags;
+  char     length;
+  char     conversion;
+  int16_t  width;
+  int16_t  precision;
+} Logcie_FormatSpec;
+
+// Parsed format string. `fallback` means that format has to be passed to vsnprintf as a whole
+typedef struct Logcie_FormatPlan {
+  uint8_t           fallback;
+  uint8_t           count;
+  Logcie_FormatSpec specs[LOGCIE_FORMAT_SPECS_MAX];
+} Logcie_FormatPlan;
+
+typedef struct Logcie_FormatOutput {
+  char  *data;
+  size_t size;
+  size_t len;
+} Logcie_FormatOutput;
+
+static const char logcie_digit_pairs[] =
+  "0001020304050607080910111213141516171819"
+  "2021222324252627282930313233343536373839"
+  "4041424344454647484950515253545556575859"
+  "6061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static int32_t logcie_format_number(const char **at) {
+  int32_t number = 0;
+
+  while (**at >= '0' && **at <= '9') {
+    number = number <= INT16_MAX ? number * 10 + (**at - '0') : number;
+    (*at)++;
+  }
+
+  return number;
+}
+
+static void logcie_format_parse(const char *fmt, Logcie_FormatPlan *plan) {
+  plan->fallback = 0;
+  plan->count    = 0;
+
+  for (const char *at = strchr(fmt, '%'); at != NULL; at = strchr(at, '%')) {
+    if (plan->count == LOGCIE_FORMAT_SPECS_MAX || at - fmt > UINT16_MAX - 64) {
+      plan->fallback = 1;
+      return;
+    }
+
+    Logcie_FormatSpec *spec = &plan->specs[plan->count];
+    spec->offset            = (uint16_t)(at - fmt);
+    spec->flags             = 0;
+    spec->width             = -1;
+    spec->precision         = -1;
+    spec->length            = 0;
+    at++;
+
+    for (const char *flag; *at && (flag = strchr("-0+ #", *at)) != NULL; at++) {
+      spec->flags |= (uint8_t)(1u << (flag - "-0+ #"));
+    }
+
+    if (*at == '*') {
+      spec->width = _LOGCIE_FORMAT_FROM_ARG;
+      at++;
+    } else if (*at >= '0' && *at <= '9') {
+      int32_t width = logcie_format_number(&at);
+
+      // Positional arguments ("%1$d") can't be formatted one by one
+      if (*at == '$' || width > INT16_MAX) {
+        plan->fallback = 1;
+        return;
+      }
+
+      spec->width = (int16_t)width;
+    }
+
+    if (*at == '.') {
+      at++;
+
+      if (*at == '*') {
+        spec->precision = _LOGCIE_FORMAT_FROM_ARG;
+        at++;
+      } else {
+        int32_t precision = logcie_format_number(&at);
+
+        if (precision > INT16_MAX) {
+          plan->fallback = 1;
+          return;
+        }
+
+        spec->precision = (int16_t)precision;
+      }
+    }
+
+    switch (*at) {
+      case 'h':
+        spec->length = at[1] == 'h' ? 'H' : 'h';
+        at += spec->length == 'H' ? 2 : 1;
+        break;
+      case 'l':
+        spec->length = at[1] == 'l' ? 'q' : 'l';
+        at += spec->length == 'q' ? 2 : 1;
+        break;
+      case 'j':
+      case 'z':
+      case 't':
+      case 'L':
+        spec->length = *at++;
+        break;
+    }
+
+    spec->conversion = *at;
+
+    if (*at == '\0' || !strchr("diouxXcspfFeEgGaA%", *at) || (spec->length == 'l' && (*at == 'c' || *at == 's'))) {
+      plan->fallback = 1;
+      return;
+    }
+
+    at++;
+    spec->end = (uint16_t)(at - fmt);
+    plan->count++;
+  }
+}
+
+static void logcie_format_put(Logcie_FormatOutput *output, const char *ptr, size_t len) {
+  if (output->len + 1 < output->size) {
+    size_t room = output->size - 1 - output->len;
+    memcpy(output->data + output->len, ptr, len < room ? len : room);
+  }
+
+  output->len += len;
+}
+
+static void logcie_format_fill(Logcie_FormatOutput *output, char c, size_t len) {
+  if (output->len + 1 < output->size) {
+    size_t room = output->size - 1 - output->len;
+    memset(output->data + output->len, c, len < room ? len : room);
+  }
+
+  output->len += len;
+}
+
+// Writes prefix (sign, "0x"), leading zeros and digits padded to width
+static void logcie_format_padded(Logcie_FormatOutput *output, uint8_t flags, int32_t width, const char *prefix, const char *digits, size_t digits_len, size_t zeros) {
+  size_t prefix_len = strlen(prefix);
+  size_t total      = prefix_len + zeros + digits_len;
+  size_t pad        = width > 0 && (size_t)width > total ? (size_t)width - total : 0;
+
+  if (!(flags & (_LOGCIE_FORMAT_LEFT | _LOGCIE_FORMAT_ZERO))) {
+    logcie_format_fill(output, ' ', pad);
+  }
+
+  logcie_format_put(output, prefix, prefix_len);
+  logcie_format_fill(output, '0', zeros + ((flags & _LOGCIE_FORMAT_ZERO) && !(flags & _LOGCIE_FORMAT_LEFT) ? pad : 0));
+  logcie_format_put(output, digits, digits_len);
+
+  if (flags & _LOGCIE_FORMAT_LEFT) {
+    logcie_format_fill(output, ' ', pad);
+  }
+}
+
+// Writes decimal digits ending at `end`, two digits per step. Returns number of digits
+static size_t logcie_format_decimal(char *end, uintmax_t value) {
+  char *at = end;
+
+  while (value >= 100) {
+    at -= 2;
+    memcpy(at, logcie_digit_pairs + (value % 100) * 2, 2);
+    value /= 100;
+  }
+
+  if (value >= 10) {
+    at -= 2;
+    memcpy(at, logcie_digit_pairs + value * 2, 2);
+  } else {
+    *--at = (char)('0' + value);
+  }
+
+  return (size_t)(end - at);
+}
+
+static size_t logcie_format_hex(char *end, uintmax_t value, const char *digits) {
+  char *at = end;
+
+  do {
+    *--at = digits[value & 15];
+    value >>= 4;
+  } while (value);
+
+  return (size_t)(end - at);
+}
+
+static intmax_t logcie_format_arg_signed(va_list *args, char length) {
+  switch (length) {
+    case 'H': return (signed char)va_arg(*args, int);
+    case 'h': return (short)va_arg(*args, int);
+    case 'l': return va_arg(*args, long);
+    case 'q': return va_arg(*args, long long);
+    case 'j': return va_arg(*args, intmax_t);
+    case 'z': return (intmax_t)(ptrdiff_t)va_arg(*args, size_t);
+    case 't': return va_arg(*args, ptrdiff_t);
+    default: return va_arg(*args, int);
+  }
+}
+
+static uintmax_t logcie_format_arg_unsigned(va_list *args, char length) {
+  switch (length) {
+    case 'H': return (unsigned char)va_arg(*args, unsigned int);
+    case 'h': return (unsigned short)va_arg(*args, unsigned int);
+    case 'l': return va_arg(*args, unsigned long);
+    case 'q': return va_arg(*args, unsigned long long);
+    case 'j': return va_arg(*args, uintmax_t);
+    case 'z': return va_arg(*args, size_t);
+    case 't': return (uintmax_t)(size_t)va_arg(*args, ptrdiff_t);
+    default: return va_arg(*args, unsigned int);
+  }
+}
+
+// Rebuilds specification with resolved width and precision for snprintf
+static void logcie_format_rebuild(char *spec_fmt, size_t size, uint8_t flags, int32_t width, int32_t precision, const char *length, char conversion) {
+  char flag_chars[6];
+  int  flags_len = 0;
+
+  for (int i = 0; i < 5; i++) {
+    if (flags & (1u << i)) {
+      flag_chars[flags_len++] = "-0+ #"[i];
+    }
+  }
+
+  flag_chars[flags_len] = '\0';
+
+  char width_str[16]     = "";
+  char precision_str[16] = "";
+
+  if (width >= 0) {
+    snprintf(width_str, sizeof(width_str), "%d", (int)width);
+  }
+
+  if (precision >= 0) {
+    snprintf(precision_str, sizeof(precision_str), ".%d", (int)precision);
+  }
+
+  snprintf(spec_fmt, size, "%%%s%s%s%s%c", flag_chars, width_str, precision_str, length, conversion);
+}
+
+#define _LOGCIE_FORMAT_SNPRINTF(output, spec_fmt, value)                                                       \
+  do {                                                                                                         \
+    size_t _pos = (output)->len;                                                                               \
+    int    _len = _pos + 1 < (output)->size ? snprintf((output)->data + _pos, (output)->size - _pos, spec_fmt, value) \
+                                            : snprintf(NULL, 0, spec_fmt, value);                              \
+    (output)->len += _len > 0 ? (size_t)_len : 0;                                                              \
+  } while (0)
+
+static const double logcie_powers_of_ten[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+
+// Fixed notation for doubles. Value is scaled by 10^precision and rounded to integer,
+// which is exact unless scaled value is too close to a rounding boundary (then 0 is returned)
+static uint8_t logcie_format_fixed(Logcie_FormatOutput *output, uint8_t flags, int32_t width, int32_t precision, double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  if (precision > 9 || (flags & _LOGCIE_FORMAT_ALT) || ((bits >> 52) & 0x7FF) == 0x7FF) {
+    return 0;
+  }
+
+  uint8_t negative  = (uint8_t)(bits >> 63);
+  double  magnitude = negative ? -value : value;
+  double  scaled    = magnitude * logcie_powers_of_ten[precision];
+
+  // Below 2^52 both integer and fractional parts are exact
+  if (scaled >= 4503599627370496.0) {
+    return 0;
+  }
+
+  uint64_t whole    = (uint64_t)scaled;
+  double   fraction = scaled - (double)whole;
+  double   distance = fraction > 0.5 ? fraction - 0.5 : 0.5 - fraction;
+
+  // Multiplication error is at most half ulp of scaled value
+  if (distance <= scaled * 5e-16) {
+    return 0;
+  }
+
+  whole += fraction > 0.5;
+
+  uint64_t unit = (uint64_t)logcie_powers_of_ten[precision];
+  char     digits[48];
+  char    *end = digits + sizeof(digits);
+  char    *at  = end;
+
+  if (precision > 0) {
+    uint64_t part = whole % unit;
+
+    for (int32_t i = 0; i < precision; i++) {
+      *--at = (char)('0' + part % 10);
+      part /= 10;
+    }
+
+    *--at = '.';
+  }
+
+  at -= logcie_format_decimal(at, whole / unit);
+
+  const char *sign = negative ? "-" : (flags & _LOGCIE_FORMAT_PLUS) ? "+" : (flags & _LOGCIE_FORMAT_SPACE) ? " " : "";
+  logcie_format_padded(output, flags, width, sign, at, (size_t)(end - at), 0);
+  return 1;
+}
+
+static void logcie_format_spec(Logcie_FormatOutput *output, const Logcie_FormatSpec *spec, va_list *args) {
+  uint8_t flags     = spec->flags;
+  int32_t width     = spec->width;
+  int32_t precision = spec->precision;
+
+  if (width == _LOGCIE_FORMAT_FROM_ARG) {
+    width = va_arg(*args, int);
+
+    if (width < 0) {
+      flags |= _LOGCIE_FORMAT_LEFT;
+      width = -width;
+    }
+  }
+
+  if (precision == _LOGCIE_FORMAT_FROM_ARG) {
+    precision = va_arg(*args, int);
+    precision = precision < 0 ? -1 : precision;
+  }
+
+  char spec_fmt[64];
+  char digits[64];
+  char length[2] = {spec->length == 'L' ? 'L' : '\0', '\0'};
+
+  switch (spec->conversion) {
+    case '%':
+      logcie_format_put(output, "%", 1);
+      return;
+    case 'd':
+    case 'i': {
+      intmax_t  value     = logcie_format_arg_signed(args, spec->length);
+      uintmax_t magnitude = value < 0 ? (uintmax_t)0 - (uintmax_t)value : (uintmax_t)value;
+      size_t    len       = precision == 0 && magnitude == 0 ? 0 : logcie_format_decimal(digits + sizeof(digits), magnitude);
+      size_t    zeros     = precision > 0 && (size_t)precision > len ? (size_t)precision - len : 0;
+
+      const char *sign = value < 0 ? "-" : (flags & _LOGCIE_FORMAT_PLUS) ? "+" : (flags & _LOGCIE_FORMAT_SPACE) ? " " : "";
+      flags            = precision >= 0 ? flags & ~_LOGCIE_FORMAT_ZERO : flags;
+      logcie_format_padded(output, flags, width, sign, digits + sizeof(digits) - len, len, zeros);
+      return;
+    }
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o': {
+      uintmax_t value = logcie_format_arg_unsigned(args, spec->length);
+
+      if (spec->conversion == 'o') {
+        logcie_format_rebuild(spec_fmt, sizeof(spec_fmt), flags, width, precision, "j", 'o');
+        _LOGCIE_FORMAT_SNPRINTF(output, spec_fmt, value);
+        return;
+      }
+
+      size_t len = 0;
+
+      if (precision != 0 || value != 0) {
+        len = spec->conversion == 'u'   ? logcie_format_decimal(digits + sizeof(digits), value)
+              : spec->conversion == 'x' ? logcie_format_hex(digits + sizeof(digits), value, "0123456789abcdef")
+                                        : logcie_format_hex(digits + sizeof(digits), value, "0123456789ABCDEF");
+      }
+
+      size_t      zeros  = precision > 0 && (size_t)precision > len ? (size_t)precision - len : 0;
+      const char *prefix = (flags & _LOGCIE_FORMAT_ALT) && value != 0 && spec->conversion != 'u' ? (spec->conversion == 'x' ? "0x" : "0X") : "";
+      flags              = precision >= 0 ? flags & ~_LOGCIE_FORMAT_ZERO : flags;
+      logcie_format_padded(output, flags, width, prefix, digits + sizeof(digits) - len, len, zeros);
+      return;
+    }
+    case 'c': {
+      char c = (char)va_arg(*args, int);
+
+      if (flags & _LOGCIE_FORMAT_ZERO) {
+        logcie_format_rebuild(spec_fmt, sizeof(spec_fmt), flags, width, precision, "", 'c');
+        _LOGCIE_FORMAT_SNPRINTF(output, spec_fmt, c);
+        return;
+      }
+
+      logcie_format_padded(output, flags, width, "", &c, 1, 0);
+      return;
+    }
+    case 's': {
+      const char *str = va_arg(*args, const char *);
+
+      if (str == NULL || (flags & _LOGCIE_FORMAT_ZERO)) {
+        logcie_format_rebuild(spec_fmt, sizeof(spec_fmt), flags, width, precision, "", 's');
+        _LOGCIE_FORMAT_SNPRINTF(output, spec_fmt, str);
+        return;
+      }
+
+      size_t len = 0;
+
+      if (precision >= 0) {
+        while (len < (size_t)precision && str[len]) {
+          len++;
+        }
+      } else {
+        len = strlen(str);
+      }
+
+      logcie_format_padded(output, flags, width, "", str, len, 0);
+      return;
+    }
+    case 'p': {
+      void *ptr = va_arg(*args, void *);
+
+      if (ptr == NULL || flags || precision >= 0) {
+        logcie_format_rebuild(spec_fmt, sizeof(spec_fmt), flags, width, precision, "", 'p');
+        _LOGCIE_FORMAT_SNPRINTF(output, spec_fmt, ptr);
+        return;
+      }
+
+      size_t len = logcie_format_hex(digits + sizeof(digits), (uintmax_t)(uintptr_t)ptr, "0123456789abcdef");
+      logcie_format_padded(output, flags, width, "0x", digits + sizeof(digits) - len, len, 0);
+      return;
+    }
+    default: {
+      if (spec->length == 'L') {
+        long double value = va_arg(*args, long double);
+        logcie_format_rebuild(spec_fmt, sizeof(spec_fmt), flags, width, precision, length, spec->conversion);
+        _LOGCIE_FORMAT_SNPRINTF(output, spec_fmt, value);
+        return;
+      }
+
+      double value = va_arg(*args, double);
+
+      if ((spec->conversion == 'f' || spec->conversion == 'F') && logcie_format_fixed(output, flags, width, precision < 0 ? 6 : precision, value)) {
+        return;
+      }
+
+      logcie_format_rebuild(spec_fmt, sizeof(spec_fmt), flags, width, precision, "", spec->conversion);
+      _LOGCIE_FORMAT_SNPRINTF(output, spec_fmt, value);
+      return;
+    }
+  }
+}
+
+static int logcie_format_plan(char *buffer, size_t size, const char *fmt, const Logcie_FormatPlan *plan, va_list args) {
+  if (plan->fallback) {
+    return vsnprintf(buffer, size, fmt, args);
+  }
+
+  Logcie_FormatOutput output = {buffer, size, 0};
+  size_t              done   = 0;
+
+  va_list args_copy;
+  va_copy(args_copy, args);
+
+  for (uint8_t i = 0; i < plan->count; i++) {
+    logcie_format_put(&output, fmt + done, plan->specs[i].offset - done);
+    logcie_format_spec(&output, &plan->specs[i], &args_copy);
+    done = plan->specs[i].end;
+  }
+
+  va_end(args_copy);
+
+  logcie_format_put(&output, fmt + done, strlen(fmt + done));
+
+  if (size > 0) {
+    buffer[output.len < size ? output.len : size - 1] = '\0';
+  }
+
+  return output.len > INT32_MAX ? -1 : (int)output.len;
+}
+
+// Format of a call site is a string literal, so it is parsed once and the plan is
+// remembered in call site cache. Plans live in a fixed pool and are never freed:
+// once pool is exhausted, formats of new call sites are parsed on every call.
+// Lookup is a single atomic load, plan is fully written before it is published
+static const Logcie_FormatPlan *logcie_callsite_format(const Logcie_CallSite *site) {
+  static Logcie_FormatPlan pool[LOGCIE_FORMAT_CACHE_SIZE];
+  static uint32_t          pool_used;
+
+  const Logcie_FormatPlan *plan = _LOGCIE_ATOMIC_LOAD(&site->cache->format);
+
+  if (plan != NULL || _LOGCIE_ATOMIC_LOAD(&pool_used) >= LOGCIE_FORMAT_CACHE_SIZE) {
+    return plan;
+  }
+
+  uint32_t index = _LOGCIE_ATOMIC_ADD(&pool_used, 1) - 1;
+
+  if (index >= LOGCIE_FORMAT_CACHE_SIZE) {
+    return NULL;
+  }
+
+  // If two threads get here for one call site, both plans are the same and one slot is wasted
+  logcie_format_parse(site->fmt, &pool[index]);
+  _LOGCIE_ATOMIC_STORE(&site->cache->format, &pool[index]);
+  return &pool[index];
+}
+
+int logcie_vformat(char *buffer, size_t size, const char *fmt, va_list args) {
+  Logcie_FormatPlan plan;
+  logcie_format_parse(fmt, &plan);
+  return logcie_format_plan(buffer, size, fmt, &plan, args);
+}
+
+int logcie_format(char *buffer, size_t size, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int len = logcie_vformat(buffer, size, fmt, args);
+  va_end(args);
+  return len;
+}
+
+const char *logcie_log_message(Logcie_Log *log, size_t *len) {
+  static _LOGCIE_THREAD_LOCAL char buffer[LOGCIE_MESSAGE_MAX];
+
+  if (log->message == NULL) {
+    if (log->args == NULL) {
+      // Log was not created by logcie_log, so there is nothing to expand
+      log->message     = log->msg ? log->msg : "";
+      log->message_len = strlen(log->message);
+    } else {
+      va_list args;
+      va_copy(args, *log->args);
+      // Format known at compile time has a cached plan
+      const Logcie_FormatPlan *plan = NULL;
+
+      if (log->callsite && log->callsite->fmt && log->callsite->fmt == log->msg) {
+        plan = logcie_callsite_format(log->callsite);
+      }
+
+      int written = plan ? logcie_format_plan(buffer, sizeof(buffer), log->msg, plan, args) : logcie_vformat(buffer, sizeof(buffer), log->msg, args);
+      va_end(args);
+
+      if (written < 0) {
+        buffer[0] = '\0';
+        written   = 0;
+      }
+
+      log->message     = buffer;
+      log->message_len = (size_t)written < sizeof(buffer) ? (size_t)written : sizeof(buffer) - 1;
+    }
+  }
+
+  if (len) {
+    *len = log->message_len;
+  }
+
+  return log->message;
+}
+
+// Rendered message, or for messages cut by LOGCIE_MESSAGE_MAX the format expanded
+// again into `buffer`, as `$m` does. For formatters whose output takes longer messages
+static const char *logcie_log_message_long(Logcie_Log *log, va_list *args, char *buffer, size_t size, size_t *len) {
+  const char *message = logcie_log_message(log, len);
+
+  if (*len < LOGCIE_MESSAGE_MAX - 1 || args == NULL || log->msg == NULL || size <= LOGCIE_MESSAGE_MAX) {
+    return message;
+  }
+
+  va_list args_copy;
+  va_copy(args_copy, *args);
+  int written = logcie_vformat(buffer, size, log->msg, args_copy);
+  va_end(args_copy);
+
+  if (written < 0) {
+    return message;
+  }
+
+  *len = (size_t)written < size ? (size_t)written : size - 1;
+  return buffer;
+}
+
+// Hash of call site and rendered message
+static uint64_t logcie_log_hash(Logcie_Log *log) {
+  uint64_t hash = _LOGCIE_HASH_INIT;
+
+  if (log->callsite) {
+    hash = logcie_hash_bytes(hash, &log->callsite, sizeof(log->callsite));
+  } else {
+    hash = logcie_hash_bytes(hash, &log->location.file, sizeof(log->location.file));
+    hash = logcie_hash_bytes(hash, &log->location.line, sizeof(log->location.line));
+  }
+
+  size_t      len;
+  const char *message = logcie_log_message(log, &len);
+  return logcie_hash_bytes(hash, message, len);
+}
+
+#ifdef LOGCIE_STATIC_SINKS
+// Every static sink expands to its own block with direct calls, so the compiler
+// can inline filter, formatter and (through constant writer) writer
+#define _LOGCIE_STATIC_SINK_DISPATCH(filter_fn, filter_data, format_fn, format_data, write_fn, writev_fn, write_data) \
+  if (filter_fn((void *)(filter_data), log)) {                                                                  \
+    Logcie_Writer writer = {write_fn, (void *)(write_data), writev_fn, NULL};                                   \
+    va_list       args_copy;                                                                                    \
+    logcie_log_message(log, NULL);                                                                              \
+    va_copy(args_copy, *args);                                                                                  \
+    format_fn(&writer, (void *)(format_data), *log, &args_copy);                                                \
+    va_end(args_copy);                                                                                          \
+  }
+
+static void logcie_static_dispatch(Logcie_Log *log, va_list *args) {
+  LOGCIE_STATIC_SINKS(_LOGCIE_STATIC_SINK_DISPATCH)
+}
+
+// Entries have no flush function, but printf writer is known to buffer in FILE*
+#define _LOGCIE_STATIC_SINK_FLUSH(filter_fn, filter_data, format_fn, format_data, write_fn, writev_fn, write_data) \
+  if ((Logcie_WriterFn *)(write_fn) == logcie_printf_writer) {                                                 \
+    logcie_printf_flush((void *)(write_data));                                                                  \
+  }
+
+static void logcie_static_flush(void) {
+  LOGCIE_STATIC_SINKS(_LOGCIE_STATIC_SINK_FLUSH)
+}
+#endif
+
+// Held logs of a thread: Logcie_Log followed by its rendered message, one after another
+typedef struct Logcie_Scope {
+  char           *buffer;
+  size_t          len;
+  int             index;
+  uint32_t        depth;
+  Logcie_LogLevel level;
+  uint8_t         failed;
+  uint8_t         emitting;
+  size_t          emitted;
+  uint32_t        dropped;
+  Logcie_Log      dropped_log;
+} Logcie_Scope;
+
+static char                             logcie_scope_pool[LOGCIE_SCOPE_BUFFERS][LOGCIE_SCOPE_BUFFER];
+static uint64_t                         logcie_scope_used = 0;
+static _LOGCIE_THREAD_LOCAL Logcie_Scope logcie_scope;
+
+#if LOGCIE_SCOPE_BUFFERS > 64
+#error "LOGCIE_SCOPE_BUFFERS can't be above 64: buffers are tracked in a 64-bit mask"
+#endif
+
+// Takes free buffer from the pool, -1 if there is none
+static int logcie_scope_acquire(void) {
+  uint64_t used = _LOGCIE_ATOMIC_LOAD(&logcie_scope_used);
+
+  for (;;) {
+    int index = 0;
+
+    while (index < LOGCIE_SCOPE_BUFFERS && ((used >> index) & 1)) {
+      index++;
+    }
+
+    if (index == LOGCIE_SCOPE_BUFFERS) {
+      return -1;
+    }
+
+    if (_LOGCIE_ATOMIC_CAS(&logcie_scope_used, &used, used | 1ull << index)) {
+      return index;
+    }
+  }
+}
+
+static void logcie_scope_release(int index) {
+  uint64_t used = _LOGCIE_ATOMIC_LOAD(&logcie_scope_used);
+
+  while (!_LOGCIE_ATOMIC_CAS(&logcie_scope_used, &used, used & ~(1ull << index))) {
+  }
+}
+
+static void logcie_scope_emit(Logcie_Scope *scope) {
+  size_t at = 0;
+
+  // Emitted logs go to sinks, not back to the buffer
+  scope->emitting = 1;
+
+  while (at < scope->len) {
+    Logcie_Log log;
+    memcpy(&log, scope->buffer + at, sizeof(log));
+    at += sizeof(log);
+    logcie_log_rendered(log, scope->buffer + at, log.message_len);
+    at += log.message_len;
+    scope->emitted++;
+  }
+
+  if (scope->dropped) {
+    char message[64];
+    int  len = logcie_format(message, sizeof(message), "%u logs of the scope were dropped", scope->dropped);
+    logcie_log_rendered(scope->dropped_log, message, (size_t)len);
+    scope->dropped = 0;
+  }
+
+  scope->emitting = 0;
+  scope->len      = 0;
+}
+
+// Returns 1 if log is held by scope of the thread
+static uint8_t logcie_scope_hold(Logcie_Scope *scope, Logcie_Log *log) {
+  if (scope->failed || scope->emitting || scope->buffer == NULL) {
+    return 0;
+  }
+
+  if (log->level >= LOGCIE_LEVEL_ERROR) {
+    scope->failed = 1;
+    logcie_scope_emit(scope);
+    return 0;
+  }
+
+  if (log->level >= scope->level) {
+    return 0;
+  }
+
+  size_t      len;
+  const char *message = logcie_log_message(log, &len);
+
+  if (LOGCIE_SCOPE_BUFFER - scope->len < sizeof(*log) + len) {
+    scope->dropped++;
+    scope->dropped_log = *log;
+    return 1;
+  }
+
+  memcpy(scope->buffer + scope->len, log, sizeof(*log));
+  memcpy(scope->buffer + scope->len + sizeof(*log), message, len);
+  scope->len += sizeof(*log) + len;
+  return 1;
+}
+
+void logcie_scope_begin(Logcie_LogLevel level) {
+  Logcie_Scope *scope = &logcie_scope;
+
+  if (scope->depth++ > 0) {
+    return;
+  }
+
+  scope->index   = logcie_scope_acquire();
+  scope->buffer  = scope->index < 0 ? NULL : logcie_scope_pool[scope->index];
+  scope->len     = 0;
+  scope->level   = level;
+  scope->failed  = 0;
+  scope->emitted = 0;
+  scope->dropped = 0;
+}
+
+size_t logcie_scope_end(uint8_t success) {
+  Logcie_Scope *scope = &logcie_scope;
+
+  if (scope->depth == 0) {
+    return 0;
+  }
+
+  if (!success && !scope->failed) {
+    scope->failed = 1;
+    logcie_scope_emit(scope);
+  }
+
+  if (--scope->depth > 0) {
+    return 0;
+  }
+
+  if (scope->buffer) {
+    logcie_scope_release(scope->index);
+    scope->buffer = NULL;
+  }
+
+  return scope->emitted;
+}
+
+static void logcie_dispatch(Logcie_Log *log, va_list *args) {
+  static _LOGCIE_THREAD_LOCAL char line[LOGCIE_LINE_MAX];
+
+  if (logcie_scope.depth && logcie_scope_hold(&logcie_scope, log)) {
+    return;
+  }
+
+  uint64_t hash     = 0;
+  uint8_t  has_hash = 0;
+
+#ifdef LOGCIE_STATIC_SINKS
+  logcie_static_dispatch(log, args);
+#endif
+
+  // Sinks are processed in blocks of 64, so set of sinks that accepted the log fits in a mask
+  for (size_t block = 0; block < logcie_logger.sinks_len; block += 64) {
+    Logcie_Sink **sinks   = logcie_logger.sinks + block;
+    size_t        count   = logcie_logger.sinks_len - block < 64 ? logcie_logger.sinks_len - block : 64;
+    uint64_t      pending = 0;
+
+    for (size_t i = 0; i < count; i++) {
+      Logcie_Sink *sink = sinks[i];
+      _LOGCIE_ASSERT(sink && sink->formatter.format, "Sink have no formatter");
+
+      if (sink->filter.filter && !sink->filter.filter(sink->filter.data, log)) {
+        continue;
+      }
+
+      if (sink->dedup) {
+        if (!has_hash) {
+          hash     = logcie_log_hash(log);
+          has_hash = 1;
+        }
+
+        if (logcie_dedup_check(sink, log, hash)) {
+          continue;
+        }
+      }
+
+      pending |= 1ull << i;
+    }
+
+    if (pending == 0) {
+      continue;
+    }
+
+    // Render message before log is copied to formatter, so every sink reuses it
+    logcie_log_message(log, NULL);
+
+    for (size_t i = 0; i < count; i++) {
+      if (!((pending >> i) & 1)) {
+        continue;
+      }
+
+      Logcie_Sink *sink = sinks[i];
+      uint64_t     same = 1ull << i;
+
+      // Sinks with the same formatter produce the same line, so it is formatted once
+      for (size_t j = i + 1; j < count; j++) {
+        if (((pending >> j) & 1) && sinks[j]->formatter.format == sink->formatter.format && sinks[j]->formatter.data == sink->formatter.data) {
+          same |= 1ull << j;
+        }
+      }
+
+      pending &= ~same;
+
+      Logcie_Buffer buffer = {line, 0, sizeof(line), 0};
+      Logcie_Writer writer = {logcie_buffer_writer, &buffer, logcie_buffer_writev, NULL};
+
+      va_list args_copy;
+
+      if (same != 1ull << i) {
+        va_copy(args_copy, *args);
+        sink->formatter.format(&writer, sink->formatter.data, *log, &args_copy);
+        va_end(args_copy);
+      }
+
+      for (size_t j = i; j < count; j++) {
+        if (!((same >> j) & 1)) {
+          continue;
+        }
+
+#ifdef _LOGCIE_THREADS
+        // Async sink gets formatted line, its writer is called by worker
+        if (sinks[j]->async) {
+          if (same == 1ull << i) {
+            va_copy(args_copy, *args);
+            sink->formatter.format(&writer, sink->formatter.data, *log, &args_copy);
+            va_end(args_copy);
+          }
+
+          // Line longer than the buffer is cut, as the queue can't take it anyway
+          logcie_async_push(sinks[j]->async, log->level, buffer.data, buffer.len, buffer.overflow);
+          continue;
+        }
+#endif
+
+        if (same != 1ull << i && !buffer.overflow) {
+          Logcie_Segment segment = {buffer.data, buffer.len};
+          logcie_writer_writev(&sinks[j]->writer, &segment, 1);
+          continue;
+        }
+
+        va_copy(args_copy, *args);
+        sinks[j]->formatter.format(&sinks[j]->writer, sinks[j]->formatter.data, *log, &args_copy);
+        va_end(args_copy);
+      }
+    }
+  }
+
+  // Process may end right after fatal log, so nothing is left in memory
+  if (log->level == LOGCIE_LEVEL_FATAL) {
+    logcie_flush();
+  }
+}
+
+size_t logcie_log(Logcie_Log log, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+
+  log.msg         = fmt;
+  log.message     = NULL;
+  log.message_len = 0;
+  log.args        = &args;
+  logcie_dispatch(&log, &args);
+
+  va_end(args);
+  return 0;
+}
+
+size_t logcie_log_callsite(const Logcie_CallSite *site, const char *module, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+
+  Logcie_Log log = {
+    .level       = site->level,
+    .msg         = fmt,
+    .time        = time(NULL),
+    .module      = module,
+    .location    = {site->file, site->line},
+    .callsite    = site,
+    .message     = NULL,
+    .message_len = 0,
+    .args        = &args,
+  };
+
+  logcie_dispatch(&log, &args);
+
+  va_end(args);
+  return 0;
+}
+
+static size_t logcie_log_rendered_va(Logcie_Log *log, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+
+  log->msg  = fmt;
+  log->args = &args;
+  logcie_dispatch(log, &args);
+
+  va_end(args);
+  return 0;
+}
+
+size_t logcie_log_rendered(Logcie_Log log, const char *message, size_t len) {
+  // Keeps `msg` and `args` meaningful for formatters that don't use `message`
+  log.message     = message;
+  log.message_len = len;
+  return logcie_log_rendered_va(&log, "%.*s", (int)len, message);
+}
+
+// Segments of a log that are collected by formatter and written at once. Numbers
+// are printed in scratch memory, everything else points to original strings
+typedef struct Logcie_SegmentList {
+  Logcie_Writer *writer;
+  Logcie_Segment segments[LOGCIE_SEGMENTS_MAX];
+  size_t         count;
+  size_t         written;
+  char           scratch[128];
+  size_t         scratch_len;
+} Logcie_SegmentList;
+
+static void logcie_segments_flush(Logcie_SegmentList *list) {
+  if (list->count) {
+    list->written += logcie_writer_writev(list->writer, list->segments, list->count);
+  }
+
+  list->count       = 0;
+  list->scratch_len = 0;
+}
+
+static size_t logcie_segments_push(Logcie_SegmentList *list, const char *ptr, size_t len) {
+  if (len == 0) {
+    return 0;
+  }
+
+  if (list->count == LOGCIE_SEGMENTS_MAX) {
+    logcie_segments_flush(list);
+  }
+
+  list->segments[list->count++] = (Logcie_Segment){ptr, len};
+  return len;
+}
+
+static size_t logcie_segments_printf(Logcie_SegmentList *list, const char *fmt, ...) PRINTF_TYPECHECK(2, 3);
+
+static size_t logcie_segments_printf(Logcie_SegmentList *list, const char *fmt, ...) {
+  if (sizeof(list->scratch) - list->scratch_len < 32) {
+    logcie_segments_flush(list);
+  }
+
+  char   *at        = list->scratch + list->scratch_len;
+  size_t  available = sizeof(list->scratch) - list->scratch_len;
+  va_list args;
+  va_start(args, fmt);
+  int written = logcie_vformat(at, available, fmt, args);
+  va_end(args);
+
+  if (written < 0) {
+    return 0;
+  }
+
+  size_t len = (size_t)written < available ? (size_t)written : available - 1;
+  list->scratch_len += len;
+  return logcie_segments_push(list, at, len);
+}
+
+// Date and time strings are cached per thread, since logs usually come many per second
+typedef struct Logcie_TimeCache {
+  time_t  time;
+  uint8_t valid;
+  char    date[48];
+  char    clock[48];
+  char    zone[16];
+} Logcie_TimeCache;
+
+// localtime_r and gmtime_r are hidden by strict ISO C modes of glibc, the declarations are repeated here
+#if defined(__GLIBC__) && defined(__STRICT_ANSI__) && !defined(__cplusplus)
+extern struct tm *localtime_r(const time_t *time, struct tm *result);
+extern struct tm *gmtime_r(const time_t *time, struct tm *result);
+#endif
+
+// Reentrant versions are used where they exist: glibc localtime() and mktime()
+// re-read timezone and strdup() it on every call when TZ is not set
+static void logcie_utc_time(time_t time, struct tm *utc_tm) {
+#if defined(__unix__) || defined(__APPLE__)
+  gmtime_r(&time, utc_tm);
+#elif defined(_MSC_VER)
+  gmtime_s(utc_tm, &time);
+#else
+  *utc_tm = *gmtime(&time);
+#endif
+}
+
+static void logcie_split_time(time_t time, struct tm *local_tm, struct tm *utc_tm) {
+#if defined(__unix__) || defined(__APPLE__)
+  localtime_r(&time, local_tm);
+#elif defined(_MSC_VER)
+  localtime_s(local_tm, &time);
+#else
+  *local_tm = *localtime(&time);
+#endif
+  logcie_utc_time(time, utc_tm);
+}
+
+static const Logcie_TimeCache *logcie_time_strings(time_t time) {
+  static _LOGCIE_THREAD_LOCAL Logcie_TimeCache cache;
+
+  if (cache.valid && cache.time == time) {
+    return &cache;
+  }
+
+  struct tm local_tm;
+  struct tm utc_tm;
+  logcie_split_time(time, &local_tm, &utc_tm);
+
+  // Offset from broken down times, mktime() would reload timezone
+  int32_t days        = local_tm.tm_year != utc_tm.tm_year ? (local_tm.tm_year > utc_tm.tm_year ? 1 : -1) : local_tm.tm_yday - utc_tm.tm_yday;
+  int32_t local_hours = local_tm.tm_hour;
+  int32_t timediff    = (days * 86400 + (local_tm.tm_hour - utc_tm.tm_hour) * 3600 + (local_tm.tm_min - utc_tm.tm_min) * 60) / 3600;
+
+  snprintf(cache.date, sizeof(cache.date), "%d-%02d-%02d", local_tm.tm_year + 1900, local_tm.tm_mon + 1, local_tm.tm_mday);
+  snprintf(cache.clock, sizeof(cache.clock), "%02d:%02d:%02d", local_hours, local_tm.tm_min, local_tm.tm_sec);
+  snprintf(cache.zone, sizeof(cache.zone), "%+d", timediff);
+
+  cache.time  = time;
+  cache.valid = 1;
+  return &cache;
+}
+
+const char *logcie_token_string(const Logcie_Log *log, char token) {
+  switch (token) {
+    case '$':
+      return "$";
+    case 'l':
+      return get_logcie_level_label(log->level);
+    case 'L':
+      return get_logcie_level_label_upper(log->level);
+    case 'c':
+      return get_logcie_level_color(log->level);
+    case 'r':
+      return LOGCIE_COLOR_RESET;
+    case 'd':
+      return logcie_time_strings(log->time)->date;
+    case 't':
+      return logcie_time_strings(log->time)->clock;
+    case 'z':
+      return logcie_time_strings(log->time)->zone;
+    case 'f':
+      return log->location.file;
+    case 'M':
+      return log->module ? log->module : default_module;
+    default:
+      return NULL;
+  }
+}
+
+size_t logcie_printf_formatter(Logcie_Writer *writer, void *data, Logcie_Log log, va_list *args) {
+  const char *fmt = (const char *)data;
+  _LOGCIE_ASSERT(writer, "Sink have no writer");
+  _LOGCIE_ASSERT(writer->data, "printf sink have nowhere to print");
+
+  static const char spaces[] = "                                ";
+
+  Logcie_SegmentList list;
+  list.writer      = writer;
+  list.count       = 0;
+  list.written     = 0;
+  list.scratch_len = 0;
+
+  size_t last_len = 0;
+
+  while (*fmt != '\0') {
+    if (*fmt != '$') {
+      const char *literal = fmt;
+
+      while (*fmt != '\0' && *fmt != '$') {
+        fmt++;
+      }
+
+      logcie_segments_push(&list, literal, (size_t)(fmt - literal));
+      continue;
+    }
+
+    fmt++;
+
+    if (*fmt == '\0') {
+      break;
+    }
+
+    switch (*fmt) {
+      case 'm': {
+        size_t      len;
+        const char *message = logcie_log_message(&log, &len);
+
+        // Message could be truncated by LOGCIE_MESSAGE_MAX, then it has to be expanded again
+        if (len >= LOGCIE_MESSAGE_MAX - 1 && args) {
+          logcie_segments_flush(&list);
+          last_len = writer->write(writer->data, log.msg, args);
+          list.written += last_len;
+        } else {
+          last_len = logcie_segments_push(&list, message, len);
+        }
+
+        break;
+      }
+      case 'x':
+        last_len = logcie_segments_printf(&list, "%u", log.location.line);
+        break;
+      case '<': {
+        fmt++;
+        uint16_t target = 0;
+
+        while (*fmt >= '0' && *fmt <= '9') {
+          target = target * 10 + (*fmt - '0');
+          fmt++;
+        }
+
+        int16_t pad = target - last_len - 1;
+
+        if (pad > 0) {
+          last_len = 0;
+
+          while (pad > 0) {
+            size_t chunk = (size_t)pad < sizeof(spaces) - 1 ? (size_t)pad : sizeof(spaces) - 1;
+            last_len += logcie_segments_push(&list, spaces, chunk);
+            pad -= (int16_t)chunk;
+          }
+        }
+
+        fmt--;
+        break;
+      }
+      default: {
+        const char *text = logcie_token_string(&log, *fmt);
+
+        if (text == NULL) {
+          fprintf(stderr, "%sWARN: unknown format sequence '$%c'. Skipping...\n" LOGCIE_COLOR_RESET, get_logcie_level_color(LOGCIE_LEVEL_WARN), *fmt);
+          break;
+        }
+
+        last_len = logcie_segments_push(&list, text, strlen(text));
+        break;
+      }
+    }
+
+    fmt++;
+  }
+
+  logcie_segments_push(&list, "\n", 1);
+  logcie_segments_flush(&list);
+  return list.written;
+}
+
+LOGCIE_DEF size_t logcie_printf_writer(void *user_data, const char *fmt, va_list *va, ...) {
+  _LOGCIE_ASSERT(user_data, "Printf writer have nothing to write to");
+  FILE   *file = (FILE *)user_data;
+  va_list args;
+
+  if (va != NULL) {
+    va_copy(args, *va);
+  } else {
+    va_start(args, va);
+  }
+
+  size_t written = 0;
+
+  if (strchr(fmt, '%') == NULL) {
+    written = fwrite(fmt, 1, strlen(fmt), file);
+  } else {
+    char    line[LOGCIE_LINE_MAX];
+    va_list args_copy;
+    va_copy(args_copy, args);
+    int len = logcie_vformat(line, sizeof(line), fmt, args_copy);
+    va_end(args_copy);
+
+    // Output that doesn't fit is left to stdio
+    if (len >= 0 && (size_t)len < sizeof(line)) {
+      written = fwrite(line, 1, (size_t)len, file);
+    } else {
+      written = vfprintf(file, fmt, args);
+    }
+  }
+
+  va_end(args);
+  return written;
+}
+
+LOGCIE_DEF size_t logcie_printf_writev(void *user_data, const Logcie_Segment *segments, size_t count) {
+  _LOGCIE_ASSERT(user_data, "Printf writer have nothing to write to");
+  FILE  *file    = (FILE *)user_data;
+  size_t written = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    written += fwrite(segments[i].ptr, 1, segments[i].len, file);
+  }
+
+  return written;
+}
+
+LOGCIE_DEF void logcie_printf_flush(void *user_data) {
+  fflush(user_data ? (FILE *)user_data : stdout);
+}
+
+LOGCIE_DEF size_t logcie_writer_writev(Logcie_Writer *writer, const Logcie_Segment *segments, size_t count) {
+  _LOGCIE_ASSERT(writer && writer->write, "Writer have no write function");
+
+  if (writer->writev) {
+    return writer->writev(writer->data, segments, count);
+  }
+
+  size_t written = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    written += writer->write(writer->data, "%.*s", NULL, (int)segments[i].len, segments[i].ptr);
+  }
+
+  return written;
+}
+
+LOGCIE_DEF void logcie_writer_flush(Logcie_Writer *writer) {
+  if (writer->flush) {
+    writer->flush(writer->data);
+  }
+}
+
+void logcie_flush(void) {
+#ifdef LOGCIE_STATIC_SINKS
+  logcie_static_flush();
+#endif
+
+  for (size_t i = 0; i < logcie_logger.sinks_len; i++) {
+    Logcie_Sink *sink = logcie_logger.sinks[i];
+
+#ifdef _LOGCIE_THREADS
+    // Worker flushes writer itself, so writer is never used by two threads
+    if (sink->async) {
+      logcie_async_flush(sink->async);
+      continue;
+    }
+#endif
+
+    logcie_writer_flush(&sink->writer);
+  }
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+LOGCIE_DEF size_t logcie_fd_writer(void *user_data, const char *fmt, va_list *va, ...) {
+  char    line[LOGCIE_LINE_MAX];
+  va_list args;
+
+  if (va != NULL) {
+    va_copy(args, *va);
+  } else {
+    va_start(args, va);
+  }
+
+  int len = logcie_vformat(line, sizeof(line), fmt, args);
+
+  va_end(args);
+
+  if (len <= 0) {
+    return 0;
+  }
+
+  Logcie_Segment segment = {line, (size_t)len < sizeof(line) ? (size_t)len : sizeof(line) - 1};
+  return logcie_fd_writev(user_data, &segment, 1);
+}
+
+LOGCIE_DEF size_t logcie_fd_writev(void *user_data, const Logcie_Segment *segments, size_t count) {
+  int          fd = (int)(intptr_t)user_data;
+  struct iovec iov[LOGCIE_SEGMENTS_MAX];
+  size_t       written = 0;
+
+  while (count > 0) {
+    size_t batch = count < LOGCIE_SEGMENTS_MAX ? count : LOGCIE_SEGMENTS_MAX;
+
+    for (size_t i = 0; i < batch; i++) {
+      iov[i].iov_base = (void *)segments[i].ptr;
+      iov[i].iov_len  = segments[i].len;
+    }
+
+    struct iovec *at   = iov;
+    size_t        left = batch;
+
+    // Short writes are continued from where they stopped
+    while (left > 0) {
+      ssize_t result = writev(fd, at, (int)left);
+
+      if (result < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+
+        return written;
+      }
+
+      written += (size_t)result;
+
+      while (left > 0 && (size_t)result >= at->iov_len) {
+        result -= (ssize_t)at->iov_len;
+        at++;
+        left--;
+      }
+
+      if (left > 0) {
+        at->iov_base = (char *)at->iov_base + result;
+        at->iov_len -= (size_t)result;
+      }
+    }
+
+    segments += batch;
+    count -= batch;
+  }
+
+  return written;
+}
+
+// sendmmsg and struct mmsghdr are declared only with _GNU_SOURCE. On glibc without
+// it the declaration is repeated here with the same signature
+#if defined(__linux__) && (defined(_GNU_SOURCE) || defined(__GLIBC__))
+#define _LOGCIE_SENDMMSG
+#ifdef _GNU_SOURCE
+typedef struct mmsghdr Logcie_MMsgHdr;
+#else
+struct mmsghdr;
+extern int sendmmsg(int fd, struct mmsghdr *messages, unsigned int count, int flags);
+
+typedef struct Logcie_MMsgHdr {
+  struct msghdr msg_hdr;
+  unsigned int  msg_len;
+} Logcie_MMsgHdr;
+#endif
+#endif
+
+#ifdef MSG_DONTWAIT
+#define _LOGCIE_MSG_DONTWAIT MSG_DONTWAIT
+#else
+#define _LOGCIE_MSG_DONTWAIT 0
+#endif
+
+LOGCIE_DEF uint8_t logcie_syslog_severity(Logcie_LogLevel level) {
+  switch (level) {
+    case LOGCIE_LEVEL_FATAL: return 2;  // crit
+    case LOGCIE_LEVEL_ERROR: return 3;  // err
+    case LOGCIE_LEVEL_WARN:  return 4;  // warning
+    case LOGCIE_LEVEL_INFO:  return 6;  // info
+    default:                 return 7;  // debug
+  }
+}
+
+// Renders `1 TIMESTAMP HOSTNAME APP-NAME PROCID - - ` for given second
+static void logcie_syslog_header(Logcie_Syslog *state, time_t time) {
+  struct utsname host;
+  struct tm      utc;
+  logcie_utc_time(time, &utc);
+
+  if (uname(&host) != 0 || host.nodename[0] == '\0') {
+    strcpy(host.nodename, "-");
+  }
+
+  int len = logcie_format(state->header, sizeof(state->header), "1 %04d-%02d-%02dT%02d:%02d:%02dZ %s %s %ld - - ",
+                          utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec,
+                          host.nodename, state->app_name ? state->app_name : "logcie", (long)getpid());
+
+  state->header_len  = len < 0 ? 0 : (size_t)len < sizeof(state->header) ? (size_t)len : sizeof(state->header) - 1;
+  state->header_time = time;
+}
+
+// Length of message cut so record of `segments`, message and `fixed` more bytes fits LOGCIE_SYSLOG_RECORD_MAX
+static size_t logcie_syslog_fit(const Logcie_Segment *segments, size_t count, size_t fixed, size_t len) {
+  size_t taken = fixed;
+
+  for (size_t i = 0; i < count; i++) {
+    taken += segments[i].len;
+  }
+
+  if (taken >= LOGCIE_SYSLOG_RECORD_MAX) {
+    return 0;
+  }
+
+  return len < LOGCIE_SYSLOG_RECORD_MAX - taken ? len : LOGCIE_SYSLOG_RECORD_MAX - taken;
+}
+
+LOGCIE_DEF size_t logcie_syslog_formatter(Logcie_Writer *writer, void *user_data, Logcie_Log log, va_list *args) {
+  _LOGCIE_ASSERT(user_data, "Syslog formatter needs Logcie_Syslog");
+  Logcie_Syslog *state    = (Logcie_Syslog *)user_data;
+  unsigned int   facility = state->facility ? state->facility : 1;
+  unsigned int   severity = logcie_syslog_severity(log.level);
+  const char    *app_name = state->app_name ? state->app_name : "logcie";
+
+  char        long_message[LOGCIE_SYSLOG_RECORD_MAX];
+  size_t      len;
+  const char *message = logcie_log_message_long(&log, args, long_message, sizeof(long_message), &len);
+
+  Logcie_Segment segments[16];
+  size_t         count = 0;
+  char           scratch[96];
+  size_t         used = 0;
+
+#define _LOGCIE_SYSLOG_PUSH(p, l) \
+  do {                            \
+    segments[count].ptr = (p);    \
+    segments[count].len = (l);    \
+    count++;                      \
+  } while (0)
+#define _LOGCIE_SYSLOG_PUSH_LITERAL(s) _LOGCIE_SYSLOG_PUSH(s, sizeof(s) - 1)
+#define _LOGCIE_SYSLOG_PUSH_FORMAT(...)                                                \
+  do {                                                                                 \
+    int n = logcie_format(scratch + used, sizeof(scratch) - used, __VA_ARGS__);        \
+    n     = n < 0 ? 0 : (size_t)n < sizeof(scratch) - used ? n : (int)(sizeof(scratch) - used - 1); \
+    _LOGCIE_SYSLOG_PUSH(scratch + used, (size_t)n);                                    \
+    used += (size_t)n;                                                                 \
+  } while (0)
+
+  if (state->protocol == LOGCIE_SYSLOG_JOURNAL) {
+    _LOGCIE_SYSLOG_PUSH_FORMAT("PRIORITY=%u\nSYSLOG_FACILITY=%u\n", severity, facility);
+    _LOGCIE_SYSLOG_PUSH_LITERAL("SYSLOG_IDENTIFIER=");
+    _LOGCIE_SYSLOG_PUSH(app_name, strlen(app_name));
+
+    if (log.location.file) {
+      _LOGCIE_SYSLOG_PUSH_LITERAL("\nCODE_FILE=");
+      _LOGCIE_SYSLOG_PUSH(log.location.file, strlen(log.location.file));
+      _LOGCIE_SYSLOG_PUSH_FORMAT("\nCODE_LINE=%u", (unsigned int)log.location.line);
+    }
+
+    len = logcie_syslog_fit(segments, count, strlen("\nMESSAGE\n") + 8 + 1, len);
+
+    if (memchr(message, '\n', len)) {
+      // Binary form: name, newline, 64-bit little-endian length, value
+      char *size = scratch + used;
+
+      for (int i = 0; i < 8; i++) {
+        size[i] = (char)(((uint64_t)len >> (8 * i)) & 0xff);
+      }
+
+      used += 8;
+      _LOGCIE_SYSLOG_PUSH_LITERAL("\nMESSAGE\n");
+      _LOGCIE_SYSLOG_PUSH(size, 8);
+    } else {
+      _LOGCIE_SYSLOG_PUSH_LITERAL("\nMESSAGE=");
+    }
+
+    _LOGCIE_SYSLOG_PUSH(message, len);
+    _LOGCIE_SYSLOG_PUSH_LITERAL("\n");
+  } else {
+    if (state->header_len == 0 || state->header_time != log.time) {
+      logcie_syslog_header(state, log.time);
+    }
+
+    _LOGCIE_SYSLOG_PUSH_FORMAT("<%u>", facility * 8 + severity);
+    _LOGCIE_SYSLOG_PUSH(state->header, state->header_len);
+    len = logcie_syslog_fit(segments, count, 0, len);
+    _LOGCIE_SYSLOG_PUSH(message, len);
+  }
+
+#undef _LOGCIE_SYSLOG_PUSH_FORMAT
+#undef _LOGCIE_SYSLOG_PUSH_LITERAL
+#undef _LOGCIE_SYSLOG_PUSH
+
+  size_t written = logcie_writer_writev(writer, segments, count);
+
+  // Important logs are not kept in the batch. Writer is not our batch when the line
+  // is rendered once for several sinks
+  if (log.level >= LOGCIE_LEVEL_WARN && writer->data == user_data && writer->writev == logcie_syslog_writev) {
+    logcie_syslog_flush(state);
+  }
+
+  return written;
+}
+
+LOGCIE_DEF size_t logcie_syslog_writer(void *user_data, const char *fmt, va_list *va, ...) {
+  char    record[LOGCIE_SYSLOG_RECORD_MAX];
+  va_list args;
+
+  if (va != NULL) {
+    va_copy(args, *va);
+  } else {
+    va_start(args, va);
+  }
+
+  int len = logcie_vformat(record, sizeof(record), fmt, args);
+
+  va_end(args);
+
+  if (len <= 0) {
+    return 0;
+  }
+
+  Logcie_Segment segment = {record, (size_t)len < sizeof(record) ? (size_t)len : sizeof(record) - 1};
+  return logcie_syslog_writev(user_data, &segment, 1);
+}
+
+LOGCIE_DEF size_t logcie_syslog_writev(void *user_data, const Logcie_Segment *segments, size_t count) {
+  _LOGCIE_ASSERT(user_data, "Syslog writer needs Logcie_Syslog");
+  Logcie_Syslog *state  = (Logcie_Syslog *)user_data;
+  char          *record = state->records[state->count];
+  size_t         len    = 0;
+  size_t         total  = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    total += segments[i].len;
+  }
+
+  // Cut journal record may end inside a binary field, and journald rejects the whole datagram
+  if (state->protocol == LOGCIE_SYSLOG_JOURNAL && total > LOGCIE_SYSLOG_RECORD_MAX) {
+    state->dropped++;
+    return 0;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    size_t part = segments[i].len < LOGCIE_SYSLOG_RECORD_MAX - len ? segments[i].len : LOGCIE_SYSLOG_RECORD_MAX - len;
+    memcpy(record + len, segments[i].ptr, part);
+    len += part;
+  }
+
+  uint64_t now = logcie_now_ns();
+
+  if (state->count == 0) {
+    state->first_ns = now;
+  }
+
+  state->lengths[state->count++] = len;
+
+  if (state->count == LOGCIE_SYSLOG_BATCH || now - state->first_ns >= (uint64_t)state->linger_ms * 1000000ull) {
+    logcie_syslog_flush(state);
+  }
+
+  return total;
+}
+
+static uint8_t logcie_syslog_connect(Logcie_Syslog *state) {
+  uint64_t now = logcie_now_ns();
+
+  if (now < state->retry_ns) {
+    return 0;
+  }
+
+  state->retry_ns = now + 1000000000ull;
+
+  const char *path = state->path ? state->path : state->protocol == LOGCIE_SYSLOG_JOURNAL ? "/run/systemd/journal/socket" : "/dev/log";
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    return 0;
+  }
+
+  strcpy(address.sun_path, path);
+
+  int type = SOCK_DGRAM;
+#ifdef SOCK_CLOEXEC
+  type |= SOCK_CLOEXEC;
+#endif
+
+  int fd = socket(AF_UNIX, type, 0);
+
+  if (fd < 0) {
+    return 0;
+  }
+
+  if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    close(fd);
+    return 0;
+  }
+
+  state->fd        = fd;
+  state->connected = 1;
+  return 1;
+}
+
+// Sends records starting from `from`. Returns number of sent records or -1 with errno
+static int logcie_syslog_send(Logcie_Syslog *state, size_t from) {
+#ifdef _LOGCIE_SENDMMSG
+  struct iovec   iov[LOGCIE_SYSLOG_BATCH];
+  Logcie_MMsgHdr messages[LOGCIE_SYSLOG_BATCH];
+  size_t         count = state->count - from;
+
+  memset(messages, 0, sizeof(messages[0]) * count);
+
+  for (size_t i = 0; i < count; i++) {
+    iov[i].iov_base                 = state->records[from + i];
+    iov[i].iov_len                  = state->lengths[from + i];
+    messages[i].msg_hdr.msg_iov    = &iov[i];
+    messages[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  return sendmmsg(state->fd, (struct mmsghdr *)messages, (unsigned int)count, _LOGCIE_MSG_DONTWAIT);
+#else
+  return send(state->fd, state->records[from], state->lengths[from], _LOGCIE_MSG_DONTWAIT) < 0 ? -1 : 1;
+#endif
+}
+
+LOGCIE_DEF size_t logcie_syslog_flush(Logcie_Syslog *state) {
+  size_t at   = 0;
+  size_t sent = 0;
+
+  if (state->count == 0) {
+    return 0;
+  }
+
+  if (state->connected || logcie_syslog_connect(state)) {
+    while (at < state->count) {
+      int result = logcie_syslog_send(state, at);
+
+      if (result > 0) {
+        at += (size_t)result;
+        sent += (size_t)result;
+        continue;
+      }
+
+      if (result < 0 && errno == EINTR) {
+        continue;
+      }
+
+      if (result < 0 && errno == EMSGSIZE) {
+        // Only this record is rejected
+        state->dropped++;
+        at++;
+        continue;
+      }
+
+      if (result < 0 && (errno == ECONNREFUSED || errno == ENOTCONN || errno == ENOENT || errno == EPIPE || errno == EBADF)) {
+        // Daemon was restarted, socket has to be connected again
+        close(state->fd);
+        state->connected = 0;
+
+        if (logcie_syslog_connect(state)) {
+          continue;
+        }
+      }
+
+      // Socket is full (EAGAIN) or gone, waiting for it would block the program
+      break;
+    }
+  }
+
+  state->dropped += state->count - at;
+  state->sent += sent;
+  state->count = 0;
+  return sent;
+}
+
+LOGCIE_DEF void logcie_syslog_flush_fn(void *user_data) {
+  logcie_syslog_flush((Logcie_Syslog *)user_data);
+}
+
+LOGCIE_DEF void logcie_syslog_close(Logcie_Syslog *state) {
+  logcie_syslog_flush(state);
+
+  if (state->connected) {
+    close(state->fd);
+    state->connected = 0;
+  }
+
+  state->retry_ns = 0;
+}
+
+LOGCIE_DEF Logcie_Sink logcie_syslog_sink(Logcie_Syslog *state) {
+  Logcie_Sink sink = {
+    .formatter = {logcie_syslog_formatter, state},
+    .writer    = {logcie_syslog_writer, state, logcie_syslog_writev, logcie_syslog_flush_fn},
+    .filter    = {NULL, NULL},
+    .dedup     = NULL,
+    .async     = NULL,
+  };
+  return sink;
+}
+
+#ifdef MSG_NOSIGNAL
+#define _LOGCIE_MSG_NOSIGNAL MSG_NOSIGNAL
+#else
+#define _LOGCIE_MSG_NOSIGNAL 0
+#endif
+
+// Length of the framed record that starts at `at`
+static size_t logcie_net_frame_len(const Logcie_Net *net, size_t at) {
+  const unsigned char *frame = (const unsigned char *)net->buffer + at;
+
+  if (net->framing == LOGCIE_NET_LENGTH_PREFIX) {
+    return 4 + ((size_t)frame[0] << 24 | (size_t)frame[1] << 16 | (size_t)frame[2] << 8 | (size_t)frame[3]);
+  }
+
+  const unsigned char *end = (const unsigned char *)memchr(frame, '\n', net->len - at);
+  return end ? (size_t)(end - frame) + 1 : net->len - at;
+}
+
+// Removes `size` bytes from the start of unsent data, counting records that ended in `records`
+static void logcie_net_consume(Logcie_Net *net, size_t size, uint64_t *records) {
+  size_t end = net->head + size;
+
+  while (net->head < end) {
+    if (net->frame_left == 0) {
+      net->frame_left = logcie_net_frame_len(net, net->head);
+    }
+
+    size_t step = net->frame_left < end - net->head ? net->frame_left : end - net->head;
+    net->head += step;
+    net->frame_left -= step;
+
+    if (net->frame_left == 0) {
+      (*records)++;
+    }
+  }
+
+  if (net->head == net->len) {
+    net->head = 0;
+    net->len  = 0;
+  }
+}
+
+static void logcie_net_backoff(Logcie_Net *net) {
+  uint32_t delay = net->delay_ms ? net->delay_ms : net->backoff_ms ? net->backoff_ms : 100;
+  uint32_t limit = net->backoff_max_ms ? net->backoff_max_ms : 30000;
+
+  net->retry_ns = logcie_now_ns() + (uint64_t)delay * 1000000ull;
+  net->delay_ms = delay < limit / 2 ? delay * 2 : limit;
+}
+
+static void logcie_net_connected(Logcie_Net *net) {
+  net->state    = 2;
+  net->delay_ms = 0;
+  net->connects++;
+}
+
+static void logcie_net_disconnect(Logcie_Net *net) {
+  // Rest of partially sent record would break framing of the next connection
+  if (net->frame_left) {
+    net->dropped_bytes += net->frame_left;
+    logcie_net_consume(net, net->frame_left, &net->dropped);
+  }
+
+  close(net->fd);
+  net->state = 0;
+}
+
+// Returns 1 when socket is connected. Never waits for connection
+static uint8_t logcie_net_ready(Logcie_Net *net) {
+  if (net->state == 0) {
+    if (logcie_now_ns() < net->retry_ns || net->host == NULL) {
+      return 0;
+    }
+
+    struct sockaddr_storage address;
+    socklen_t               address_len;
+    memset(&address, 0, sizeof(address));
+
+    struct sockaddr_in  *ipv4 = (struct sockaddr_in *)&address;
+    struct sockaddr_in6 *ipv6 = (struct sockaddr_in6 *)&address;
+
+    if (inet_pton(AF_INET, net->host, &ipv4->sin_addr) == 1) {
+      ipv4->sin_family = AF_INET;
+      ipv4->sin_port   = htons(net->port);
+      address_len      = sizeof(*ipv4);
+    } else if (inet_pton(AF_INET6, net->host, &ipv6->sin6_addr) == 1) {
+      ipv6->sin6_family = AF_INET6;
+      ipv6->sin6_port   = htons(net->port);
+      address_len       = sizeof(*ipv6);
+    } else {
+      logcie_net_backoff(net);
+      return 0;
+    }
+
+    net->fd = socket(address.ss_family, net->transport == LOGCIE_NET_UDP ? SOCK_DGRAM : SOCK_STREAM, 0);
+
+    if (net->fd < 0) {
+      logcie_net_backoff(net);
+      return 0;
+    }
+
+    fcntl(net->fd, F_SETFL, fcntl(net->fd, F_GETFL) | O_NONBLOCK);
+    fcntl(net->fd, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(net->fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+    if (connect(net->fd, (struct sockaddr *)&address, address_len) == 0) {
+      logcie_net_connected(net);
+    } else if (errno == EINPROGRESS) {
+      net->state = 1;
+    } else {
+      logcie_net_disconnect(net);
+      logcie_net_backoff(net);
+      return 0;
+    }
+  }
+
+  if (net->state == 1) {
+    struct pollfd poll_fd = {net->fd, POLLOUT, 0};
+
+    if (poll(&poll_fd, 1, 0) <= 0) {
+      return 0;
+    }
+
+    int       error     = 0;
+    socklen_t error_len = sizeof(error);
+
+    if (getsockopt(net->fd, SOL_SOCKET, SO_ERROR, &error, &error_len) != 0 || error != 0) {
+      logcie_net_disconnect(net);
+      logcie_net_backoff(net);
+      return 0;
+    }
+
+    logcie_net_connected(net);
+  }
+
+  return 1;
+}
+
+LOGCIE_DEF size_t logcie_net_flush(Logcie_Net *net) {
+  size_t total = 0;
+
+  if (net->head == net->len || !logcie_net_ready(net)) {
+    return 0;
+  }
+
+  while (net->head < net->len) {
+    size_t size = net->len - net->head;
+
+    // Datagram carries whole records only
+    if (net->transport == LOGCIE_NET_UDP) {
+      size = logcie_net_frame_len(net, net->head);
+
+      while (net->head + size < net->len) {
+        size_t next = logcie_net_frame_len(net, net->head + size);
+
+        if (size + next > LOGCIE_NET_DATAGRAM_MAX) {
+          break;
+        }
+
+        size += next;
+      }
+    }
+
+    ssize_t result = send(net->fd, net->buffer + net->head, size, _LOGCIE_MSG_DONTWAIT | _LOGCIE_MSG_NOSIGNAL);
+
+    if (result >= 0) {
+      // Datagram is sent whole or not at all
+      logcie_net_consume(net, net->transport == LOGCIE_NET_UDP ? size : (size_t)result, &net->sent);
+      total += (size_t)result;
+      continue;
+    }
+
+    if (errno == EINTR) {
+      continue;
+    }
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      break;
+    }
+
+    if (net->transport == LOGCIE_NET_UDP) {
+      // Rejected datagram (too big, nobody listens) does not break the socket
+      net->dropped_bytes += size;
+      logcie_net_consume(net, size, &net->dropped);
+      continue;
+    }
+
+    logcie_net_disconnect(net);
+    logcie_net_backoff(net);
+    break;
+  }
+
+  net->first_ns = logcie_now_ns();
+  return total;
+}
+
+LOGCIE_DEF size_t logcie_net_writer(void *user_data, const char *fmt, va_list *va, ...) {
+  char    line[LOGCIE_LINE_MAX];
+  va_list args;
+
+  if (va != NULL) {
+    va_copy(args, *va);
+  } else {
+    va_start(args, va);
+  }
+
+  int len = logcie_vformat(line, sizeof(line), fmt, args);
+
+  va_end(args);
+
+  if (len <= 0) {
+    return 0;
+  }
+
+  Logcie_Segment segment = {line, (size_t)len < sizeof(line) ? (size_t)len : sizeof(line) - 1};
+  return logcie_net_writev(user_data, &segment, 1);
+}
+
+LOGCIE_DEF size_t logcie_net_writev(void *user_data, const Logcie_Segment *segments, size_t count) {
+  _LOGCIE_ASSERT(user_data, "Network writer needs Logcie_Net");
+  Logcie_Net *net = (Logcie_Net *)user_data;
+  size_t      len = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    len += segments[i].len;
+  }
+
+  uint8_t newline = 0;
+
+  if (net->framing == LOGCIE_NET_NEWLINE) {
+    const Logcie_Segment *last = NULL;
+
+    for (size_t i = count; i > 0 && last == NULL; i--) {
+      last = segments[i - 1].len ? &segments[i - 1] : NULL;
+    }
+
+    newline = last == NULL || last->ptr[last->len - 1] != '\n';
+  }
+
+  size_t framed = len + newline + (net->framing == LOGCIE_NET_LENGTH_PREFIX ? 4 : 0);
+
+  if (net->len + framed > sizeof(net->buffer) && net->head > 0) {
+    memmove(net->buffer, net->buffer + net->head, net->len - net->head);
+    net->len -= net->head;
+    net->head = 0;
+  }
+
+  if (net->len + framed > sizeof(net->buffer)) {
+    net->dropped++;
+    net->dropped_bytes += framed;
+    logcie_net_flush(net);
+    return 0;
+  }
+
+  char *at = net->buffer + net->len;
+
+  if (net->framing == LOGCIE_NET_LENGTH_PREFIX) {
+    *at++ = (char)((len >> 24) & 0xff);
+    *at++ = (char)((len >> 16) & 0xff);
+    *at++ = (char)((len >> 8) & 0xff);
+    *at++ = (char)(len & 0xff);
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    memcpy(at, segments[i].ptr, segments[i].len);
+    at += segments[i].len;
+  }
+
+  if (newline) {
+    *at = '\n';
+  }
+
+  uint64_t now = logcie_now_ns();
+
+  if (net->head == net->len) {
+    net->first_ns = now;
+  }
+
+  net->len += framed;
+
+  if (net->len - net->head >= sizeof(net->buffer) / 2 || now - net->first_ns >= (uint64_t)net->linger_ms * 1000000ull) {
+    logcie_net_flush(net);
+  }
+
+  return len;
+}
+
+LOGCIE_DEF size_t logcie_net_formatter(Logcie_Writer *writer, void *user_data, Logcie_Log log, va_list *args) {
+  static _LOGCIE_THREAD_LOCAL char line[LOGCIE_LINE_MAX];
+  Logcie_Buffer                    buffer  = {line, 0, sizeof(line), 0};
+  Logcie_Writer                    collect = {logcie_buffer_writer, &buffer, logcie_buffer_writev, NULL};
+
+  logcie_printf_formatter(&collect, user_data, log, args);
+
+  Logcie_Segment segment = {line, buffer.len};
+  return logcie_writer_writev(writer, &segment, 1);
+}
+
+LOGCIE_DEF void logcie_net_flush_fn(void *user_data) {
+  logcie_net_flush((Logcie_Net *)user_data);
+}
+
+LOGCIE_DEF void logcie_net_close(Logcie_Net *net) {
+  logcie_net_flush(net);
+
+  if (net->state != 0) {
+    logcie_net_disconnect(net);
+  }
+
+  net->retry_ns = 0;
+  net->delay_ms = 0;
+}
+
+LOGCIE_DEF Logcie_Sink logcie_net_sink(Logcie_Net *net, const char *format) {
+  Logcie_Sink sink = {
+    .formatter = {logcie_net_formatter, (void *)format},
+    .writer    = {logcie_net_writer, net, logcie_net_writev, logcie_net_flush_fn},
+    .filter    = {NULL, NULL},
+    .dedup     = NULL,
+    .async     = NULL,
+  };
+  return sink;
+}
+
+// ftruncate is hidden by strict ISO C modes of glibc, the declaration is repeated here
+#if defined(__GLIBC__) && defined(__STRICT_ANSI__) && !defined(__cplusplus)
+extern int ftruncate(int fd, off_t length);
+#endif
+
+#define _LOGCIE_SHM_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+LOGCIE_DEF uint8_t logcie_shm_open(Logcie_Shm *shm) {
+  _LOGCIE_ASSERT(shm->name, "Shared memory sink needs name");
+  size_t capacity = _LOGCIE_SHM_ALIGN(shm->capacity ? shm->capacity : LOGCIE_SHM_CAPACITY);
+  size_t size     = sizeof(Logcie_ShmHeader) + capacity;
+  int    fd       = shm_open(shm->name, O_RDWR | O_CREAT, 0600);
+
+  if (fd < 0) {
+    return 0;
+  }
+
+  void *memory = MAP_FAILED;
+
+  if (ftruncate(fd, (off_t)size) == 0) {
+    memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+
+  if (memory == MAP_FAILED) {
+    close(fd);
+    return 0;
+  }
+
+  shm->fd       = fd;
+  shm->header   = (Logcie_ShmHeader *)memory;
+  shm->data     = (char *)memory + sizeof(Logcie_ShmHeader);
+  shm->capacity = capacity;
+  shm->lock     = 0;
+  shm->sequence = 0;
+
+  // Ring left by previous run is started over, magic hides it from readers meanwhile
+  Logcie_ShmHeader *header = shm->header;
+  uint64_t          epoch  = header->magic == LOGCIE_SHM_MAGIC ? header->epoch + 1 : 0;
+  _LOGCIE_ATOMIC_STORE(&header->magic, 0u);
+  _LOGCIE_ATOMIC_FENCE();
+  header->version  = LOGCIE_SHM_VERSION;
+  header->capacity = capacity;
+  _LOGCIE_ATOMIC_STORE(&header->epoch, epoch);
+  _LOGCIE_ATOMIC_STORE(&header->tail, (uint64_t)0);
+  _LOGCIE_ATOMIC_STORE(&header->head, (uint64_t)0);
+  _LOGCIE_ATOMIC_STORE(&header->magic, LOGCIE_SHM_MAGIC);
+  return 1;
+}
+
+LOGCIE_DEF void logcie_shm_close(Logcie_Shm *shm) {
+  if (shm->header == NULL) {
+    return;
+  }
+
+  munmap(shm->header, sizeof(Logcie_ShmHeader) + shm->capacity);
+  close(shm->fd);
+  shm->header = NULL;
+  shm->data   = NULL;
+}
+
+// Puts record with payload taken from segments after first `skip` bytes
+static size_t logcie_shm_put(Logcie_Shm *shm, Logcie_ShmRecord record, const Logcie_Segment *segments, size_t count, size_t skip) {
+  size_t   payload  = (size_t)record.module_len + record.file_len + record.message_len;
+  size_t   size     = _LOGCIE_SHM_ALIGN(sizeof(record) + payload);
+  uint64_t capacity = shm->capacity;
+
+  if (shm->header == NULL || size > LOGCIE_SHM_RECORD_MAX || size > capacity) {
+    _LOGCIE_ATOMIC_ADD(&shm->dropped, 1);
+    return 0;
+  }
+
+  uint32_t unlocked = 0;
+
+  while (!_LOGCIE_ATOMIC_CAS(&shm->lock, &unlocked, 1)) {
+    unlocked = 0;
+  }
+
+  // Only this process writes the control block, so it is read without atomics
+  Logcie_ShmHeader *header = shm->header;
+  uint64_t          head   = header->head;
+  uint64_t          tail   = header->tail;
+  uint64_t          offset = head % capacity;
+  uint64_t          start  = capacity - offset < size ? head + (capacity - offset) : head;
+
+  // Records that are about to be overwritten are given up, readers never hold the writer
+  while (tail < head && start + size - tail > capacity) {
+    uint32_t skipped;
+    memcpy(&skipped, shm->data + tail % capacity, sizeof(skipped));
+    tail += skipped == LOGCIE_SHM_WRAP ? capacity - tail % capacity : skipped;
+  }
+
+  if (start + size - tail > capacity) {
+    tail = start;
+  }
+
+  // Readers must see the new tail before any byte of old records changes
+  _LOGCIE_ATOMIC_STORE(&header->tail, tail);
+  _LOGCIE_ATOMIC_FENCE();
+
+  if (start != head) {
+    uint32_t wrap = LOGCIE_SHM_WRAP;
+    memcpy(shm->data + offset, &wrap, sizeof(wrap));
+  }
+
+  char *at        = shm->data + start % capacity;
+  record.size     = (uint32_t)size;
+  record.sequence = shm->sequence++;
+  record.reserved = 0;
+  memcpy(at, &record, sizeof(record));
+  at += sizeof(record);
+
+  for (size_t i = 0; i < count && payload > 0; i++) {
+    size_t len = segments[i].len;
+
+    if (skip >= len) {
+      skip -= len;
+      continue;
+    }
+
+    len = len - skip < payload ? len - skip : payload;
+    memcpy(at, segments[i].ptr + skip, len);
+    at += len;
+    payload -= len;
+    skip = 0;
+  }
+
+  shm->written++;
+  _LOGCIE_ATOMIC_STORE(&header->head, start + size);
+  _LOGCIE_ATOMIC_STORE(&shm->lock, 0u);
+  return (size_t)record.module_len + record.file_len + record.message_len;
+}
+
+LOGCIE_DEF size_t logcie_shm_formatter(Logcie_Writer *writer, void *user_data, Logcie_Log log, va_list *args) {
+  (void)user_data;
+  char        long_message[LOGCIE_SHM_RECORD_MAX];
+  size_t      len;
+  const char *message    = logcie_log_message_long(&log, args, long_message, sizeof(long_message), &len);
+  const char *module     = log.module ? log.module : "";
+  const char *file       = log.location.file ? log.location.file : "";
+  size_t      module_len = log.module ? strlen(log.module) + 1 : 0;
+  size_t      file_len   = log.location.file ? strlen(log.location.file) + 1 : 0;
+
+  Logcie_ShmRecord record;
+  memset(&record, 0, sizeof(record));
+  record.level      = (uint32_t)log.level;
+  record.time       = (int64_t)log.time;
+  record.line       = log.location.line;
+  record.module_len = (uint16_t)(module_len <= UINT16_MAX ? module_len : 0);
+  record.file_len   = (uint16_t)(file_len <= UINT16_MAX ? file_len : 0);
+
+  // Message is cut so the aligned record fits LOGCIE_SHM_RECORD_MAX
+  size_t limit = LOGCIE_SHM_RECORD_MAX & ~(size_t)7;
+  size_t taken = sizeof(record) + record.module_len + record.file_len;
+
+  if (taken + len > limit) {
+    len = taken < limit ? limit - taken : 0;
+  }
+
+  record.message_len = (uint32_t)len;
+  record.size        = (uint32_t)(sizeof(record) + record.module_len + record.file_len + len);
+
+  Logcie_Segment segments[4] = {
+    {(const char *)&record, sizeof(record)},
+    {module, record.module_len},
+    {file, record.file_len},
+    {message, len},
+  };
+
+  return logcie_writer_writev(writer, segments, 4);
+}
+
+LOGCIE_DEF size_t logcie_shm_writer(void *user_data, const char *fmt, va_list *va, ...) {
+  char    line[LOGCIE_SHM_RECORD_MAX];
+  va_list args;
+
+  if (va != NULL) {
+    va_copy(args, *va);
+  } else {
+    va_start(args, va);
+  }
+
+  int len = logcie_vformat(line, sizeof(line), fmt, args);
+
+  va_end(args);
+
+  if (len <= 0) {
+    return 0;
+  }
+
+  Logcie_Segment segment = {line, (size_t)len < sizeof(line) ? (size_t)len : sizeof(line) - 1};
+  return logcie_shm_writev(user_data, &segment, 1);
+}
+
+LOGCIE_DEF size_t logcie_shm_writev(void *user_data, const Logcie_Segment *segments, size_t count) {
+  _LOGCIE_ASSERT(user_data, "Shared memory writer needs Logcie_Shm");
+  Logcie_Shm      *shm   = (Logcie_Shm *)user_data;
+  size_t           total = 0;
+  size_t           got   = 0;
+  Logcie_ShmRecord record;
+
+  // Record made by logcie_shm_formatter may come as is or as one line (async queue)
+  for (size_t i = 0; i < count; i++) {
+    size_t len = segments[i].len < sizeof(record) - got ? segments[i].len : sizeof(record) - got;
+    memcpy((char *)&record + got, segments[i].ptr, len);
+    got += len;
+    total += segments[i].len;
+  }
+
+  if (got == sizeof(record) && record.size == total && record.reserved == 0 &&
+      sizeof(record) + record.module_len + record.file_len + record.message_len == total) {
+    return logcie_shm_put(shm, record, segments, count, sizeof(record));
+  }
+
+  memset(&record, 0, sizeof(record));
+  record.level       = LOGCIE_LEVEL_TRACE;
+  record.time        = (int64_t)time(NULL);
+  record.message_len = (uint32_t)(total < LOGCIE_SHM_RECORD_MAX ? total : LOGCIE_SHM_RECORD_MAX);
+  return logcie_shm_put(shm, record, segments, count, 0);
+}
+
+LOGCIE_DEF Logcie_Sink logcie_shm_sink(Logcie_Shm *shm) {
+  Logcie_Sink sink = {
+    .formatter = {logcie_shm_formatter, shm},
+    .writer    = {logcie_shm_writer, shm, logcie_shm_writev, NULL},
+    .filter    = {NULL, NULL},
+    .dedup     = NULL,
+    .async     = NULL,
+  };
+  return sink;
+}
+
+LOGCIE_DEF uint8_t logcie_shm_reader_open(Logcie_ShmReader *reader) {
+  _LOGCIE_ASSERT(reader->name, "Shared memory reader needs name");
+  struct stat info;
+  int         fd = shm_open(reader->name, O_RDONLY, 0);
+
+  if (fd < 0) {
+    return 0;
+  }
+
+  void *memory = MAP_FAILED;
+
+  if (fstat(fd, &info) == 0 && (size_t)info.st_size > sizeof(Logcie_ShmHeader)) {
+    memory = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+
+  if (memory == MAP_FAILED) {
+    close(fd);
+    return 0;
+  }
+
+  const Logcie_ShmHeader *header = (const Logcie_ShmHeader *)memory;
+
+  // Mapping has to match the ring exactly, otherwise it is not created yet or is created again
+  if (_LOGCIE_ATOMIC_LOAD(&header->magic) != LOGCIE_SHM_MAGIC || header->version != LOGCIE_SHM_VERSION ||
+      sizeof(Logcie_ShmHeader) + header->capacity != (uint64_t)info.st_size) {
+    munmap(memory, (size_t)info.st_size);
+    close(fd);
+    return 0;
+  }
+
+  reader->fd       = fd;
+  reader->header   = header;
+  reader->data     = (const char *)memory + sizeof(Logcie_ShmHeader);
+  reader->capacity = header->capacity;
+  reader->epoch    = _LOGCIE_ATOMIC_LOAD(&header->epoch);
+  reader->position = _LOGCIE_ATOMIC_LOAD(&header->tail);
+  // Nothing was overwritten yet only if the oldest record is the first one
+  reader->sequence = reader->position == 0 ? 0 : UINT64_MAX;
+  return 1;
+}
+
+LOGCIE_DEF uint8_t logcie_shm_read(Logcie_ShmReader *reader, Logcie_Log *log) {
+  const Logcie_ShmHeader *header = reader->header;
+
+  if (header == NULL) {
+    return 0;
+  }
+
+  for (;;) {
+    if (_LOGCIE_ATOMIC_LOAD(&header->magic) != LOGCIE_SHM_MAGIC || header->capacity != reader->capacity) {
+      return 0;
+    }
+
+    uint64_t epoch = _LOGCIE_ATOMIC_LOAD(&header->epoch);
+    uint64_t head  = _LOGCIE_ATOMIC_LOAD(&header->head);
+    uint64_t tail  = _LOGCIE_ATOMIC_LOAD(&header->tail);
+
+    if (epoch != reader->epoch) {
+      reader->epoch    = epoch;
+      reader->position = tail;
+      reader->sequence = tail == 0 ? 0 : UINT64_MAX;
+    }
+
+    // Overwritten records are skipped, sequence numbers tell how many
+    if (reader->position < tail) {
+      reader->position = tail;
+    }
+
+    if (reader->position >= head) {
+      return 0;
+    }
+
+    uint64_t offset = reader->position % reader->capacity;
+    uint32_t size;
+    memcpy(&size, reader->data + offset, sizeof(size));
+
+    uint8_t wrap  = size == LOGCIE_SHM_WRAP;
+    uint8_t valid = wrap || (size >= sizeof(Logcie_ShmRecord) && size <= LOGCIE_SHM_RECORD_MAX && size <= reader->capacity - offset);
+
+    if (valid && !wrap) {
+      memcpy(reader->record, reader->data + offset, size);
+    }
+
+    // Copy is good only if writer did not move tail past it meanwhile
+    _LOGCIE_ATOMIC_FENCE();
+
+    if (_LOGCIE_ATOMIC_LOAD(&header->tail) > reader->position || _LOGCIE_ATOMIC_LOAD(&header->epoch) != epoch) {
+      continue;
+    }
+
+    if (!valid) {
+      // Ring is damaged, nothing before head can be trusted
+      reader->position = head;
+      return 0;
+    }
+
+    if (wrap) {
+      reader->position += reader->capacity - offset;
+      continue;
+    }
+
+    Logcie_ShmRecord record;
+    memcpy(&record, reader->record, sizeof(record));
+
+    if (sizeof(record) + record.module_len + record.file_len + record.message_len > size) {
+      reader->position = head;
+      return 0;
+    }
+
+    reader->position += size;
+
+    if (reader->sequence != UINT64_MAX && record.sequence > reader->sequence) {
+      reader->lost += record.sequence - reader->sequence;
+    }
+
+    reader->sequence = record.sequence + 1;
+
+    char *module  = reader->record + sizeof(record);
+    char *file    = module + record.module_len;
+    char *message = file + record.file_len;
+
+    // Strings are NUL-terminated by the writer, but shared memory is not trusted
+    if (record.module_len) {
+      file[-1] = '\0';
+    }
+
+    if (record.file_len) {
+      message[-1] = '\0';
+    }
+
+    log->level         = record.level < Count_LOGCIE_LEVEL ? (Logcie_LogLevel)record.level : LOGCIE_LEVEL_TRACE;
+    log->msg           = NULL;
+    log->time          = (time_t)record.time;
+    log->module        = record.module_len ? module : NULL;
+    log->location.file = record.file_len ? file : NULL;
+    log->location.line = record.line;
+    log->callsite      = NULL;
+    log->message       = message;
+    log->message_len   = record.message_len;
+    log->args          = NULL;
+    return 1;
+  }
+}
+
+LOGCIE_DEF void logcie_shm_reader_close(Logcie_ShmReader *reader) {
+  if (reader->header == NULL) {
+    return;
+  }
+
+  munmap((void *)reader->header, sizeof(Logcie_ShmHeader) + reader->capacity);
+  close(reader->fd);
+  reader->header = NULL;
+  reader->data   = NULL;
+}
+
+static const int logcie_crash_signals[] = {
+  SIGSEGV,
+  SIGILL,
+  SIGFPE,
+  SIGABRT,
+#ifdef SIGBUS
+  SIGBUS,
+#endif
+};
+
+#define _LOGCIE_CRASH_SIGNALS (sizeof(logcie_crash_signals) / sizeof(logcie_crash_signals[0]))
+
+// sigaction is hidden by strict ISO C modes, plain signal() is used there
+#ifdef SA_RESETHAND
+static struct sigaction logcie_crash_previous[_LOGCIE_CRASH_SIGNALS];
+#else
+static void (*logcie_crash_previous[_LOGCIE_CRASH_SIGNALS])(int);
+#endif
+
+#ifdef SA_ONSTACK
+static char logcie_crash_stack[65536];
+#endif
+
+static volatile sig_atomic_t logcie_crash_active = 0;
+
+// Writes a line only if it can be done with async-signal-safe calls
+static void logcie_crash_write(Logcie_Writer *writer, const Logcie_Segment *segment) {
+  if (writer->writev == logcie_fd_writev || writer->writev == logcie_syslog_writev || writer->writev == logcie_net_writev) {
+    writer->writev(writer->data, segment, 1);
+    return;
+  }
+
+  // FILE* can't be used here, but stdout and stderr have well-known fds
+  if (writer->writev == logcie_printf_writev || (writer->writev == NULL && writer->write == logcie_printf_writer)) {
+    FILE *file = writer->data ? (FILE *)writer->data : stdout;
+
+    if (file == stdout || file == stderr) {
+      logcie_fd_writev((void *)(intptr_t)(file == stdout ? 1 : 2), segment, 1);
+    }
+  }
+}
+
+static void logcie_crash_flush(void) {
+  for (size_t i = 0; i < logcie_logger.sinks_len; i++) {
+    Logcie_Sink *sink = logcie_logger.sinks[i];
+
+#ifdef _LOGCIE_THREADS
+    Logcie_Async *async = sink->async;
+
+    // Lock may be held by the crashed thread, so queue is read in place without it.
+    // Worker that is inside the writer owns the writer state, such sink is skipped
+    if (async) {
+      _LOGCIE_ATOMIC_STORE(&async->crashing, 1);
+      _LOGCIE_ATOMIC_FENCE();
+
+      if (_LOGCIE_ATOMIC_LOAD(&async->busy)) {
+        continue;
+      }
+
+      size_t at   = async->tail;
+      size_t head = async->head;
+
+      while (at < head) {
+        size_t             offset = at % LOGCIE_ASYNC_BUFFER;
+        Logcie_AsyncHeader header;
+        memcpy(&header, async->buffer + offset, sizeof(header));
+
+        if (header.len == _LOGCIE_ASYNC_WRAP) {
+          at += LOGCIE_ASYNC_BUFFER - offset;
+          continue;
+        }
+
+        if (header.len > LOGCIE_ASYNC_BUFFER - offset - sizeof(header)) {
+          break;
+        }
+
+        Logcie_Segment segment = {async->buffer + offset + sizeof(header), header.len};
+        logcie_crash_write(&sink->writer, &segment);
+        at += _LOGCIE_ASYNC_RECORD_SIZE(header.len);
+      }
+
+      async->tail = head;
+    }
+#endif
+
+    if (sink->writer.writev == logcie_syslog_writev) {
+      logcie_syslog_flush((Logcie_Syslog *)sink->writer.data);
+    } else if (sink->writer.writev == logcie_net_writev) {
+      logcie_net_flush((Logcie_Net *)sink->writer.data);
+    }
+  }
+}
+
+static void logcie_crash_handler(int sig) {
+  // Crash inside the handler goes straight to the previous handler
+  if (!logcie_crash_active) {
+    logcie_crash_active = 1;
+    logcie_crash_flush();
+  }
+
+  for (size_t i = 0; i < _LOGCIE_CRASH_SIGNALS; i++) {
+    if (logcie_crash_signals[i] == sig) {
+#ifdef SA_RESETHAND
+      sigaction(sig, &logcie_crash_previous[i], NULL);
+#else
+      signal(sig, logcie_crash_previous[i]);
+#endif
+    }
+  }
+
+  // Signal is delivered again once handler returns
+  raise(sig);
 }
 
-LOGCIE_DEF Logcie_Filter logcie_filter_not(Logcie_Filter const filter) {
-  static Logcie_Filter storage;
-  storage = filter;
-  return (Logcie_Filter){logcie_filter_or_fn, &storage};
+LOGCIE_DEF uint8_t logcie_install_crash_handler(void) {
+#ifdef SA_ONSTACK
+  // Stack overflow leaves no stack for the handler, existing alternate stack is kept
+  stack_t current;
+
+  if (sigaltstack(NULL, &current) == 0 && (current.ss_flags & SS_DISABLE)) {
+    stack_t stack;
+    memset(&stack, 0, sizeof(stack));
+    stack.ss_sp   = logcie_crash_stack;
+    stack.ss_size = sizeof(logcie_crash_stack);
+    sigaltstack(&stack, NULL);
+  }
+#endif
+
+  for (size_t i = 0; i < _LOGCIE_CRASH_SIGNALS; i++) {
+#ifdef SA_RESETHAND
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = logcie_crash_handler;
+    action.sa_flags   = SA_RESETHAND;
+#ifdef SA_ONSTACK
+    action.sa_flags |= SA_ONSTACK;
+#endif
+    sigemptyset(&action.sa_mask);
+
+    if (sigaction(logcie_crash_signals[i], &action, &logcie_crash_previous[i]) != 0) {
+      return 0;
+    }
+#else
+    logcie_crash_previous[i] = signal(logcie_crash_signals[i], logcie_crash_handler);
+
+    if (logcie_crash_previous[i] == SIG_ERR) {
+      logcie_crash_previous[i] = SIG_DFL;
+      return 0;
+    }
+#endif
+  }
+
+  return 1;
 }
+#endif
 
-LOGCIE_DEF Logcie_Filter logcie_filter_level_min(Logcie_LogLevel level) {
-  static Logcie_LogLevel storage;
-  storage = level;
-  return (Logcie_Filter){logcie_filter_level_min_fn, &storage};
+LOGCIE_DEF size_t logcie_buffer_writev(void *user_data, const Logcie_Segment *segments, size_t count) {
+  _LOGCIE_ASSERT(user_data, "Buffer writer have nothing to write to");
+  Logcie_Buffer *buffer  = (Logcie_Buffer *)user_data;
+  size_t         written = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    size_t available = buffer->capacity - buffer->len;
+    size_t len       = segments[i].len;
+
+    // Keep one byte for NUL, as logcie_buffer_writer does
+    if (len >= available) {
+      buffer->overflow = 1;
+      len              = available ? available - 1 : 0;
+    }
+
+    memcpy(buffer->data + buffer->len, segments[i].ptr, len);
+    buffer->len += len;
+    written += segments[i].len;
+  }
+
+  if (buffer->len < buffer->capacity) {
+    buffer->data[buffer->len] = '\0';
+  }
+
+  return written;
 }
 
-LOGCIE_DEF Logcie_Filter logcie_filter_level_max(Logcie_LogLevel level) {
-  static Logcie_LogLevel storage;
-  storage = level;
-  return (Logcie_Filter){logcie_filter_level_max_fn, &storage};
+LOGCIE_DEF size_t logcie_buffer_writer(void *user_data, const char *fmt, va_list *va, ...) {
+  _LOGCIE_ASSERT(user_data, "Buffer writer have nothing to write to");
+  Logcie_Buffer *buffer = (Logcie_Buffer *)user_data;
+  va_list        args;
+
+  if (va != NULL) {
+    va_copy(args, *va);
+  } else {
+    va_start(args, va);
+  }
+
+  size_t available = buffer->capacity - buffer->len;
+  int    written   = logcie_vformat(buffer->data + buffer->len, available, fmt, args);
+
+  va_end(args);
+
+  if (written < 0) {
+    return 0;
+  }
+
+  if ((size_t)written >= available) {
+    buffer->overflow = 1;
+    buffer->len      = available ? buffer->capacity - 1 : buffer->len;
+  } else {
+    buffer->len += (size_t)written;
+  }
+
+  return (size_t)written;
 }
 
-LOGCIE_DEF Logcie_Filter logcie_filter_module_eq(const char *module) {
-  return (Logcie_Filter){logcie_filter_message_contains_fn, (void *)module};
+LOGCIE_DEF uint8_t logcie_filter_not_fn(void *data, Logcie_Log *log) {
+  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_not'");
+  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_not'");
+  Logcie_Filter *filter = (Logcie_Filter *)data;
+  return !filter->filter(filter->data, log);
 }
 
-LOGCIE_DEF Logcie_Filter logcie_filter_message_contains(const char *substr) {
-  return (Logcie_Filter){logcie_filter_message_contains_fn, (void *)substr};
+LOGCIE_DEF uint8_t logcie_filter_and_fn(void *data, Logcie_Log *log) {
+  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_and'");
+  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_and'");
+  Logcie_FilterCombinationData *d = (Logcie_FilterCombinationData *)data;
+  return d->a.filter(d->a.data, log) && d->b.filter(d->b.data, log);
 }
 
-LOGCIE_DEF Logcie_Filter logcie_filter_custom(Logcie_FilterCustomPredicateFn *fn) {
-  return (Logcie_Filter){logcie_filter_custom_fn, &fn};
+LOGCIE_DEF uint8_t logcie_filter_or_fn(void *data, Logcie_Log *log) {
+  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_or'");
+  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_or'");
+  Logcie_FilterCombinationData *d = (Logcie_FilterCombinationData *)data;
+  return d->a.filter(d->a.data, log) || d->b.filter(d->b.data, log);
 }
 
-/**
- * @brief Allows customization of log level colors. Must be array of size Count_LOGCIE_LEVEL.
- *
- * Override the default ANSI color codes for each log level. The array must
- * contain exactly Count_LOGCIE_LEVEL (7) elements. Pass NULL to reset to defaults.
- *
- * @param colors Array of ANSI color code strings, one per log level in order:
- *               [TRACE, DEBUG, VERBOSE, INFO, WARN, ERROR, FATAL]
- *               or NULL to reset to defaults
- * @note Colors are applied globally to all sinks using the default formatter
- * @note Custom formatters may ignore these colors
- * @note I can not check if colors array is valid in runtime. I did what I can,
- *       but still try to compile if -fsanitize=address to check if everything is all right
- */
-LOGCIE_DEF void logcie_set_colors(const char **colors);
+LOGCIE_DEF uint8_t logcie_filter_level_min_fn(void *data, Logcie_Log *log) {
+  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_level_min'");
+  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_level_min'");
+  Logcie_LogLevel *level = (Logcie_LogLevel *)data;
+  return log->level >= *level;
+}
 
-#ifdef __cplusplus
-} /* extern "C" */
-#endif
+LOGCIE_DEF uint8_t logcie_filter_level_max_fn(void *data, Logcie_Log *log) {
+  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_level_max'");
+  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_level_max'");
+  Logcie_LogLevel *level = (Logcie_LogLevel *)data;
+  return log->level <= *level;
+}
 
-#endif /* end of include guard: LOGCIE */
+LOGCIE_DEF uint8_t logcie_filter_module_eq_fn(void *data, Logcie_Log *log) {
+  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_module_eq'");
+  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_module_eq'");
+  const char *module = (const char *)data;
+  return log->module && strcmp(module, log->module) == 0;
+}
 
-/* --------------------------------------------- */
+LOGCIE_DEF uint8_t logcie_filter_message_contains_fn(void *data, Logcie_Log *log) {
+  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_message_contains'");
+  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_message_contains'");
+  const char *str = (const char *)data;
+  return log->msg && strstr(log->msg, str);
+}
 
-#ifdef LOGCIE_IMPLEMENTATION
+LOGCIE_DEF uint8_t logcie_filter_custom_fn(void *data, Logcie_Log *log) {
+  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_custom'");
+  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_custom'");
+  Logcie_FilterCustomPredicateFn *predicate = (Logcie_FilterCustomPredicateFn *)data;
+  return predicate(log);
+}
 
-#include <assert.h>
-#include <stdlib.h>
+LOGCIE_DEF uint8_t logcie_filter_pass_fn(void *data, Logcie_Log *log) {
+  (void)data;
+  (void)log;
+  return 1;
+}
 
-static const char *default_module = "Logcie";
+static uint64_t logcie_saturating_add(uint64_t a, uint64_t b) {
+  return a > UINT64_MAX - b ? UINT64_MAX : a + b;
+}
 
-#ifndef _LOGCIE_ASSERT
-#define _LOGCIE_ASSERT(bool, msg) assert(bool &&msg)
-#endif
+// Rate limiter is a GCRA (virtual scheduling form of token bucket): instead of
+// counting tokens, each bucket stores the time when it will be full again. One
+// 64 bit word per bucket makes it possible to update it with a single CAS.
+LOGCIE_DEF uint8_t logcie_filter_rate_limit_fn(void *data, Logcie_Log *log) {
+  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_rate_limit'");
+  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_rate_limit'");
+  Logcie_RateLimit *limit = (Logcie_RateLimit *)data;
+
+  size_t slot = 0;
+
+  if (limit->key == LOGCIE_RATE_LIMIT_PER_MODULE) {
+    const char *module = log->module ? log->module : default_module;
+    slot               = logcie_hash_bytes(_LOGCIE_HASH_INIT, module, strlen(module)) % LOGCIE_RATE_LIMIT_SLOTS;
+  } else if (limit->key == LOGCIE_RATE_LIMIT_PER_CALLSITE) {
+    uint64_t hash = _LOGCIE_HASH_INIT;
+
+    if (log->callsite) {
+      hash = logcie_hash_bytes(hash, &log->callsite, sizeof(log->callsite));
+    } else {
+      hash = logcie_hash_bytes(hash, &log->location.file, sizeof(log->location.file));
+      hash = logcie_hash_bytes(hash, &log->location.line, sizeof(log->location.line));
+    }
 
-#ifdef _LOGCIE_DEBUG
-#if __STDC_VERSION__ >= 201112L  // Check for C11 support
-#define _LOGCIE_DEBUG_ASSERT(bool, msg) static_assert(bool, msg)
-#else
-#define _LOGCIE_DEBUG_ASSERT(bool, msg) _LOGCIE_ASSERT(bool, msg)
-#endif
-#else
-#define _LOGCIE_DEBUG_ASSERT(bool, msg)
-#endif
+    slot = hash % LOGCIE_RATE_LIMIT_SLOTS;
+  }
 
-#ifndef _LOGCIE_ARR_LEN
-#define _LOGCIE_ARR_LEN(array) ((int)sizeof(array) / (int)sizeof((array)[0]))
-#endif
+  uint64_t burst    = limit->burst ? limit->burst : 1;
+  uint64_t interval = limit->per_second ? 1000000000ull / limit->per_second : UINT64_MAX / (burst + 1);
+  uint64_t tolerance = interval * (burst - 1);
 
-static const char *logcie_level_label[] = {
-  "trace",
-  "debug",
-  "verb",
-  "info",
-  "warn",
-  "error",
-  "fatal",
-};
+  uint64_t  now = logcie_now_ns();
+  uint64_t *tat = &limit->tat[slot];
+  uint64_t  old = _LOGCIE_ATOMIC_LOAD(tat);
 
-static inline const char *get_logcie_level_label(Logcie_LogLevel level) {
-  _LOGCIE_DEBUG_ASSERT(Count_LOGCIE_LEVEL == 7, "Forgot to update get_logcie_level_label, you dummy dumb fuck");
-  _LOGCIE_ASSERT(level < Count_LOGCIE_LEVEL, "Unexpected log level");
-  return logcie_level_label[level];
+  for (;;) {
+    if (old > logcie_saturating_add(now, tolerance)) {
+      _LOGCIE_ATOMIC_ADD(&limit->suppressed, 1);
+      return 0;
+    }
+
+    uint64_t next = logcie_saturating_add(old > now ? old : now, interval);
+
+    if (_LOGCIE_ATOMIC_CAS(tat, &old, next)) {
+      return 1;
+    }
+  }
 }
 
-static const char *logcie_level_label_upper[] = {
-  "TRACE",
-  "DEBUG",
-  "VERB",
-  "INFO",
-  "WARN",
-  "ERROR",
-  "FATAL",
-};
+LOGCIE_DEF uint8_t logcie_patterns_compile(Logcie_PatternSet *set, const char *const *patterns, size_t count, uint8_t rendered) {
+  memset(set, 0, sizeof(*set));
+  set->rendered = rendered;
+  set->states   = 1;
+  set->classes  = 1;
 
-static inline const char *get_logcie_level_label_upper(Logcie_LogLevel level) {
-  _LOGCIE_DEBUG_ASSERT(Count_LOGCIE_LEVEL == 7, "Forgot to update get_logcie_level_label, you dummy dumb fuck");
-  _LOGCIE_ASSERT(level < Count_LOGCIE_LEVEL, "Unexpected log level");
-  return logcie_level_label_upper[level];
+  // Build trie. State 0 is root, so 0 in `next` means "no edge" until failure links are built
+  for (size_t i = 0; i < count; i++) {
+    uint16_t state = 0;
+
+    for (const unsigned char *c = (const unsigned char *)patterns[i]; *c; c++) {
+      if (set->byte_class[*c] == 0) {
+        if (set->classes == LOGCIE_PATTERNS_MAX_CLASSES) {
+          return 0;
+        }
+
+        set->byte_class[*c] = set->classes++;
+      }
+
+      uint16_t *edge = &set->next[state][set->byte_class[*c]];
+
+      if (*edge == 0) {
+        if (set->states == LOGCIE_PATTERNS_MAX_STATES) {
+          return 0;
+        }
+
+        *edge = set->states++;
+      }
+
+      state = *edge;
+    }
+
+    set->match[state] = 1;
+  }
+
+  // Breadth-first: failure links of shallower states are complete, so missing
+  // edges are taken from the state failure link points to
+  uint16_t fail[LOGCIE_PATTERNS_MAX_STATES];
+  uint16_t queue[LOGCIE_PATTERNS_MAX_STATES];
+  size_t   head = 0;
+  size_t   tail = 0;
+
+  for (uint8_t c = 0; c < set->classes; c++) {
+    uint16_t child = set->next[0][c];
+
+    if (child) {
+      fail[child]   = 0;
+      queue[tail++] = child;
+    }
+  }
+
+  while (head < tail) {
+    uint16_t state = queue[head++];
+
+    for (uint8_t c = 0; c < set->classes; c++) {
+      uint16_t child = set->next[state][c];
+
+      if (child) {
+        fail[child]        = set->next[fail[state]][c];
+        set->match[child] |= set->match[fail[child]];
+        queue[tail++]      = child;
+      } else {
+        set->next[state][c] = set->next[fail[state]][c];
+      }
+    }
+  }
+
+  for (int b = 0; b < 256; b++) {
+    if (set->next[0][set->byte_class[b]] == 0) {
+      continue;
+    }
+
+    if (set->first_len == sizeof(set->first)) {
+      set->first_len = 0;
+      break;
+    }
+
+    set->first[set->first_len++] = (uint8_t)b;
+  }
+
+  return 1;
 }
 
-static const char *logcie_default_level_color[] = {
-  LOGCIE_COLOR_GRAY,
-  LOGCIE_COLOR_GRAY,
-  LOGCIE_COLOR_GRAY,
-  LOGCIE_COLOR_BLUE,
-  LOGCIE_COLOR_YELLOW,
-  LOGCIE_COLOR_RED,
-  LOGCIE_COLOR_BRIGHT_RED,
-};
+// Returns position of the next byte that can start a pattern
+static size_t logcie_patterns_skip(const Logcie_PatternSet *set, const char *text, size_t i, size_t len) {
+#ifdef _LOGCIE_SSE2
+  if (set->first_len) {
+    __m128i first[4];
+
+    for (uint8_t k = 0; k < set->first_len; k++) {
+      first[k] = _mm_set1_epi8((char)set->first[k]);
+    }
+
+    for (; i + 16 <= len; i += 16) {
+      __m128i chunk = _mm_loadu_si128((const __m128i *)(text + i));
+      __m128i hits  = _mm_cmpeq_epi8(chunk, first[0]);
+
+      for (uint8_t k = 1; k < set->first_len; k++) {
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, first[k]));
+      }
+
+      int mask = _mm_movemask_epi8(hits);
+
+      if (mask) {
+        return i + (size_t)__builtin_ctz((unsigned)mask);
+      }
+    }
+  }
+#endif
+
+  while (i < len && set->next[0][set->byte_class[(unsigned char)text[i]]] == 0) {
+    i++;
+  }
+
+  return i;
+}
+
+LOGCIE_DEF uint8_t logcie_patterns_match(const Logcie_PatternSet *set, const char *text, size_t len) {
+  if (set->match[0]) {
+    return 1;
+  }
 
-static const char **logcie_level_color = logcie_default_level_color;
+  uint16_t state = 0;
+  size_t   i     = 0;
 
-void logcie_set_colors(const char **colors) {
-  if (colors) {
-    // If compiled with -fsanitize=address and colors array is wrong it will crash
-    // If it is compiled without -fsanitize=address then color would be NULL (I hope)
-    const char *color = colors[Count_LOGCIE_LEVEL - 1];
-    _LOGCIE_ASSERT(color != NULL, "Size of array of colors in logcie_set_colors is not equal to Count_LOGCIE_LEVEL");
-    logcie_level_color = colors;
-  } else {
-    logcie_level_color = logcie_default_level_color;
+  while (i < len) {
+    if (state == 0) {
+      i = logcie_patterns_skip(set, text, i, len);
+
+      if (i == len) {
+        break;
+      }
+    }
+
+    state = set->next[state][set->byte_class[(unsigned char)text[i++]]];
+
+    if (set->match[state]) {
+      return 1;
+    }
   }
+
+  return 0;
 }
 
-static inline const char *get_logcie_level_color(Logcie_LogLevel level) {
-  _LOGCIE_DEBUG_ASSERT(Count_LOGCIE_LEVEL == 7, "Forgot to update get_logcie_level_label, you dummy dumb fuck");
-  _LOGCIE_ASSERT(level < Count_LOGCIE_LEVEL, "Unexpected log level");
-  return logcie_level_color[level];
+LOGCIE_DEF uint8_t logcie_filter_patterns_fn(void *data, Logcie_Log *log) {
+  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_patterns'");
+  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_patterns'");
+  Logcie_PatternSet *set = (Logcie_PatternSet *)data;
+
+  if (set->rendered) {
+    size_t      len;
+    const char *message = logcie_log_message(log, &len);
+    return logcie_patterns_match(set, message, len);
+  }
+
+  return log->msg && logcie_patterns_match(set, log->msg, strlen(log->msg));
 }
 
-static Logcie_Sink default_stdout_sink = {
-  .formatter = {logcie_printf_formatter, (void *)("$c$L$r " LOGCIE_COLOR_GRAY "$f:$x$r: $m")},
-  .writer    = {logcie_printf_writer, NULL},
-  .filter    = {NULL, NULL},
-};
+LOGCIE_DEF Logcie_Filter logcie_filter_patterns(Logcie_PatternSet *set) {
+  return (Logcie_Filter){logcie_filter_patterns_fn, set};
+}
 
-static Logcie_Sink *default_stdout_sink_ptr = &default_stdout_sink;
+// Regex is compiled with position (Glushkov) automaton: every character or set in
+// the pattern is a position, parser computes first/last positions of every
+// subexpression and which positions can follow each other. DFA states are then
+// sets of positions, which fit in uint64_t
+#define _LOGCIE_REGEX_POSITIONS 64
+
+typedef struct Logcie_RegexParser {
+  const char *at;
+  const char *end;
+  uint8_t     error;
+  uint8_t     positions;
+  uint8_t     sets[_LOGCIE_REGEX_POSITIONS][32];
+  uint64_t    follow[_LOGCIE_REGEX_POSITIONS];
+} Logcie_RegexParser;
+
+typedef struct Logcie_RegexFragment {
+  uint8_t  nullable;
+  uint64_t first;
+  uint64_t last;
+} Logcie_RegexFragment;
+
+static Logcie_RegexFragment logcie_regex_parse_alt(Logcie_RegexParser *parser);
+
+static void logcie_regex_set_add(uint8_t *set, unsigned char c) {
+  set[c >> 3] |= (uint8_t)(1u << (c & 7));
+}
 
-#if defined(__has_attribute) && __has_attribute(constructor)
-#define __L_ATTR_CONSTRUCT
-#endif
+static uint8_t logcie_regex_set_has(const uint8_t *set, unsigned char c) {
+  return (set[c >> 3] >> (c & 7)) & 1;
+}
 
-#ifdef __L_ATTR_CONSTRUCT
-__attribute__((constructor)) void init_default_stdout_sink(void) {
-  default_stdout_sink.writer.data = stdout;
+static void logcie_regex_follow(Logcie_RegexParser *parser, uint64_t from, uint64_t to) {
+  for (uint8_t i = 0; i < parser->positions; i++) {
+    if ((from >> i) & 1) {
+      parser->follow[i] |= to;
+    }
+  }
 }
-#endif
 
-typedef struct Logcie_Logger {
-  Logcie_Sink **sinks;
-  size_t        sinks_len;
-  size_t        sinks_cap;
-} Logcie_Logger;
+// Adds \d, \w, \s (and negations) or escaped literal to the set
+static void logcie_regex_escape(uint8_t *set, unsigned char c) {
+  for (int b = 1; b < 256; b++) {
+    uint8_t in;
 
-// INFO: By default there is one default sink to allow logging right
-//       after includnig Logcie without initializing anything
-static Logcie_Logger logcie = {
-  .sinks     = &default_stdout_sink_ptr,
-  .sinks_len = 1,
-  .sinks_cap = 1,
-};
+    switch (tolower(c)) {
+      case 'd': in = isdigit(b) != 0; break;
+      case 'w': in = isalnum(b) || b == '_'; break;
+      case 's': in = isspace(b) != 0; break;
+      default: in = b == c; break;
+    }
 
-size_t logcie_get_sink_count(void) {
-  return logcie.sinks_len;
+    if (isupper(c) && strchr("DWS", c)) {
+      in = !in;
+    }
+
+    if (in) {
+      logcie_regex_set_add(set, (unsigned char)b);
+    }
+  }
 }
 
-Logcie_Sink *logcie_get_sink(size_t index) {
-  if (index >= logcie.sinks_len) {
-    return NULL;
+static uint8_t logcie_regex_class(uint8_t *set, const char *name, size_t len) {
+  static const struct {
+    const char *name;
+    int (*is)(int);
+  } classes[] = {
+    {"alpha", isalpha}, {"digit", isdigit}, {"alnum", isalnum}, {"space", isspace}, {"upper", isupper},
+    {"lower", islower}, {"punct", ispunct},  {"xdigit", isxdigit}, {"print", isprint}, {"cntrl", iscntrl},
+  };
+
+  for (int i = 0; i < _LOGCIE_ARR_LEN(classes); i++) {
+    if (strlen(classes[i].name) == len && strncmp(classes[i].name, name, len) == 0) {
+      for (int b = 1; b < 256; b++) {
+        if (classes[i].is(b)) {
+          logcie_regex_set_add(set, (unsigned char)b);
+        }
+      }
+
+      return 1;
+    }
   }
 
-  return logcie.sinks[index];
+  return 0;
 }
 
-uint8_t logcie_add_sink(Logcie_Sink *sink) {
-  if (sink == NULL) {
-    return 0;
+static void logcie_regex_bracket(Logcie_RegexParser *parser, uint8_t *set) {
+  uint8_t negate = 0;
+
+  if (parser->at < parser->end && *parser->at == '^') {
+    negate = 1;
+    parser->at++;
   }
 
-#ifndef __L_ATTR_CONSTRUCT
-  if (sink->writer.data == NULL)
-    sink->writer.data = stdout;
-#endif
+  for (uint8_t first = 1; parser->at < parser->end && (first || *parser->at != ']'); first = 0) {
+    unsigned char lo = (unsigned char)*parser->at++;
+
+    if (lo == '[' && parser->at < parser->end && *parser->at == ':') {
+      const char *name  = parser->at + 1;
+      const char *close = name;
+
+      while (close + 1 < parser->end && !(close[0] == ':' && close[1] == ']')) {
+        close++;
+      }
+
+      if (close + 1 >= parser->end || !logcie_regex_class(set, name, (size_t)(close - name))) {
+        parser->error = 1;
+        return;
+      }
+
+      parser->at = close + 2;
+      continue;
+    }
+
+    if (lo == '\\' && parser->at < parser->end) {
+      logcie_regex_escape(set, (unsigned char)*parser->at++);
+      continue;
+    }
 
-  if (logcie.sinks_cap == 1) {
-    logcie.sinks_cap = 8;
-    logcie.sinks_len = 0;
-    logcie.sinks     = (Logcie_Sink **)malloc(sizeof(*logcie.sinks) * logcie.sinks_cap);
+    unsigned char hi = lo;
+
+    if (parser->at + 1 < parser->end && parser->at[0] == '-' && parser->at[1] != ']') {
+      hi = (unsigned char)parser->at[1];
+      parser->at += 2;
+    }
+
+    for (int b = lo; b <= hi; b++) {
+      logcie_regex_set_add(set, (unsigned char)b);
+    }
   }
 
-  if (logcie.sinks_cap == logcie.sinks_len) {
-    logcie.sinks_cap *= 2;
-    logcie.sinks = (Logcie_Sink **)realloc(logcie.sinks, sizeof(*logcie.sinks) * logcie.sinks_cap);
+  if (parser->at == parser->end) {
+    parser->error = 1;
+    return;
   }
 
-  logcie.sinks[logcie.sinks_len] = sink;
-  logcie.sinks_len++;
+  parser->at++;
 
-  return 1;
-}
+  if (negate) {
+    for (int i = 0; i < 32; i++) {
+      set[i] = (uint8_t)~set[i];
+    }
 
-uint8_t logcie_remove_sink(Logcie_Sink *sink) {
-  if (sink == &default_stdout_sink) {
-    return 0;  // unreachable
+    set[0] &= (uint8_t)~1u;
   }
+}
 
-  for (size_t i = 0; i < logcie.sinks_len; i++) {
-    if (logcie.sinks[i] == sink) {
-      return logcie_remove_sink_by_index(i);
+static Logcie_RegexFragment logcie_regex_parse_atom(Logcie_RegexParser *parser) {
+  Logcie_RegexFragment fragment = {1, 0, 0};
+  char                 c        = *parser->at++;
+
+  if (c == '(') {
+    fragment = logcie_regex_parse_alt(parser);
+
+    if (parser->at == parser->end || *parser->at != ')') {
+      parser->error = 1;
+    } else {
+      parser->at++;
     }
-  }
 
-  return 0;
-}
+    return fragment;
+  }
 
-uint8_t logcie_remove_sink_by_index(size_t index) {
-  if (index >= logcie.sinks_len) {
-    return 0;
+  if (strchr(")*+?{^$", c) || parser->positions == _LOGCIE_REGEX_POSITIONS - 1) {
+    parser->error = 1;
+    return fragment;
   }
 
-  if (logcie.sinks_cap == 1 && index == 0) {
-    return 0;
+  uint8_t  position = parser->positions++;
+  uint8_t *set      = parser->sets[position];
+  memset(set, 0, sizeof(parser->sets[position]));
+
+  if (c == '.') {
+    memset(set, 0xFF, sizeof(parser->sets[position]));
+    set[0] &= (uint8_t)~1u;
+  } else if (c == '[') {
+    logcie_regex_bracket(parser, set);
+  } else if (c == '\\' && parser->at < parser->end) {
+    logcie_regex_escape(set, (unsigned char)*parser->at++);
+  } else {
+    logcie_regex_set_add(set, (unsigned char)c);
   }
 
-  for (size_t i = index; i < logcie.sinks_len; i++) {
-    logcie.sinks[i] = logcie.sinks[i + 1];
+  fragment.nullable = 0;
+  fragment.first    = 1ull << position;
+  fragment.last     = 1ull << position;
+  return fragment;
+}
+
+static Logcie_RegexFragment logcie_regex_parse_repeat(Logcie_RegexParser *parser) {
+  Logcie_RegexFragment fragment = logcie_regex_parse_atom(parser);
+
+  while (!parser->error && parser->at < parser->end && strchr("*+?", *parser->at)) {
+    char op = *parser->at++;
+
+    if (op != '?') {
+      logcie_regex_follow(parser, fragment.last, fragment.first);
+    }
+
+    if (op != '+') {
+      fragment.nullable = 1;
+    }
   }
 
-  logcie.sinks_len--;
-  return 1;
+  return fragment;
 }
 
-uint8_t logcie_remove_and_free_sink(Logcie_Sink *sink) {
-  if (logcie_remove_sink(sink)) {
-    free(sink);
-    return 1;
+static Logcie_RegexFragment logcie_regex_parse_concat(Logcie_RegexParser *parser) {
+  Logcie_RegexFragment result = {1, 0, 0};
+
+  while (!parser->error && parser->at < parser->end && *parser->at != '|' && *parser->at != ')') {
+    Logcie_RegexFragment next = logcie_regex_parse_repeat(parser);
+    logcie_regex_follow(parser, result.last, next.first);
+
+    result.first    = result.nullable ? result.first | next.first : result.first;
+    result.last     = next.nullable ? result.last | next.last : next.last;
+    result.nullable = result.nullable && next.nullable;
   }
 
-  return 0;
+  return result;
 }
 
-void logcie_remove_all_sinks(void) {
-  if (logcie.sinks_cap > 1) {
-    free(logcie.sinks);
-    logcie.sinks_cap = 1;
-    logcie.sinks_len = 1;
-    logcie.sinks     = &default_stdout_sink_ptr;
-    return;
+static Logcie_RegexFragment logcie_regex_parse_alt(Logcie_RegexParser *parser) {
+  Logcie_RegexFragment result = logcie_regex_parse_concat(parser);
+
+  while (!parser->error && parser->at < parser->end && *parser->at == '|') {
+    parser->at++;
+    Logcie_RegexFragment next = logcie_regex_parse_concat(parser);
+
+    result.nullable = result.nullable || next.nullable;
+    result.first |= next.first;
+    result.last |= next.last;
   }
+
+  return result;
 }
 
-size_t logcie_log(Logcie_Log log, const char *fmt, ...) {
-  va_list args;
-  va_start(args, fmt);
+LOGCIE_DEF uint8_t logcie_regex_compile(Logcie_Regex *re, const char *pattern, Logcie_RegexTarget target) {
+  _LOGCIE_ASSERT(re && pattern, "Regex and pattern must be present");
+  memset(re, 0, sizeof(*re));
+  re->target = target;
 
-  log.msg = fmt;
+  Logcie_RegexParser parser;
+  memset(&parser, 0, sizeof(parser));
+  parser.at  = pattern;
+  parser.end = pattern + strlen(pattern);
 
-  for (size_t i = 0; i < logcie.sinks_len; i++) {
-    Logcie_Sink *sink = logcie.sinks[i];
-    _LOGCIE_ASSERT(sink && sink->formatter.format, "Sink have no formatter");
+  uint8_t anchored_start = *parser.at == '^';
+  parser.at += anchored_start;
 
-    if (sink->filter.filter && !sink->filter.filter(sink->filter.data, &log)) {
-      continue;
-    }
+  // Trailing '$' is an anchor unless it is escaped
+  const char *escape = parser.end - 1;
 
-    va_list args_copy;
-    va_copy(args_copy, args);
+  while (escape > parser.at && escape[-1] == '\\') {
+    escape--;
+  }
+
+  if (parser.end > parser.at && parser.end[-1] == '$' && (parser.end - 1 - escape) % 2 == 0) {
+    re->anchored_end = 1;
+    parser.end--;
+  }
 
-    sink->formatter.format(&sink->writer, sink->formatter.data, log, &args_copy);
+  Logcie_RegexFragment root = logcie_regex_parse_alt(&parser);
 
-    va_end(args_copy);
+  if (parser.error || parser.at != parser.end) {
+    return 0;
   }
 
-  va_end(args);
-  return 0;
-}
+  // Position after the last one marks the end of pattern
+  uint64_t accept = 1ull << parser.positions;
+  logcie_regex_follow(&parser, root.last, accept);
+  uint64_t start = root.nullable ? root.first | accept : root.first;
 
-size_t logcie_printf_formatter(Logcie_Writer *writer, void *data, Logcie_Log log, va_list *args) {
-  const char *fmt = (const char *)data;
-  _LOGCIE_ASSERT(writer, "Sink have no writer");
-  _LOGCIE_ASSERT(writer->data, "printf sink have nowhere to print");
+  // Bytes that belong to the same positions are indistinguishable
+  uint64_t membership[256];
+  uint8_t  representative[LOGCIE_REGEX_MAX_CLASSES];
 
-  size_t output_len = 0;
-  size_t last_len   = 0;
+  for (int b = 0; b < 256; b++) {
+    membership[b] = 0;
 
-  struct tm local_tm = *localtime(&log.time);
-  struct tm utc_tm   = *gmtime(&log.time);
+    for (uint8_t i = 0; i < parser.positions; i++) {
+      membership[b] |= (uint64_t)logcie_regex_set_has(parser.sets[i], (unsigned char)b) << i;
+    }
 
-  int32_t local_hours = local_tm.tm_hour;
-  int32_t timediff    = (int32_t)difftime(mktime(&local_tm), mktime(&utc_tm)) / 3600;
+    uint8_t c = 0;
 
-  while (*fmt != '\0') {
-    if (*fmt != '$') {
-      output_len += writer->write(writer->data, "%c", NULL, *fmt);
-      fmt++;
-      continue;
+    while (c < re->classes && membership[representative[c]] != membership[b]) {
+      c++;
     }
 
-    fmt++;
+    if (c == re->classes) {
+      if (re->classes == LOGCIE_REGEX_MAX_CLASSES) {
+        return 0;
+      }
 
-    if (*fmt == '\0') {
-      break;
+      representative[re->classes++] = (uint8_t)b;
     }
 
-    switch (*fmt) {
-      case '$':
-        last_len = writer->write(writer->data, "$", NULL);
-        break;
-      case 'm':
-        last_len = writer->write(writer->data, log.msg, args);
-        break;
-      case 'l':
-        last_len = writer->write(writer->data, "%s", NULL, get_logcie_level_label(log.level));
-        break;
-      case 'L':
-        last_len = writer->write(writer->data, "%s", NULL, get_logcie_level_label_upper(log.level));
-        break;
-      case 'c':
-        last_len = writer->write(writer->data, "%s", NULL, get_logcie_level_color(log.level));
-        break;
-      case 'r':
-        last_len = writer->write(writer->data, LOGCIE_COLOR_RESET, NULL);
-        break;
-      case 'd':
-        last_len = writer->write(writer->data, "%d-%02d-%02d", NULL, local_tm.tm_year + 1900, local_tm.tm_mon + 1, local_tm.tm_mday);
-        break;
-      case 't':
-        last_len = writer->write(writer->data, "%02d:%02d:%02d", NULL, local_hours, local_tm.tm_min, local_tm.tm_sec);
-        break;
-      case 'z':
-        last_len = writer->write(writer->data, "%+d", NULL, timediff);
-        break;
-      case 'f':
-        last_len = writer->write(writer->data, "%s", NULL, log.location.file);
-        break;
-      case 'x':
-        last_len = writer->write(writer->data, "%u", NULL, log.location.line);
-        break;
-      case 'M':
-        last_len = writer->write(writer->data, "%s", NULL, log.module ? log.module : default_module);
-        break;
-      case '<': {
-        fmt++;
-        uint16_t target = 0;
+    re->byte_class[b] = c;
+  }
 
-        while (*fmt >= '0' && *fmt <= '9') {
-          target = target * 10 + (*fmt - '0');
-          fmt++;
+  uint64_t states[LOGCIE_REGEX_MAX_STATES];
+  states[0]  = start;
+  re->states = 1;
+
+  for (uint8_t state = 0; state < re->states; state++) {
+    re->accept[state] = (states[state] & accept) != 0;
+
+    for (uint8_t c = 0; c < re->classes; c++) {
+      uint64_t next = anchored_start ? 0 : start;
+
+      for (uint8_t i = 0; i < parser.positions; i++) {
+        if (((states[state] & membership[representative[c]]) >> i) & 1) {
+          next |= parser.follow[i];
         }
+      }
 
-        int16_t pad = target - last_len - 1;
+      uint8_t found = 0;
 
-        if (pad > 0) {
-          last_len = writer->write(writer->data, "%*s", NULL, pad, "");
+      while (found < re->states && states[found] != next) {
+        found++;
+      }
+
+      if (found == re->states) {
+        if (re->states == LOGCIE_REGEX_MAX_STATES) {
+          return 0;
         }
 
-        fmt--;
-        break;
+        states[re->states++] = next;
       }
-      default:
-        fprintf(stderr, "%sWARN: unknown format sequence '$%c'. Skipping...\n" LOGCIE_COLOR_RESET, get_logcie_level_color(LOGCIE_LEVEL_WARN), *fmt);
-        break;
-    }
 
-    output_len += last_len;
-    fmt++;
+      re->next[state][c] = found;
+    }
   }
 
-  output_len += writer->write(writer->data, "\n", NULL);
-  return output_len;
+  return 1;
 }
 
-// TODO: logcie_writer_flush()???
+LOGCIE_DEF uint8_t logcie_regex_match(const Logcie_Regex *re, const char *text, size_t len) {
+  uint8_t state = 0;
 
-LOGCIE_DEF size_t logcie_printf_writer(void *user_data, const char *fmt, va_list *va, ...) {
-  _LOGCIE_ASSERT(user_data, "Printf writer have nothing to write to");
-  FILE   *file = (FILE *)user_data;
-  va_list args;
+  for (size_t i = 0; i < len; i++) {
+    if (re->accept[state] && !re->anchored_end) {
+      return 1;
+    }
 
-  if (va != NULL) {
-    va_copy(args, *va);
-  } else {
-    va_start(args, va);
+    state = re->next[state][re->byte_class[(unsigned char)text[i]]];
   }
 
-  size_t written = vfprintf(file, fmt, args);
-
-  va_end(args);
-  return written;
-}
-
-LOGCIE_DEF uint8_t logcie_filter_not_fn(void *data, Logcie_Log *log) {
-  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_not'");
-  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_not'");
-  Logcie_Filter *filter = (Logcie_Filter *)data;
-  return !filter->filter(filter->data, log);
+  return re->accept[state];
 }
 
-LOGCIE_DEF uint8_t logcie_filter_and_fn(void *data, Logcie_Log *log) {
-  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_and'");
-  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_and'");
-  Logcie_FilterCombinationData *d = (Logcie_FilterCombinationData *)data;
-  return d->a.filter(d->a.data, log) && d->b.filter(d->b.data, log);
-}
+LOGCIE_DEF uint8_t logcie_filter_regex_fn(void *data, Logcie_Log *log) {
+  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_regex'");
+  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_regex'");
+  Logcie_Regex *re = (Logcie_Regex *)data;
 
-LOGCIE_DEF uint8_t logcie_filter_or_fn(void *data, Logcie_Log *log) {
-  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_or'");
-  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_or'");
-  Logcie_FilterCombinationData *d = (Logcie_FilterCombinationData *)data;
-  return d->a.filter(d->a.data, log) || d->b.filter(d->b.data, log);
-}
+  const char *text = NULL;
+  size_t      len  = 0;
 
-LOGCIE_DEF uint8_t logcie_filter_level_min_fn(void *data, Logcie_Log *log) {
-  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_level_min'");
-  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_level_min'");
-  Logcie_LogLevel *level = (Logcie_LogLevel *)data;
-  return log->level >= *level;
-}
+  switch (re->target) {
+    case LOGCIE_REGEX_MESSAGE:
+      text = logcie_log_message(log, &len);
+      return logcie_regex_match(re, text, len);
+    case LOGCIE_REGEX_FORMAT:
+      text = log->msg;
+      break;
+    case LOGCIE_REGEX_MODULE:
+      text = log->module ? log->module : default_module;
+      break;
+    case LOGCIE_REGEX_FILE:
+      text = log->location.file;
+      break;
+  }
 
-LOGCIE_DEF uint8_t logcie_filter_level_max_fn(void *data, Logcie_Log *log) {
-  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_level_max'");
-  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_level_max'");
-  Logcie_LogLevel *level = (Logcie_LogLevel *)data;
-  return log->level <= *level;
+  return text && logcie_regex_match(re, text, strlen(text));
 }
 
-LOGCIE_DEF uint8_t logcie_filter_module_eq_fn(void *data, Logcie_Log *log) {
-  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_module_eq'");
-  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_module_eq'");
-  const char *module = (const char *)data;
-  return log->module && strcmp(module, log->module) == 0;
+LOGCIE_DEF Logcie_Filter logcie_filter_regex(Logcie_Regex *re) {
+  return (Logcie_Filter){logcie_filter_regex_fn, re};
 }
 
-LOGCIE_DEF uint8_t logcie_filter_message_contains_fn(void *data, Logcie_Log *log) {
-  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_message_contains'");
-  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_message_contains'");
-  const char *str = (const char *)data;
-  return log->msg && strstr(log->msg, str);
+LOGCIE_DEF Logcie_Filter logcie_filter_rate_limit(Logcie_RateLimit *limit) {
+  return (Logcie_Filter){logcie_filter_rate_limit_fn, limit};
 }
 
-LOGCIE_DEF uint8_t logcie_filter_custom_fn(void *data, Logcie_Log *log) {
-  _LOGCIE_ASSERT(data, "Param 'data' is not present for filter 'logcie_filter_custom'");
-  _LOGCIE_ASSERT(log, "Param 'log' is not present for filter 'logcie_filter_custom'");
-  Logcie_FilterCustomPredicateFn *predicate = (Logcie_FilterCustomPredicateFn *)data;
-  return predicate(log);
+LOGCIE_DEF uint64_t logcie_rate_limit_suppressed(Logcie_RateLimit *limit) {
+  return _LOGCIE_ATOMIC_LOAD(&limit->suppressed);
 }
 
 // TODO: Abiblity to accept custom stuff in logging (logging arrays)
@@ -0,0 +1,1386 @@
+/*
+ * Logcie C++ front-end (Single Header)
+ *
+ * Description:
+ *   Type-safe interface to logcie.h for C++11 and newer. Arguments are passed
+ *   through variadic templates instead of `va_list`, so every argument is
+ *   formatted by a function picked at compile time and written straight into
+ *   the render buffer. Logs go through the same sinks, filters and formatters
+ *   as LOGCIE_* macros.
+ *
+ * Basic usage:
+ *   #define LOGCIE_IMPLEMENTATION
+ *   #include "logcie.hpp"
+ *
+ *   logcie::info("Hello from {}", "Logcie");
+ *   logcie::warn("x={} y={:.2} mask={:x}", x, y, mask);
+ *
+ * Format syntax:
+ *   `{}` is replaced with the next argument, `{{` and `}}` are literal braces.
+ *   Field may have a spec: `{:[<|>][width][.precision][type]}`
+ *     <, >       Align left or right inside `width` (numbers are right aligned by default)
+ *     precision  Significant digits for floating point (digits after the point for f and e),
+ *                max length for strings
+ *     type       d, x, X, c for integers; f, e, g for floating point; s; p for pointers
+ *   Floating point numbers without spec are printed as `%g`.
+ *   Messages longer than LOGCIE_MESSAGE_MAX are rendered again into a buffer of
+ *   LOGCIE_LINE_MAX bytes; longer ones are truncated.
+ *
+ * Compile-time checks:
+ *   Number of fields, their syntax and spec/argument compatibility are checked
+ *   while compiling:
+ *     C++20         for every literal format, `logcie::info("x={}", x)`
+ *     C++11/14/17   for formats wrapped in LOGCIE_FMT, `logcie::info(LOGCIE_FMT("x={}"), x)`
+ *   Other formats are checked while rendering: fields without arguments are
+ *   printed as is, extra arguments and unsupported specs are ignored.
+ *   Argument types are always checked at compile time: a type without
+ *   logcie::formatter specialization is an error.
+ *   Checks use constexpr recursion, so checked formats are limited by
+ *   compiler's constexpr depth (512 characters by default).
+ *
+ * Custom types:
+ *   ```cpp
+ *   template <> struct logcie::formatter<Point> {
+ *     static constexpr logcie::Kind kind = logcie::Kind::Custom;
+ *     static void format(Logcie_Buffer &out, const Point &p, const logcie::FormatSpec &spec) {
+ *       logcie::format_to(out, "({}, {})", p.x, p.y);
+ *     }
+ *   };
+ *   ```
+ *
+ * Pipelines:
+ *   logcie::Pipeline<Filter, Formatter, Writer...> is a sink whose parts are
+ *   known at compile time and called directly. logcie::Format parses `$`
+ *   format of logcie_printf_formatter while compiling. Pipeline can be
+ *   registered as a regular sink with `logcie_add_sink(pipeline.sink())`.
+ *   ```cpp
+ *   static auto console = logcie::make_pipeline(logcie::MinLevel<LOGCIE_LEVEL_INFO>(),
+ *                                               logcie::format(LOGCIE_FMT("[$L] $f:$x $m")),
+ *                                               logcie::FileWriter(stdout));
+ *   logcie_add_sink(console.sink());
+ *   ```
+ *
+ * Author: Nikita (Strongleong) Chulkov nikita_chul@mail.ru
+ * License: MIT
+ */
+
+#ifndef LOGCIE_HPP
+#define LOGCIE_HPP
+
+#if !defined(__cplusplus) || __cplusplus < 201103L
+#error "logcie.hpp requires C++11 or newer"
+#endif
+
+#ifndef LOGCIE
+#include "logcie.h"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<string_view>)
+#include <string_view>
+#define _LOGCIE_HPP_STRING_VIEW
+#endif
+#endif
+
+#if defined(__cpp_consteval) && __cpp_consteval >= 201811L
+#define _LOGCIE_HPP_CONSTEVAL
+#endif
+
+// Location of the caller is taken from default arguments, since there is no macro at the call site
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_FILE) && __has_builtin(__builtin_LINE)
+#define _LOGCIE_HPP_LOCATION
+#endif
+#elif defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 8))
+#define _LOGCIE_HPP_LOCATION
+#endif
+
+#ifdef _LOGCIE_HPP_LOCATION
+#define _LOGCIE_HPP_FILE __builtin_FILE()
+#define _LOGCIE_HPP_LINE __builtin_LINE()
+#else
+#define _LOGCIE_HPP_FILE ""
+#define _LOGCIE_HPP_LINE 0
+#endif
+
+/**
+ * @brief Wraps a literal format so it is checked at compile time before C++20.
+ *
+ * @code
+ * logcie::info(LOGCIE_FMT("{} of {}"), done, total);
+ * @endcode
+ */
+#define LOGCIE_FMT(fmt)                                               \
+  [] {                                                                \
+    struct Logcie_CompiledFormat : ::logcie::detail::CompiledString { \
+      static constexpr const char *value() {                          \
+        return fmt;                                                   \
+      }                                                               \
+    };                                                                \
+    return Logcie_CompiledFormat();                                   \
+  }()
+
+namespace logcie {
+
+/**
+ * @brief Parsed spec of a replacement field, `{:[<|>][width][.precision][type]}`
+ *
+ * @field align      '<', '>' or 0 if not set
+ * @field width      Minimal width of the field (0 if not set)
+ * @field precision  Precision or -1 if not set
+ * @field type       Type character or 0 if not set
+ */
+struct FormatSpec {
+  char     align;
+  unsigned width;
+  int      precision;
+  char     type;
+};
+
+/**
+ * @brief Category of an argument type. Decides which specs it accepts.
+ *
+ * @value Unsupported  Type has no formatter
+ * @value Integer      d, x, X, c
+ * @value Char         d, x, X, c
+ * @value Bool         d, x, X, s
+ * @value Floating     f, e, g, precision
+ * @value String       s, precision
+ * @value Pointer      p
+ * @value Custom       Any spec, formatter interprets it
+ */
+enum class Kind {
+  Unsupported,
+  Integer,
+  Char,
+  Bool,
+  Floating,
+  String,
+  Pointer,
+  Custom,
+};
+
+/**
+ * @brief Formats values of type `T`. Specialize it to log your own types.
+ *
+ * Specialization must have `static constexpr Kind kind` and
+ * `static void format(Logcie_Buffer &out, const T &value, const FormatSpec &spec)`.
+ * Width and alignment are applied by the caller.
+ */
+template <class T, class Enable = void>
+struct formatter {
+  static constexpr Kind kind = Kind::Unsupported;
+};
+
+/**
+ * @brief Appends bytes to the buffer. Output that doesn't fit is truncated and sets `overflow`.
+ */
+inline void append(Logcie_Buffer &out, const char *data, size_t len) {
+  size_t room = out.capacity - out.len - 1;
+
+  if (len > room) {
+    len          = room;
+    out.overflow = 1;
+  }
+
+  std::memcpy(out.data + out.len, data, len);
+  out.len += len;
+}
+
+namespace detail {
+
+template <class T>
+struct identity {
+  typedef T type;
+};
+
+// Base of formats created by LOGCIE_FMT
+struct CompiledString {};
+
+template <class T>
+constexpr Kind kind_of() {
+  return formatter<typename std::decay<T>::type>::kind;
+}
+
+// Everything below works on a format string and an index in it, with single
+// return statement per function so it can be evaluated by C++11 compilers
+
+constexpr bool is_digit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+constexpr bool is_type(char c) {
+  return c == 'd' || c == 'x' || c == 'X' || c == 'c' || c == 'f' || c == 'e' || c == 'g' || c == 's' || c == 'p';
+}
+
+constexpr size_t skip_digits(const char *s, size_t i) {
+  return is_digit(s[i]) ? skip_digits(s, i + 1) : i;
+}
+
+constexpr bool has_char(const char *s, size_t i, size_t end, char c) {
+  return i < end && (s[i] == c || has_char(s, i + 1, end, c));
+}
+
+// Position of the next field '{', stray '}' or terminating NUL. Escaped braces are skipped
+constexpr size_t next_field(const char *s, size_t i) {
+  return s[i] == '\0'                                           ? i
+       : (s[i] == '{' || s[i] == '}') && s[i + 1] == s[i]       ? next_field(s, i + 2)
+       : s[i] == '{' || s[i] == '}'                             ? i
+                                                                : next_field(s, i + 1);
+}
+
+constexpr size_t spec_align(const char *s, size_t i) {
+  return s[i] == '<' || s[i] == '>' ? i + 1 : i;
+}
+
+constexpr size_t spec_precision(const char *s, size_t i) {
+  return s[i] == '.' && is_digit(s[i + 1]) ? skip_digits(s, i + 1) : i;
+}
+
+constexpr size_t spec_type(const char *s, size_t i) {
+  return is_type(s[i]) ? i + 1 : i;
+}
+
+constexpr size_t spec_close(const char *s, size_t i) {
+  return s[i] == '}' ? i : 0;
+}
+
+// Position of '}' that closes field starting at `i`, 0 if field is malformed
+constexpr size_t field_end(const char *s, size_t i) {
+  return s[i + 1] == '}'   ? i + 1
+       : s[i + 1] != ':'   ? 0
+                           : spec_close(s, spec_type(s, spec_precision(s, skip_digits(s, spec_align(s, i + 2)))));
+}
+
+constexpr bool type_accepts(Kind kind, char type) {
+  return type == 0 || kind == Kind::Custom
+      || ((type == 'd' || type == 'x' || type == 'X') && (kind == Kind::Integer || kind == Kind::Char || kind == Kind::Bool))
+      || (type == 'c' && (kind == Kind::Integer || kind == Kind::Char))
+      || ((type == 'f' || type == 'e' || type == 'g') && kind == Kind::Floating)
+      || (type == 's' && (kind == Kind::String || kind == Kind::Bool))
+      || (type == 'p' && kind == Kind::Pointer);
+}
+
+constexpr bool precision_accepts(Kind kind) {
+  return kind == Kind::Floating || kind == Kind::String || kind == Kind::Custom;
+}
+
+// Checks spec of field [i, end] against argument kind
+constexpr bool field_accepts(const char *s, size_t i, size_t end, Kind kind) {
+  return end != 0
+      && type_accepts(kind, end > i + 1 && is_type(s[end - 1]) ? s[end - 1] : 0)
+      && (!has_char(s, i, end, '.') || precision_accepts(kind));
+}
+
+template <class... Args>
+struct Checker;
+
+template <>
+struct Checker<> {
+  static constexpr bool check(const char *s, size_t i) {
+    return s[next_field(s, i)] == '\0';
+  }
+};
+
+template <class Arg, class... Rest>
+struct Checker<Arg, Rest...> {
+  static constexpr bool check(const char *s, size_t i) {
+    return check_field(s, next_field(s, i));
+  }
+
+  static constexpr bool check_field(const char *s, size_t i) {
+    return s[i] == '{' && check_spec(s, i, field_end(s, i));
+  }
+
+  static constexpr bool check_spec(const char *s, size_t i, size_t end) {
+    return field_accepts(s, i, end, kind_of<Arg>()) && Checker<Rest...>::check(s, end + 1);
+  }
+};
+
+template <class... Args>
+struct Supported;
+
+template <>
+struct Supported<> {
+  static constexpr bool value = true;
+};
+
+template <class Arg, class... Rest>
+struct Supported<Arg, Rest...> {
+  static constexpr bool value = kind_of<Arg>() != Kind::Unsupported && Supported<Rest...>::value;
+};
+
+#ifdef _LOGCIE_HPP_CONSTEVAL
+// Not constexpr: calling it from consteval constructor stops compilation
+inline void format_string_does_not_match_arguments() {}
+#endif
+
+// Argument with its type erased, points to the caller's object
+struct Arg {
+  const void *value;
+  void (*format)(Logcie_Buffer &out, const void *value, const FormatSpec &spec);
+  Kind kind;
+};
+
+template <class T>
+void format_erased(Logcie_Buffer &out, const void *value, const FormatSpec &spec) {
+  formatter<T>::format(out, *static_cast<const T *>(value), spec);
+}
+
+template <size_t N>
+void format_char_array(Logcie_Buffer &out, const void *value, const FormatSpec &spec) {
+  const char *str = static_cast<const char *>(value);
+  const char *end = static_cast<const char *>(std::memchr(str, '\0', N));
+  size_t      len = end ? (size_t)(end - str) : N;
+
+  if (spec.precision >= 0 && (size_t)spec.precision < len) {
+    len = (size_t)spec.precision;
+  }
+
+  append(out, str, len);
+}
+
+template <class T>
+Arg make_arg(const T &value) {
+  return Arg{&value, &format_erased<T>, formatter<T>::kind};
+}
+
+template <size_t N>
+Arg make_arg(const char (&value)[N]) {
+  return Arg{value, &format_char_array<N>, Kind::String};
+}
+
+template <class T>
+inline bool is_negative(T value, std::true_type) {
+  return value < 0;
+}
+
+template <class T>
+inline bool is_negative(T, std::false_type) {
+  return false;
+}
+
+template <class T>
+void format_integer(Logcie_Buffer &out, T value, char type) {
+  typedef typename std::make_unsigned<T>::type Unsigned;
+
+  char     digits[3 * sizeof(T) + 2];
+  char    *end      = digits + sizeof(digits);
+  char    *p        = end;
+  bool     negative = is_negative(value, std::is_signed<T>());
+  Unsigned u        = negative ? (Unsigned)(0 - (Unsigned)value) : (Unsigned)value;
+
+  if (type == 'x' || type == 'X') {
+    const char *hex = type == 'x' ? "0123456789abcdef" : "0123456789ABCDEF";
+
+    do {
+      *--p = hex[u & 15];
+      u >>= 4;
+    } while (u);
+  } else {
+    do {
+      *--p = (char)('0' + u % 10);
+      u /= 10;
+    } while (u);
+  }
+
+  if (negative) {
+    *--p = '-';
+  }
+
+  append(out, p, (size_t)(end - p));
+}
+
+// Floating point goes through logcie_format kernels, which print fixed precision without libc
+template <class T>
+void format_floating(Logcie_Buffer &out, T value, const FormatSpec &spec) {
+  char        conversion[] = {'%', '.', '*', 'L', spec.type ? spec.type : 'g', '\0'};
+  const char *fmt          = conversion;
+  int         precision    = spec.precision >= 0 ? spec.precision : 6;
+  size_t      room         = out.capacity - out.len;
+  int         written;
+
+  if (std::is_same<T, long double>::value) {
+    written = logcie_format(out.data + out.len, room, fmt, precision, (long double)value);
+  } else {
+    // Drop 'L' for double
+    conversion[3] = conversion[4];
+    conversion[4] = '\0';
+    written       = logcie_format(out.data + out.len, room, fmt, precision, (double)value);
+  }
+
+  if (written < 0) {
+    return;
+  }
+
+  if ((size_t)written >= room) {
+    out.overflow = 1;
+    written      = room ? (int)room - 1 : 0;
+  }
+
+  out.len += (size_t)written;
+}
+
+inline void format_string(Logcie_Buffer &out, const char *str, size_t len, const FormatSpec &spec) {
+  if (spec.precision >= 0 && (size_t)spec.precision < len) {
+    len = (size_t)spec.precision;
+  }
+
+  append(out, str, len);
+}
+
+inline FormatSpec parse_spec(const char *field, size_t end) {
+  FormatSpec spec = {0, 0, -1, 0};
+  size_t     i    = 2;
+
+  if (end == 1) {
+    return spec;
+  }
+
+  if (field[i] == '<' || field[i] == '>') {
+    spec.align = field[i++];
+  }
+
+  for (; is_digit(field[i]); i++) {
+    spec.width = spec.width * 10 + (unsigned)(field[i] - '0');
+  }
+
+  if (field[i] == '.') {
+    spec.precision = 0;
+
+    for (i++; is_digit(field[i]); i++) {
+      spec.precision = spec.precision * 10 + (field[i] - '0');
+    }
+  }
+
+  if (i < end) {
+    spec.type = field[i];
+  }
+
+  return spec;
+}
+
+inline void write_field(Logcie_Buffer &out, const Arg &arg, FormatSpec spec) {
+  size_t start = out.len;
+
+  arg.format(out, arg.value, spec);
+
+  size_t len = out.len - start;
+
+  if (spec.width <= len) {
+    return;
+  }
+
+  size_t pad  = spec.width - len;
+  size_t room = out.capacity - out.len - 1;
+
+  if (pad > room) {
+    pad          = room;
+    out.overflow = 1;
+  }
+
+  bool right = spec.align == '>' || (spec.align == 0 && (arg.kind == Kind::Integer || arg.kind == Kind::Floating || arg.kind == Kind::Pointer));
+
+  if (right) {
+    std::memmove(out.data + start + pad, out.data + start, len);
+    std::memset(out.data + start, ' ', pad);
+  } else {
+    std::memset(out.data + out.len, ' ', pad);
+  }
+
+  out.len += pad;
+}
+
+// Renders format with arguments into `out`. Format may be unchecked, so
+// malformed fields and fields without arguments are copied as is
+inline void render(Logcie_Buffer &out, const char *fmt, const Arg *args, size_t count) {
+  const char *p    = fmt;
+  size_t      next = 0;
+
+  while (*p) {
+    const char *literal = p;
+
+    while (*p && *p != '{' && *p != '}') {
+      p++;
+    }
+
+    append(out, literal, (size_t)(p - literal));
+
+    if (*p == '\0') {
+      break;
+    }
+
+    if (p[1] == p[0]) {
+      append(out, p, 1);
+      p += 2;
+      continue;
+    }
+
+    size_t end = *p == '{' ? field_end(p, 0) : 0;
+
+    if (end == 0 || next == count) {
+      append(out, p, 1);
+      p++;
+      continue;
+    }
+
+    const Arg &arg  = args[next++];
+    FormatSpec spec = parse_spec(p, end);
+
+    if (!field_accepts(p, 0, end, arg.kind)) {
+      spec.type      = 0;
+      spec.precision = -1;
+    }
+
+    write_field(out, arg, spec);
+    p += end + 1;
+  }
+
+  out.data[out.len] = '\0';
+}
+
+// Renders message into a per-thread buffer and builds a log around it. Message that
+// doesn't fit LOGCIE_MESSAGE_MAX is rendered again into a LOGCIE_LINE_MAX buffer
+inline Logcie_Log make_log(Logcie_LogLevel level, const char *fmt, const char *file, uint32_t line, const Arg *args, size_t count) {
+  static thread_local char message[LOGCIE_MESSAGE_MAX];
+  static thread_local char long_message[LOGCIE_LINE_MAX > LOGCIE_MESSAGE_MAX ? LOGCIE_LINE_MAX : LOGCIE_MESSAGE_MAX];
+  Logcie_Buffer            out = {message, 0, sizeof(message), 0};
+
+  render(out, fmt, args, count);
+
+  if (out.overflow) {
+    out = Logcie_Buffer{long_message, 0, sizeof(long_message), 0};
+    render(out, fmt, args, count);
+  }
+
+  Logcie_Log log = {level, fmt, std::time(NULL), logcie_module, {file, line}, NULL, out.data, out.len, NULL};
+  return log;
+}
+
+inline void emit(Logcie_LogLevel level, const char *fmt, const char *file, uint32_t line, const Arg *args, size_t count) {
+  Logcie_Log log = make_log(level, fmt, file, line, args, count);
+  logcie_log_rendered(log, log.message, log.message_len);
+}
+
+} // namespace detail
+
+/**
+ * @brief Format that is not known at compile time. See logcie::runtime()
+ */
+struct RuntimeFormat {
+  const char *fmt;
+};
+
+/**
+ * @brief Allows format that is not a literal (required since C++20, where literals are checked).
+ */
+inline RuntimeFormat runtime(const char *fmt) {
+  return RuntimeFormat{fmt};
+}
+
+/**
+ * @brief Format string of a log together with location of the caller.
+ *
+ * Constructed implicitly from the format argument of logcie::info() and others.
+ * Constructor checks the format against `Args` (see "Compile-time checks").
+ */
+template <class... Args>
+class BasicFormatString {
+public:
+#ifdef _LOGCIE_HPP_CONSTEVAL
+  consteval BasicFormatString(const char *fmt, const char *file = _LOGCIE_HPP_FILE, uint32_t line = _LOGCIE_HPP_LINE)
+    : fmt(fmt), file(file), line(line) {
+    if (!detail::Checker<Args...>::check(fmt, 0)) {
+      detail::format_string_does_not_match_arguments();
+    }
+  }
+#else
+  constexpr BasicFormatString(const char *fmt, const char *file = _LOGCIE_HPP_FILE, uint32_t line = _LOGCIE_HPP_LINE)
+    : fmt(fmt), file(file), line(line) {}
+#endif
+
+  template <class S, class = typename std::enable_if<std::is_base_of<detail::CompiledString, S>::value>::type>
+  constexpr BasicFormatString(S, const char *file = _LOGCIE_HPP_FILE, uint32_t line = _LOGCIE_HPP_LINE)
+    : fmt(S::value()), file(file), line(line) {
+    static_assert(detail::Checker<Args...>::check(S::value(), 0), "logcie: format string does not match arguments");
+  }
+
+  BasicFormatString(RuntimeFormat fmt, const char *file = _LOGCIE_HPP_FILE, uint32_t line = _LOGCIE_HPP_LINE)
+    : fmt(fmt.fmt), file(file), line(line) {}
+
+  const char *fmt;
+  const char *file;
+  uint32_t    line;
+};
+
+// Arguments are not deduced from the format, only from the values
+template <class... Args>
+using FormatString = BasicFormatString<typename detail::identity<Args>::type...>;
+
+/**
+ * @brief Renders format with arguments into a buffer (truncates, always NUL-terminated).
+ *
+ * Useful in custom formatters. Format is checked as in logcie::info().
+ *
+ * @return Number of bytes written
+ */
+template <class... Args>
+size_t format_to(Logcie_Buffer &out, FormatString<Args...> fmt, Args &&...args) {
+  static_assert(detail::Supported<Args...>::value, "logcie: argument type has no logcie::formatter specialization");
+  const detail::Arg list[] = {detail::Arg{NULL, NULL, Kind::Unsupported}, detail::make_arg(args)...};
+  size_t            start  = out.len;
+
+  detail::render(out, fmt.fmt, list + 1, sizeof...(Args));
+  return out.len - start;
+}
+
+/**
+ * @brief Checks if any sink may accept logs of the level. Cached like LOGCIE_* call sites.
+ */
+inline bool enabled(Logcie_LogLevel level) {
+  static Logcie_CallSiteCache  caches[Count_LOGCIE_LEVEL] = {};
+  static const Logcie_CallSite sites[Count_LOGCIE_LEVEL]  = {
+    {LOGCIE_LEVEL_TRACE, 0, "", NULL, &caches[0]},
+    {LOGCIE_LEVEL_DEBUG, 0, "", NULL, &caches[1]},
+    {LOGCIE_LEVEL_VERBOSE, 0, "", NULL, &caches[2]},
+    {LOGCIE_LEVEL_INFO, 0, "", NULL, &caches[3]},
+    {LOGCIE_LEVEL_WARN, 0, "", NULL, &caches[4]},
+    {LOGCIE_LEVEL_ERROR, 0, "", NULL, &caches[5]},
+    {LOGCIE_LEVEL_FATAL, 0, "", NULL, &caches[6]},
+  };
+
+  return logcie_callsite_enabled(&sites[level]) != 0;
+}
+
+/**
+ * @brief Emits a log. Arguments are formatted only if some sink may accept the level.
+ *
+ * @param level Log level
+ * @param fmt   Format string (see "Format syntax")
+ * @param args  Arguments, taken by reference, never copied
+ */
+template <class... Args>
+void log(Logcie_LogLevel level, FormatString<Args...> fmt, Args &&...args) {
+  static_assert(detail::Supported<Args...>::value, "logcie: argument type has no logcie::formatter specialization");
+
+  if (!enabled(level)) {
+    return;
+  }
+
+  const detail::Arg list[] = {detail::Arg{NULL, NULL, Kind::Unsupported}, detail::make_arg(args)...};
+  detail::emit(level, fmt.fmt, fmt.file, fmt.line, list + 1, sizeof...(Args));
+}
+
+/**
+ * @brief Convenience functions for each log level.
+ */
+template <class... Args>
+void trace(FormatString<Args...> fmt, Args &&...args) {
+  log(LOGCIE_LEVEL_TRACE, fmt, static_cast<Args &&>(args)...);
+}
+
+template <class... Args>
+void debug(FormatString<Args...> fmt, Args &&...args) {
+  log(LOGCIE_LEVEL_DEBUG, fmt, static_cast<Args &&>(args)...);
+}
+
+template <class... Args>
+void verbose(FormatString<Args...> fmt, Args &&...args) {
+  log(LOGCIE_LEVEL_VERBOSE, fmt, static_cast<Args &&>(args)...);
+}
+
+template <class... Args>
+void info(FormatString<Args...> fmt, Args &&...args) {
+  log(LOGCIE_LEVEL_INFO, fmt, static_cast<Args &&>(args)...);
+}
+
+template <class... Args>
+void warn(FormatString<Args...> fmt, Args &&...args) {
+  log(LOGCIE_LEVEL_WARN, fmt, static_cast<Args &&>(args)...);
+}
+
+template <class... Args>
+void error(FormatString<Args...> fmt, Args &&...args) {
+  log(LOGCIE_LEVEL_ERROR, fmt, static_cast<Args &&>(args)...);
+}
+
+template <class... Args>
+void fatal(FormatString<Args...> fmt, Args &&...args) {
+  log(LOGCIE_LEVEL_FATAL, fmt, static_cast<Args &&>(args)...);
+}
+
+// Formatters of built-in types
+
+template <class T>
+struct formatter<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value && !std::is_same<T, char>::value>::type> {
+  static constexpr Kind kind = Kind::Integer;
+
+  static void format(Logcie_Buffer &out, T value, const FormatSpec &spec) {
+    if (spec.type == 'c') {
+      char c = (char)value;
+      append(out, &c, 1);
+    } else {
+      detail::format_integer(out, value, spec.type);
+    }
+  }
+};
+
+template <class T>
+struct formatter<T, typename std::enable_if<std::is_enum<T>::value>::type> {
+  static constexpr Kind kind = Kind::Integer;
+
+  static void format(Logcie_Buffer &out, T value, const FormatSpec &spec) {
+    typedef typename std::underlying_type<T>::type Underlying;
+    formatter<Underlying>::format(out, (Underlying)value, spec);
+  }
+};
+
+template <>
+struct formatter<char> {
+  static constexpr Kind kind = Kind::Char;
+
+  static void format(Logcie_Buffer &out, char value, const FormatSpec &spec) {
+    if (spec.type == 'd' || spec.type == 'x' || spec.type == 'X') {
+      detail::format_integer(out, (int)value, spec.type);
+    } else {
+      append(out, &value, 1);
+    }
+  }
+};
+
+template <>
+struct formatter<bool> {
+  static constexpr Kind kind = Kind::Bool;
+
+  static void format(Logcie_Buffer &out, bool value, const FormatSpec &spec) {
+    if (spec.type == 'd' || spec.type == 'x' || spec.type == 'X') {
+      append(out, value ? "1" : "0", 1);
+    } else if (value) {
+      append(out, "true", 4);
+    } else {
+      append(out, "false", 5);
+    }
+  }
+};
+
+template <class T>
+struct formatter<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+  static constexpr Kind kind = Kind::Floating;
+
+  static void format(Logcie_Buffer &out, T value, const FormatSpec &spec) {
+    detail::format_floating(out, value, spec);
+  }
+};
+
+template <>
+struct formatter<const char *> {
+  static constexpr Kind kind = Kind::String;
+
+  static void format(Logcie_Buffer &out, const char *value, const FormatSpec &spec) {
+    if (value == NULL) {
+      value = "(null)";
+    }
+
+    detail::format_string(out, value, std::strlen(value), spec);
+  }
+};
+
+template <>
+struct formatter<char *> : formatter<const char *> {};
+
+template <class Traits, class Allocator>
+struct formatter<std::basic_string<char, Traits, Allocator> > {
+  static constexpr Kind kind = Kind::String;
+
+  static void format(Logcie_Buffer &out, const std::basic_string<char, Traits, Allocator> &value, const FormatSpec &spec) {
+    detail::format_string(out, value.data(), value.size(), spec);
+  }
+};
+
+#ifdef _LOGCIE_HPP_STRING_VIEW
+template <class Traits>
+struct formatter<std::basic_string_view<char, Traits> > {
+  static constexpr Kind kind = Kind::String;
+
+  static void format(Logcie_Buffer &out, std::basic_string_view<char, Traits> value, const FormatSpec &spec) {
+    detail::format_string(out, value.data(), value.size(), spec);
+  }
+};
+#endif
+
+template <class T>
+struct formatter<T *, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type> {
+  static constexpr Kind kind = Kind::Pointer;
+
+  static void format(Logcie_Buffer &out, T *value, const FormatSpec &) {
+    append(out, "0x", 2);
+    detail::format_integer(out, (uintptr_t)value, 'x');
+  }
+};
+
+template <>
+struct formatter<std::nullptr_t> {
+  static constexpr Kind kind = Kind::Pointer;
+
+  static void format(Logcie_Buffer &out, std::nullptr_t, const FormatSpec &) {
+    append(out, "0x0", 3);
+  }
+};
+
+// Compile-time sink pipelines
+
+/**
+ * @brief Pipeline filter that accepts every log.
+ */
+struct AcceptAll {
+  bool operator()(const Logcie_Log &) const {
+    return true;
+  }
+
+  Logcie_Filter c_filter() const {
+    return Logcie_Filter{NULL, NULL};
+  }
+};
+
+/**
+ * @brief Pipeline filter that accepts logs of `Level` and above.
+ */
+template <Logcie_LogLevel Level>
+struct MinLevel {
+  static const Logcie_LogLevel level = Level;
+
+  bool operator()(const Logcie_Log &log) const {
+    return log.level >= Level;
+  }
+
+  // Same filter as logcie_filter_level_min, so call sites below the level stay disabled
+  Logcie_Filter c_filter() const {
+    return Logcie_Filter{logcie_filter_level_min_fn, (void *)&level};
+  }
+};
+
+template <Logcie_LogLevel Level>
+const Logcie_LogLevel MinLevel<Level>::level;
+
+/**
+ * @brief Pipeline filter that accepts logs of `Level` and below.
+ */
+template <Logcie_LogLevel Level>
+struct MaxLevel {
+  static const Logcie_LogLevel level = Level;
+
+  bool operator()(const Logcie_Log &log) const {
+    return log.level <= Level;
+  }
+
+  Logcie_Filter c_filter() const {
+    return Logcie_Filter{logcie_filter_level_max_fn, (void *)&level};
+  }
+};
+
+template <Logcie_LogLevel Level>
+const Logcie_LogLevel MaxLevel<Level>::level;
+
+/**
+ * @brief Pipeline writer to FILE* (stdout if NULL).
+ */
+struct FileWriter {
+  FILE *stream;
+
+  explicit FileWriter(FILE *stream = NULL) : stream(stream) {}
+
+  size_t writev(const Logcie_Segment *segments, size_t count) {
+    return logcie_printf_writev(stream ? stream : stdout, segments, count);
+  }
+
+  void flush() {
+    logcie_printf_flush(stream);
+  }
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+/**
+ * @brief Pipeline writer to a file descriptor.
+ */
+struct FdWriter {
+  int fd;
+
+  explicit FdWriter(int fd) : fd(fd) {}
+
+  size_t writev(const Logcie_Segment *segments, size_t count) {
+    return logcie_fd_writev((void *)(intptr_t)fd, segments, count);
+  }
+};
+#endif
+
+/**
+ * @brief Pipeline writer to memory (see Logcie_Buffer).
+ */
+struct BufferWriter {
+  Logcie_Buffer *buffer;
+
+  explicit BufferWriter(Logcie_Buffer *buffer) : buffer(buffer) {}
+
+  size_t writev(const Logcie_Segment *segments, size_t count) {
+    return logcie_buffer_writev(buffer, segments, count);
+  }
+};
+
+/**
+ * @brief Pipeline writer that forwards to a runtime Logcie_Writer.
+ */
+struct CWriter {
+  Logcie_Writer writer;
+
+  explicit CWriter(Logcie_Writer writer) : writer(writer) {}
+
+  size_t writev(const Logcie_Segment *segments, size_t count) {
+    return logcie_writer_writev(&writer, segments, count);
+  }
+
+  void flush() {
+    logcie_writer_flush(&writer);
+  }
+};
+
+namespace detail {
+
+// Collects segments of a log like logcie_printf_formatter does and hands
+// them to `Target::writev` when full or at the end
+template <class Target>
+class SegmentOutput {
+public:
+  explicit SegmentOutput(Target &target) : target(target), count(0), scratch_len(0), written(0) {}
+
+  size_t push(const char *ptr, size_t len) {
+    if (len == 0) {
+      return 0;
+    }
+
+    if (count == LOGCIE_SEGMENTS_MAX) {
+      flush();
+    }
+
+    segments[count++] = Logcie_Segment{ptr, len};
+    return len;
+  }
+
+  // Memory for text that lives only until the segments are written
+  char *scratch(size_t len) {
+    if (sizeof(memory) - scratch_len < len) {
+      flush();
+    }
+
+    char *at = memory + scratch_len;
+    scratch_len += len;
+    return at;
+  }
+
+  size_t flush() {
+    if (count) {
+      written += target.writev(segments, count);
+    }
+
+    count       = 0;
+    scratch_len = 0;
+    return written;
+  }
+
+private:
+  Target        &target;
+  Logcie_Segment segments[LOGCIE_SEGMENTS_MAX];
+  size_t         count;
+  char           memory[64];
+  size_t         scratch_len;
+  size_t         written;
+};
+
+// Writer of C sink used as SegmentOutput target
+struct CWriterTarget {
+  Logcie_Writer *writer;
+
+  size_t writev(const Logcie_Segment *segments, size_t count) {
+    return logcie_writer_writev(writer, segments, count);
+  }
+};
+
+// Emit operations of a `$` format
+
+template <class S, size_t Begin, size_t End>
+struct LiteralOp {
+  template <class Out>
+  static void emit(Out &out, Logcie_Log &, size_t &) {
+    out.push(S::value() + Begin, End - Begin);
+  }
+};
+
+template <char Token>
+struct TokenOp {
+  template <class Out>
+  static void emit(Out &out, Logcie_Log &log, size_t &last_len) {
+    const char *text = logcie_token_string(&log, Token);
+    last_len         = out.push(text, std::strlen(text));
+  }
+};
+
+template <>
+struct TokenOp<'m'> {
+  template <class Out>
+  static void emit(Out &out, Logcie_Log &log, size_t &last_len) {
+    size_t      len;
+    const char *message = logcie_log_message(&log, &len);
+    last_len            = out.push(message, len);
+  }
+};
+
+template <>
+struct TokenOp<'x'> {
+  template <class Out>
+  static void emit(Out &out, Logcie_Log &log, size_t &last_len) {
+    char    *digits = out.scratch(10);
+    char    *p      = digits + 10;
+    uint32_t line   = log.location.line;
+
+    do {
+      *--p = (char)('0' + line % 10);
+      line /= 10;
+    } while (line);
+
+    last_len = out.push(p, (size_t)(digits + 10 - p));
+  }
+};
+
+// `$<N`, pads previous token up to N like logcie_printf_formatter
+template <unsigned Target>
+struct PadOp {
+  template <class Out>
+  static void emit(Out &out, Logcie_Log &, size_t &last_len) {
+    static const char spaces[] = "                                ";
+
+    if (last_len + 1 >= Target) {
+      return;
+    }
+
+    size_t pad = Target - last_len - 1;
+    last_len   = 0;
+
+    while (pad > 0) {
+      size_t chunk = pad < sizeof(spaces) - 1 ? pad : sizeof(spaces) - 1;
+      last_len += out.push(spaces, chunk);
+      pad -= chunk;
+    }
+  }
+};
+
+template <class... Ops>
+struct OpList {
+  template <class Out>
+  static void emit(Out &out, Logcie_Log &log) {
+    size_t    last_len = 0;
+    const int order[]  = {0, (Ops::emit(out, log, last_len), 0)...};
+    (void)order;
+    (void)last_len;
+  }
+};
+
+template <class Op, class List>
+struct Prepend;
+
+template <class Op, class... Ops>
+struct Prepend<Op, OpList<Ops...> > {
+  typedef OpList<Op, Ops...> type;
+};
+
+constexpr bool is_token(char c) {
+  return c == '$' || c == 'm' || c == 'f' || c == 'x' || c == 'M' || c == 'l' || c == 'L' || c == 'c' || c == 'r' || c == 'd' || c == 't' || c == 'z';
+}
+
+constexpr size_t literal_end(const char *s, size_t i) {
+  return s[i] == '\0' || s[i] == '$' ? i : literal_end(s, i + 1);
+}
+
+constexpr unsigned parse_number(const char *s, size_t i, unsigned value) {
+  return is_digit(s[i]) ? parse_number(s, i + 1, value * 10 + (unsigned)(s[i] - '0')) : value;
+}
+
+// Turns format `S::value()` starting at `I` into OpList
+template <class S, size_t I, char C = S::value()[I]>
+struct ParseFormat {
+  typedef typename Prepend<LiteralOp<S, I, literal_end(S::value(), I)>, typename ParseFormat<S, literal_end(S::value(), I)>::type>::type type;
+};
+
+template <class S, size_t I>
+struct ParseFormat<S, I, '\0'> {
+  typedef OpList<> type;
+};
+
+template <class S, size_t I, char C = S::value()[I]>
+struct ParseToken {
+  static_assert(is_token(C), "logcie: unknown $ token in pipeline format");
+  typedef typename Prepend<TokenOp<C>, typename ParseFormat<S, I + 1>::type>::type type;
+};
+
+template <class S, size_t I>
+struct ParseToken<S, I, '\0'> {
+  typedef OpList<> type;
+};
+
+template <class S, size_t I>
+struct ParseToken<S, I, '<'> {
+  typedef typename Prepend<PadOp<parse_number(S::value(), I + 1, 0)>, typename ParseFormat<S, skip_digits(S::value(), I + 1)>::type>::type type;
+};
+
+template <class S, size_t I>
+struct ParseFormat<S, I, '$'> {
+  typedef typename ParseToken<S, I + 1>::type type;
+};
+
+// Calls writev of every writer in a tuple
+template <size_t I, size_t N>
+struct WriteAll {
+  template <class Tuple>
+  static size_t writev(Tuple &writers, const Logcie_Segment *segments, size_t count) {
+    size_t written = std::get<I>(writers).writev(segments, count);
+    WriteAll<I + 1, N>::writev(writers, segments, count);
+    return written;
+  }
+};
+
+template <size_t N>
+struct WriteAll<N, N> {
+  template <class Tuple>
+  static size_t writev(Tuple &, const Logcie_Segment *, size_t) {
+    return 0;
+  }
+};
+
+// flush() is optional for writers: used if writer has it
+template <class Writer>
+auto flush_writer(Writer &writer, int) -> decltype(writer.flush(), void()) {
+  writer.flush();
+}
+
+template <class Writer>
+void flush_writer(Writer &, long) {}
+
+// Calls flush of every writer in a tuple that has one
+template <size_t I, size_t N>
+struct FlushAll {
+  template <class Tuple>
+  static void flush(Tuple &writers) {
+    flush_writer(std::get<I>(writers), 0);
+    FlushAll<I + 1, N>::flush(writers);
+  }
+};
+
+template <size_t N>
+struct FlushAll<N, N> {
+  template <class Tuple>
+  static void flush(Tuple &) {}
+};
+
+// Pipeline filter exposed to C: filters with c_filter() are used as is,
+// other go through a thunk
+template <class Filter>
+auto c_filter(const Filter &filter, Logcie_FilterFn *, void *, int) -> decltype(filter.c_filter()) {
+  return filter.c_filter();
+}
+
+template <class Filter>
+Logcie_Filter c_filter(const Filter &, Logcie_FilterFn *thunk, void *data, long) {
+  return Logcie_Filter{thunk, data};
+}
+
+} // namespace detail
+
+/**
+ * @brief Formatter of a `$` format known at compile time.
+ *
+ * Format is parsed while compiling into a fixed sequence of emit operations,
+ * so formatting is a straight line of pushes without parsing or switches.
+ * Supports all tokens of logcie_printf_formatter, unknown token is a compile error.
+ * `S` is a type with `static constexpr const char *value()`, as LOGCIE_FMT creates.
+ */
+template <class S>
+struct Format {
+  typedef typename detail::ParseFormat<S, 0>::type Ops;
+
+  template <class Out>
+  void format(Out &out, Logcie_Log &log) const {
+    Ops::emit(out, log);
+    out.push("\n", 1);
+  }
+};
+
+/**
+ * @brief Creates Format from LOGCIE_FMT("...")
+ */
+template <class S>
+Format<S> format(S) {
+  return Format<S>();
+}
+
+/**
+ * @brief Sink with filter, formatter and writers known at compile time.
+ *
+ * Filter, formatter and every writer are called directly, so the whole chain
+ * is inlined instead of going through function pointers of Logcie_Sink.
+ *
+ * Filter     `bool operator()(const Logcie_Log &) const`, optionally
+ *            `Logcie_Filter c_filter() const` to expose it to call site cache
+ * Formatter  `template <class Out> void format(Out &out, Logcie_Log &log) const`,
+ *            where `out.push(ptr, len)` adds a segment (see logcie::Format)
+ * Writer     `size_t writev(const Logcie_Segment *segments, size_t count)`,
+ *            optionally `void flush()` (see logcie_flush)
+ *
+ * Pipeline is used directly with log()/emit(), or registered in runtime
+ * sink list with `logcie_add_sink(pipeline.sink())`, then it receives logs
+ * from LOGCIE_* macros and logcie::info() as any other sink. Pipeline must
+ * not be moved while registered.
+ */
+template <class Filter, class Formatter, class... Writers>
+class Pipeline {
+public:
+  Pipeline() : filter(), formatter(), writers() {}
+
+  Pipeline(Filter filter, Formatter formatter, Writers... writers)
+    : filter(filter), formatter(formatter), writers(writers...) {}
+
+  /**
+   * @brief Filters, formats and writes a log. Returns number of bytes written.
+   */
+  size_t emit(Logcie_Log &log) {
+    if (!filter(log)) {
+      return 0;
+    }
+
+    return write(log);
+  }
+
+  /**
+   * @brief Logs straight to this pipeline, bypassing registered sinks.
+   */
+  template <class... Args>
+  size_t log(Logcie_LogLevel level, FormatString<Args...> fmt, Args &&...args) {
+    static_assert(detail::Supported<Args...>::value, "logcie: argument type has no logcie::formatter specialization");
+    const detail::Arg list[] = {detail::Arg{NULL, NULL, Kind::Unsupported}, detail::make_arg(args)...};
+    Logcie_Log        log    = detail::make_log(level, fmt.fmt, fmt.file, fmt.line, list + 1, sizeof...(Args));
+    return emit(log);
+  }
+
+  /**
+   * @brief Formats and writes a log without filtering.
+   */
+  size_t write(Logcie_Log &log) {
+    detail::SegmentOutput<Pipeline> out(*this);
+    formatter.format(out, log);
+    return out.flush();
+  }
+
+  /**
+   * @brief Writes segments to every writer. Returns result of the first one.
+   */
+  size_t writev(const Logcie_Segment *segments, size_t count) {
+    return detail::WriteAll<0, sizeof...(Writers)>::writev(writers, segments, count);
+  }
+
+  /**
+   * @brief Flushes every writer that has flush().
+   */
+  void flush() {
+    detail::FlushAll<0, sizeof...(Writers)>::flush(writers);
+  }
+
+  /**
+   * @brief Runtime sink for logcie_add_sink(). Filter, formatter and writer call this pipeline.
+   */
+  Logcie_Sink *sink() {
+    c_sink.formatter = Logcie_Formatter{&Pipeline::format_thunk, this};
+    c_sink.writer    = Logcie_Writer{&Pipeline::write_thunk, this, &Pipeline::writev_thunk, &Pipeline::flush_thunk};
+    c_sink.filter    = detail::c_filter(filter, &Pipeline::filter_thunk, this, 0);
+    c_sink.dedup     = NULL;
+    c_sink.async     = NULL;
+    return &c_sink;
+  }
+
+  Filter                 filter;
+  Formatter              formatter;
+  std::tuple<Writers...> writers;
+
+private:
+  static uint8_t filter_thunk(void *data, Logcie_Log *log) {
+    return static_cast<Pipeline *>(data)->filter(*log);
+  }
+
+  static size_t format_thunk(Logcie_Writer *writer, void *data, Logcie_Log log, va_list *) {
+    Pipeline *pipeline = static_cast<Pipeline *>(data);
+
+    // Own writer is called directly, others (buffer of shared formatting) through writev
+    if (writer->data == data && writer->writev == &Pipeline::writev_thunk) {
+      return pipeline->write(log);
+    }
+
+    detail::CWriterTarget                       target = {writer};
+    detail::SegmentOutput<detail::CWriterTarget> out(target);
+    pipeline->formatter.format(out, log);
+    return out.flush();
+  }
+
+  static size_t writev_thunk(void *data, const Logcie_Segment *segments, size_t count) {
+    return static_cast<Pipeline *>(data)->writev(segments, count);
+  }
+
+  static void flush_thunk(void *data) {
+    static_cast<Pipeline *>(data)->flush();
+  }
+
+  static size_t write_thunk(void *data, const char *fmt, va_list *va, ...) {
+    char    line[LOGCIE_LINE_MAX];
+    va_list args;
+
+    if (va != NULL) {
+      va_copy(args, *va);
+    } else {
+      va_start(args, va);
+    }
+
+    int written = logcie_vformat(line, sizeof(line), fmt, args);
+    va_end(args);
+
+    if (written < 0) {
+      return 0;
+    }
+
+    Logcie_Segment segment = {line, (size_t)written < sizeof(line) ? (size_t)written : sizeof(line) - 1};
+    return static_cast<Pipeline *>(data)->writev(&segment, 1);
+  }
+
+  Logcie_Sink c_sink;
+};
+
+/**
+ * @brief Creates Pipeline deducing its types, e.g. for formats made with LOGCIE_FMT.
+ *
+ * @code
+ * static auto console = logcie::make_pipeline(logcie::MinLevel<LOGCIE_LEVEL_INFO>(),
+ *                                             logcie::format(LOGCIE_FMT("[$L] $m")),
+ *                                             logcie::FileWriter(stdout));
+ * logcie_add_sink(console.sink());
+ * @endcode
+ */
+template <class Filter, class Formatter, class... Writers>
+Pipeline<Filter, Formatter, Writers...> make_pipeline(Filter filter, Formatter formatter, Writers... writers) {
+  return Pipeline<Filter, Formatter, Writers...>(filter, formatter, writers...);
+}
+
+} // namespace logcie
+
+#endif /* end of include guard: LOGCIE_HPP */
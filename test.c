@@ -1,6 +1,6 @@
 #include <stdbool.h>
 #include <string.h>
-
+#define LOGCIE_FLIGHT_RECORD_MAX 8192  // Longer than LOGCIE_LINE_MAX, async targets cut records
 #define PRINTF_TYPECHECK(a, b)
 #define LOGCIE_IMPLEMENTATION
 #include <logcie.h>
@@ -279,6 +279,1359 @@ static Logcie_TestCase tests[] = {
    .expected       = "INFO this is a very long log message used for stress testing"},
 };
 
+// Captures everything logged between capture_begin() and capture_end() into buffer
+static FILE       *capture_file;
+static Logcie_Sink capture_sink;
+
+static void capture_begin(const char *fmt, Logcie_Filter filter) {
+  memset(buffer, '\0', BUFFER_LEN);
+  capture_file = tmpfile();
+
+  capture_sink = (Logcie_Sink){
+    .formatter = {logcie_printf_formatter, (void *)fmt},
+    .writer    = {logcie_printf_writer, capture_file},
+    .filter    = filter,
+  };
+
+  logcie_add_sink(&capture_sink);
+}
+
+static const char *capture_end(void) {
+  logcie_remove_sink(&capture_sink);
+
+  if (capture_file) {
+    rewind(capture_file);
+    fread(buffer, 1, sizeof(buffer) - 1, capture_file);
+    fclose(capture_file);
+    capture_file = NULL;
+  }
+
+  return buffer;
+}
+
+typedef struct {
+  const char *name;
+  bool (*run)(void);
+} Logcie_FeatureTest;
+
+static const uint32_t callsite_test_line = __LINE__ + 1;
+static void emit_from_callsite(void) { LOGCIE_INFO("from callsite"); }
+
+static bool test_callsite_rules(void) {
+  bool ok = true;
+
+  capture_begin("$m", (Logcie_Filter){NULL, NULL});
+  logcie_callsite_set(__FILE__, callsite_test_line, LOGCIE_CALLSITE_DISABLED);
+  emit_from_callsite();
+  ok = ok && strcmp(capture_end(), "") == 0;
+
+  capture_begin("$m", (Logcie_Filter){NULL, NULL});
+  logcie_callsite_set("test.c", callsite_test_line, LOGCIE_CALLSITE_DEFAULT);
+  logcie_callsite_set(__FILE__, callsite_test_line, LOGCIE_CALLSITE_DEFAULT);
+  emit_from_callsite();
+  ok = ok && strcmp(capture_end(), "from callsite\n") == 0;
+
+  logcie_callsite_reset();
+  return ok;
+}
+
+static void emit_trace(void) { LOGCIE_TRACE("trace %d", 1); }
+
+static bool test_callsite_generation(void) {
+  Logcie_LogLevel min_level = LOGCIE_LEVEL_INFO;
+
+  capture_begin("$m", (Logcie_Filter){logcie_filter_level_min_fn, &min_level});
+  emit_trace();
+
+  // Decision is cached until call sites are invalidated
+  min_level = LOGCIE_LEVEL_TRACE;
+  emit_trace();
+
+  logcie_invalidate_callsites();
+  emit_trace();
+
+  return strcmp(capture_end(), "trace 1\n") == 0;
+}
+
+static bool test_callsite_enumeration(void) {
+#ifdef LOGCIE_CALLSITE_SECTION
+  for (size_t i = 0; i < logcie_callsite_count(); i++) {
+    const Logcie_CallSite *site = logcie_callsite_get(i);
+
+    if (site->line == callsite_test_line && site->level == LOGCIE_LEVEL_INFO) {
+      return site->fmt && strcmp(site->fmt, "from callsite") == 0 && strcmp(site->file, __FILE__) == 0;
+    }
+  }
+
+  return false;
+#else
+  return logcie_callsite_count() == 0;
+#endif
+}
+
+static void emit_rate_limited(int i) { LOGCIE_INFO("rate %d", i); }
+
+static bool test_rate_limit(void) {
+  // Refill is so slow that only burst passes
+  static Logcie_RateLimit limit = {.burst = 3, .per_second = 0, .key = LOGCIE_RATE_LIMIT_PER_CALLSITE};
+
+  capture_begin("$m", logcie_filter_rate_limit(&limit));
+
+  for (int i = 0; i < 10; i++) {
+    emit_rate_limited(i);
+  }
+
+  // Different call site has its own bucket
+  LOGCIE_INFO("other");
+
+  bool ok = strcmp(capture_end(), "rate 0\nrate 1\nrate 2\nother\n") == 0;
+  return ok && logcie_rate_limit_suppressed(&limit) == 7;
+}
+
+static void emit_duplicate(const char *what) { LOGCIE_ERROR("failed %s", what); }
+
+static bool test_dedup(void) {
+  static Logcie_Dedup dedup = {.window_ms = 0, .summary_every = 0};
+
+  capture_begin("$m", (Logcie_Filter){NULL, NULL});
+  capture_sink.dedup = &dedup;
+
+  for (int i = 0; i < 5; i++) {
+    emit_duplicate("a");
+  }
+
+  emit_duplicate("b");
+  emit_duplicate("b");
+  logcie_dedup_flush(&capture_sink);
+
+  return strcmp(capture_end(), "failed a\nlast message repeated 4 times\nfailed b\nlast message repeated 1 times\n") == 0;
+}
+
+static bool test_patterns(void) {
+  static Logcie_PatternSet set;
+  const char              *patterns[] = {"he", "she", "hers", "refused"};
+
+  bool ok = logcie_patterns_compile(&set, patterns, 4, 1);
+
+  const char *long_text = "a long line with nothing in it until its very end: ushers";
+  ok = ok && logcie_patterns_match(&set, long_text, strlen(long_text));
+  ok = ok && !logcie_patterns_match(&set, long_text, strlen(long_text) - 3);
+  ok = ok && !logcie_patterns_match(&set, "", 0);
+
+  capture_begin("$m", logcie_filter_patterns(&set));
+  LOGCIE_INFO("connect: %s", "refused");
+  LOGCIE_INFO("all good");
+  LOGCIE_INFO("%d %s", 42, "ushers");
+  ok = ok && strcmp(capture_end(), "connect: refused\n42 ushers\n") == 0;
+
+  // Format string mode doesn't see arguments
+  ok = ok && logcie_patterns_compile(&set, patterns + 3, 1, 0);
+  capture_begin("$m", logcie_filter_patterns(&set));
+  LOGCIE_INFO("connect: %s", "refused");
+  LOGCIE_INFO("connect: refused");
+  ok = ok && strcmp(capture_end(), "connect: refused\n") == 0;
+
+  return ok;
+}
+
+static bool regex_matches(const char *pattern, const char *text) {
+  Logcie_Regex re;
+  return logcie_regex_compile(&re, pattern, LOGCIE_REGEX_MESSAGE) && logcie_regex_match(&re, text, strlen(text));
+}
+
+static bool test_regex(void) {
+  bool ok = regex_matches("timeout after \\d+ms", "db: timeout after 150ms") && !regex_matches("timeout after \\d+ms", "timeout after ms") &&
+            regex_matches("^(ab|c)*$", "abcab") && !regex_matches("^(ab|c)*$", "abca") && regex_matches("colou?r", "color") &&
+            regex_matches("^[[:upper:]][^ ]*$", "Word") && !regex_matches("^[[:upper:]][^ ]*$", "Two words") && regex_matches("a\\$", "a$");
+
+  Logcie_Regex invalid;
+  ok = ok && !logcie_regex_compile(&invalid, "a{2}", LOGCIE_REGEX_MESSAGE) && !logcie_regex_compile(&invalid, "(ab", LOGCIE_REGEX_MESSAGE);
+
+  static Logcie_Regex module;
+  static Logcie_Regex message;
+  ok = ok && logcie_regex_compile(&module, "^db\\.", LOGCIE_REGEX_MODULE);
+  ok = ok && logcie_regex_compile(&message, "timeout after [0-9]+ms", LOGCIE_REGEX_MESSAGE);
+
+  capture_begin("$M $m", logcie_filter_and(logcie_filter_regex(&module), logcie_filter_regex(&message)));
+
+  const char *saved_module = logcie_module;
+  logcie_module            = "db.pool";
+  LOGCIE_INFO("timeout after %dms", 30);
+  LOGCIE_INFO("connected");
+  logcie_module = "dbx";
+  LOGCIE_INFO("timeout after %dms", 30);
+  logcie_module = saved_module;
+
+  return ok && strcmp(capture_end(), "db.pool timeout after 30ms\n") == 0;
+}
+
+static const char *seen_messages[2];
+static size_t      seen_count;
+
+static size_t remember_message(Logcie_Writer *writer, void *data, Logcie_Log log, va_list *args) {
+  (void)writer, (void)data, (void)args;
+  seen_messages[seen_count++ % 2] = log.message;
+  return 0;
+}
+
+static bool test_render_once(void) {
+  Logcie_Sink first  = {.formatter = {remember_message, NULL}, .writer = {logcie_printf_writer, stdout}, .filter = {NULL, NULL}, .dedup = NULL, .async = NULL};
+  Logcie_Sink second = first;
+
+  // Different formatter data, so sinks don't share formatted output
+  second.formatter.data = &second;
+
+  capture_begin("$m", (Logcie_Filter){NULL, NULL});
+  logcie_add_sink(&first);
+  logcie_add_sink(&second);
+
+  seen_count = 0;
+  LOGCIE_INFO("rendered %d", 1);
+
+  // Both sinks got the same rendered buffer
+  bool ok = seen_count == 2 && seen_messages[0] && seen_messages[0] == seen_messages[1] && strcmp(seen_messages[0], "rendered 1") == 0;
+
+  logcie_remove_sink(&first);
+  logcie_remove_sink(&second);
+
+  // Messages longer than LOGCIE_MESSAGE_MAX are not truncated by $m
+  static char long_message[LOGCIE_MESSAGE_MAX * 2];
+  memset(long_message, 'x', sizeof(long_message) - 1);
+  LOGCIE_INFO("%s", long_message);
+
+  const char *output = capture_end();
+  return ok && strncmp(output, "rendered 1\n", 11) == 0 && strlen(output) == 11 + sizeof(long_message);
+}
+
+static size_t formatter_calls;
+
+static size_t counting_formatter(Logcie_Writer *writer, void *data, Logcie_Log log, va_list *args) {
+  formatter_calls++;
+  return logcie_printf_formatter(writer, data, log, args);
+}
+
+static bool read_file(FILE *file, const char *expected) {
+  char content[256] = {0};
+  rewind(file);
+  fread(content, 1, sizeof(content) - 1, file);
+  fclose(file);
+  return strcmp(content, expected) == 0;
+}
+
+static bool test_shared_formatter(void) {
+  static const char *format = "[$L] $m";
+  FILE       *a      = tmpfile();
+  FILE       *b      = tmpfile();
+  Logcie_Sink first  = {.formatter = {counting_formatter, (void *)format}, .writer = {logcie_printf_writer, a}, .filter = {NULL, NULL}, .dedup = NULL, .async = NULL};
+  Logcie_Sink second = {.formatter = {counting_formatter, (void *)format}, .writer = {logcie_printf_writer, b}, .filter = logcie_filter_level_min(LOGCIE_LEVEL_WARN), .dedup = NULL, .async = NULL};
+
+  logcie_add_sink(&first);
+  logcie_add_sink(&second);
+
+  formatter_calls = 0;
+  LOGCIE_WARN("shared %d", 1);
+  bool ok = formatter_calls == 1;
+
+  LOGCIE_INFO("only first");
+  ok = ok && formatter_calls == 2;
+
+  logcie_remove_sink(&first);
+  logcie_remove_sink(&second);
+
+  ok = read_file(a, "[WARN] shared 1\n[INFO] only first\n") && ok;
+  ok = read_file(b, "[WARN] shared 1\n") && ok;
+  return ok;
+}
+
+// Not at the top, line numbers of table tests above must stay the same
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+static size_t writev_calls;
+
+static size_t counting_writev(void *data, const Logcie_Segment *segments, size_t count) {
+  writev_calls++;
+  return logcie_buffer_writev(data, segments, count);
+}
+
+static bool test_gather_writer(void) {
+  char          line[256];
+  Logcie_Buffer output = {line, 0, sizeof(line), 0};
+  Logcie_Sink   sink   = {
+    .formatter = {logcie_printf_formatter, (void *)"[$L] $M: $m ($x)"},
+    .writer    = {logcie_buffer_writer, &output, counting_writev},
+    .filter    = {NULL, NULL},
+    .dedup     = NULL,
+    .async     = NULL,
+  };
+
+  logcie_add_sink(&sink);
+  writev_calls = 0;
+  LOGCIE_ERROR("gather %s", "write");
+  const uint32_t line_number = __LINE__ - 1;
+  logcie_remove_sink(&sink);
+
+  char expected[64];
+  snprintf(expected, sizeof(expected), "[ERROR] %s: gather write (%u)\n", logcie_module ? logcie_module : default_module, line_number);
+  bool ok = writev_calls == 1 && output.len == strlen(expected) && strncmp(line, expected, output.len) == 0;
+
+  // Writers without writev get segments through the adapter
+  Logcie_Writer  plain      = {logcie_buffer_writer, &output, NULL, NULL};
+  Logcie_Segment segments[] = {{"ab", 2}, {"cdef", 3}};
+  output.len                = 0;
+  ok = ok && logcie_writer_writev(&plain, segments, 2) == 5 && output.len == 5 && strncmp(line, "abcde", 5) == 0;
+
+#if defined(__unix__) || defined(__APPLE__)
+  int fds[2];
+
+  if (pipe(fds) == 0) {
+    Logcie_Writer fd_writer = {logcie_fd_writer, (void *)(intptr_t)fds[1], logcie_fd_writev, NULL};
+    ok = ok && logcie_writer_writev(&fd_writer, segments, 2) == 5;
+    ok = ok && fd_writer.write(fd_writer.data, "%d!", NULL, 42) == 3;
+
+    char piped[16] = {0};
+    ok             = ok && read(fds[0], piped, sizeof(piped)) == 8 && strcmp(piped, "abcde42!") == 0;
+    close(fds[0]);
+    close(fds[1]);
+  }
+#endif
+
+  return ok;
+}
+
+static bool format_matches_libc(const char *fmt, ...) {
+  char    ours[128];
+  char    libc[128];
+  va_list args;
+  va_list args_copy;
+  va_start(args, fmt);
+  va_copy(args_copy, args);
+
+  int ours_len = logcie_vformat(ours, sizeof(ours), fmt, args);
+  int libc_len = vsnprintf(libc, sizeof(libc), fmt, args_copy);
+
+  va_end(args_copy);
+  va_end(args);
+
+  if (ours_len != libc_len || strcmp(ours, libc) != 0) {
+    printf("  format: '%s'\n  ours:   '%s' (%d)\n  libc:   '%s' (%d)\n", fmt, ours, ours_len, libc, libc_len);
+    return false;
+  }
+
+  return true;
+}
+
+static bool test_format_kernels(void) {
+  bool ok = true;
+
+  ok = format_matches_libc("%d %i %u %x %X", 0, -42, 4000000000u, 0xbeefu, 0xbeefu) && ok;
+  ok = format_matches_libc("[%5d|%-5d|%05d|%+d|% d|%.3d|%.0d]", 42, 42, -42, 42, 42, 7, 0) && ok;
+  ok = format_matches_libc("%hhd %hd %ld %lld %zu %jd %td", 300, 70000, -1L, -9223372036854775807LL - 1, (size_t)-1, (intmax_t)-5, (ptrdiff_t)-6) && ok;
+  ok = format_matches_libc("[%#x|%#X|%#x|%08.3x|%-#8x]", 255u, 255u, 0u, 10u, 10u) && ok;
+  ok = format_matches_libc("[%s|%10s|%-10s|%.3s|%s]", "abc", "abc", "abc", "abcdef", (char *)NULL) && ok;
+  ok = format_matches_libc("[%c|%3c|%-3c|%%]", 'x', 'y', 'z') && ok;
+  ok = format_matches_libc("%p %p %10p", (void *)&ok, (void *)NULL, (void *)&ok) && ok;
+  ok = format_matches_libc("*[%*d|%-*d|%.*f|%*.*s]", 6, 1, -6, 2, 2, 3.14159, 5, 2, "abc") && ok;
+  ok = format_matches_libc("%o %#o %e %g %a %G", 8u, 8u, 12345.678, 0.0001, 1.0, 1e20) && ok;
+  ok = format_matches_libc("%Lf %.2Le", (long double)1.5, (long double)2.25) && ok;
+  ok = format_matches_libc("%2$s %1$s", "positional", "arguments") && ok;
+
+  // Fixed floats: rounding ties and values that can't be represented exactly
+  double floats[] = {0.0, -0.0, 0.5, 1.5, 2.5, 0.0005, 1.0005, 2.675, 1e-7, -123.456, 1e15, 1e300, 123456789.987654321};
+
+  for (int i = 0; i < _LOGCIE_ARR_LEN(floats); i++) {
+    ok = format_matches_libc("%f|%.0f|%.1f|%.3f|%+.2f|%010.4f|%-12.9f|%.12f", floats[i], floats[i], floats[i], floats[i], floats[i], floats[i], floats[i], floats[i]) && ok;
+  }
+
+  for (int i = 0; i < 10000; i++) {
+    double value = (i * 7919 % 100000) / 1000.0 - 50.0;
+    ok           = format_matches_libc("%.3f %.2f %f", value, value / 7, value * 1e6) && ok;
+  }
+
+  // Truncation reports full length, like vsnprintf
+  char small[8];
+  ok = logcie_format(small, sizeof(small), "%s-%d", "truncated", 12345) == 15 && strcmp(small, "truncat") == 0 && ok;
+
+  return ok;
+}
+
+static bool test_format_cache(void) {
+  static Logcie_CallSiteCache cache = {0, 0, NULL};
+  static const Logcie_CallSite site = {LOGCIE_LEVEL_INFO, 1, "cached.c", "%s=%5.2f", &cache};
+
+  capture_begin("$m", (Logcie_Filter){NULL, NULL});
+  logcie_log_callsite(&site, NULL, site.fmt, "a", 1.5);
+  const struct Logcie_FormatPlan *plan = cache.format;
+  logcie_log_callsite(&site, NULL, site.fmt, "b", 22.25);
+
+  // Formats that are not the literal of a call site are never cached
+  char runtime[16];
+  strcpy(runtime, "%d");
+  logcie_log_callsite(&site, NULL, runtime, 3);
+
+  bool ok = plan != NULL && cache.format == plan;
+  return strcmp(capture_end(), "a= 1.50\nb=22.25\n3\n") == 0 && ok;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static bool test_syslog_sink(void) {
+  static Logcie_Syslog state;
+  char                 path[64];
+  snprintf(path, sizeof(path), "/tmp/logcie_syslog_%ld.sock", (long)getpid());
+  unlink(path);
+
+  // Socket is absent: records are dropped without blocking
+  memset(&state, 0, sizeof(state));
+  state.path     = path;
+  state.app_name = "test";
+  Logcie_Sink sink = logcie_syslog_sink(&state);
+  logcie_add_sink(&sink);
+  LOGCIE_INFO("nobody listens");
+  logcie_remove_sink(&sink);
+  bool ok = state.dropped == 1 && state.sent == 0;
+  logcie_syslog_close(&state);
+
+  struct sockaddr_un address = {0};
+  address.sun_family        = AF_UNIX;
+  strcpy(address.sun_path, path);
+  int listener = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+  if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    return false;
+  }
+
+  char    datagram[LOGCIE_SYSLOG_RECORD_MAX];
+  ssize_t len;
+
+  // RFC 5424: INFO records wait in the batch, WARN sends the whole batch
+  memset(&state, 0, sizeof(state));
+  state.path      = path;
+  state.app_name  = "test";
+  state.linger_ms = 60000;
+  logcie_add_sink(&sink);
+  LOGCIE_INFO("batched %d", 1);
+  ok  = ok && recv(listener, datagram, sizeof(datagram), MSG_DONTWAIT) < 0 && state.count == 1;
+  LOGCIE_WARN("urgent");
+  len = recv(listener, datagram, sizeof(datagram) - 1, MSG_DONTWAIT);
+  ok  = ok && len > 0 && strncmp(datagram, "<14>1 ", 6) == 0 && strstr(datagram, " test ") != NULL;
+  ok  = ok && len > 9 && strncmp(datagram + len - 9, "batched 1", 9) == 0;
+  len = recv(listener, datagram, sizeof(datagram) - 1, MSG_DONTWAIT);
+  ok  = ok && len > 0 && strncmp(datagram, "<12>1 ", 6) == 0 && strncmp(datagram + len - 6, "urgent", 6) == 0;
+  ok  = ok && state.sent == 2 && state.dropped == 0;
+  logcie_remove_sink(&sink);
+  logcie_syslog_close(&state);
+
+  // Journal native protocol
+  memset(&state, 0, sizeof(state));
+  state.path     = path;
+  state.app_name = "test";
+  state.protocol = LOGCIE_SYSLOG_JOURNAL;
+  logcie_add_sink(&sink);
+  LOGCIE_ERROR("one line");
+  len = recv(listener, datagram, sizeof(datagram) - 1, MSG_DONTWAIT);
+  ok  = ok && len > 0;
+  datagram[len > 0 ? len : 0] = '\0';
+  ok  = ok && strncmp(datagram, "PRIORITY=3\nSYSLOG_FACILITY=1\nSYSLOG_IDENTIFIER=test\nCODE_FILE=", 61) == 0;
+  ok  = ok && strstr(datagram, "\nMESSAGE=one line\n") != NULL;
+  LOGCIE_ERROR("two\nlines");
+  len = recv(listener, datagram, sizeof(datagram) - 1, MSG_DONTWAIT);
+  ok  = ok && len > 27 && memcmp(datagram + len - 27, "\nMESSAGE\n\x09\0\0\0\0\0\0\0two\nlines\n", 27) == 0;
+
+  // Message longer than LOGCIE_MESSAGE_MAX is sent whole, too long one is cut to fit the record
+  static char long_message[LOGCIE_SYSLOG_RECORD_MAX * 2];
+  memset(long_message, 'x', sizeof(long_message) - 1);
+  long_message[1] = '\n';
+  int sizes[]     = {LOGCIE_MESSAGE_MAX + 100, (int)sizeof(long_message) - 1};
+
+  for (int i = 0; i < 2; i++) {
+    LOGCIE_ERROR("%.*s", sizes[i], long_message);
+    len            = recv(listener, datagram, sizeof(datagram), MSG_DONTWAIT);
+    char    *value = NULL;
+    uint64_t size  = 0;
+
+    for (ssize_t j = 0; j + 17 <= len && value == NULL; j++) {
+      value = memcmp(datagram + j, "\nMESSAGE\n", 9) == 0 ? datagram + j : NULL;
+    }
+
+    for (int j = 0; value && j < 8; j++) {
+      size |= (uint64_t)(unsigned char)value[9 + j] << (8 * j);
+    }
+
+    ok = ok && value && value + 9 + 8 + size + 1 == datagram + len && datagram[len - 1] == '\n';
+    ok = ok && (i == 0 ? size == (uint64_t)sizes[i] : len == LOGCIE_SYSLOG_RECORD_MAX);
+  }
+
+  ok = ok && state.dropped == 0;
+
+  // Journal record that doesn't fit is dropped, not cut
+  Logcie_Segment oversized = {long_message, LOGCIE_SYSLOG_RECORD_MAX + 1};
+  ok                       = ok && logcie_syslog_writev(&state, &oversized, 1) == 0 && state.dropped == 1 && state.count == 0;
+  logcie_remove_sink(&sink);
+  logcie_syslog_close(&state);
+
+  close(listener);
+  unlink(path);
+  return ok;
+}
+
+#include <arpa/inet.h>
+#include <sched.h>
+#include <netinet/in.h>
+
+// Loopback socket bound to a free port
+static int loopback_listener(int type, uint16_t *port) {
+  struct sockaddr_in address = {0};
+  socklen_t          len     = sizeof(address);
+  address.sin_family         = AF_INET;
+  address.sin_addr.s_addr    = htonl(INADDR_LOOPBACK);
+  int fd                     = socket(AF_INET, type, 0);
+
+  if (fd < 0 || bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || (type == SOCK_STREAM && listen(fd, 1) != 0) ||
+      getsockname(fd, (struct sockaddr *)&address, &len) != 0) {
+    return -1;
+  }
+
+  *port = ntohs(address.sin_port);
+  return fd;
+}
+
+static bool test_net_sink(void) {
+  static Logcie_Net net;
+  uint16_t          port;
+  char              received[256];
+  bool              ok = true;
+
+  // TCP: records are kept until flush and sent as one length-prefixed stream
+  int listener = loopback_listener(SOCK_STREAM, &port);
+  memset(&net, 0, sizeof(net));
+  net.host         = "127.0.0.1";
+  net.port         = port;
+  net.framing      = LOGCIE_NET_LENGTH_PREFIX;
+  net.linger_ms    = 60000;
+  Logcie_Sink sink = logcie_net_sink(&net, "$L $m");
+  logcie_add_sink(&sink);
+  LOGCIE_INFO("first");
+  LOGCIE_ERROR("second %d", 2);
+  ok = ok && net.sent == 0 && net.len == 2 * 4 + strlen("INFO first\n") + strlen("ERROR second 2\n");
+
+  for (int i = 0; i < 100 && net.sent < 2; i++) {
+    logcie_net_flush(&net);
+  }
+
+  int     peer = accept(listener, NULL, NULL);
+  ssize_t len  = recv(peer, received, 34, MSG_WAITALL);
+  ok           = ok && net.sent == 2 && net.connects == 1 && len == 34;
+  ok           = ok && memcmp(received, "\0\0\0\013INFO first\n\0\0\0\017ERROR second 2\n", 34) == 0;
+  logcie_remove_sink(&sink);
+  logcie_net_close(&net);
+  close(peer);
+  close(listener);
+
+  // Nobody listens: records are buffered until buffer is full, the rest is dropped
+  memset(&net, 0, sizeof(net));
+  net.host       = "127.0.0.1";
+  net.port       = port;
+  net.backoff_ms = 60000;
+  char record[1000];
+  memset(record, 'x', sizeof(record));
+  Logcie_Segment segment = {record, sizeof(record)};
+
+  for (int i = 0; i < 100; i++) {
+    logcie_net_writev(&net, &segment, 1);
+  }
+
+  ok = ok && net.sent == 0 && net.connects == 0 && net.dropped == 100 - LOGCIE_NET_BUFFER / 1001;
+  ok = ok && net.dropped_bytes == net.dropped * 1001 && net.len == LOGCIE_NET_BUFFER / 1001 * 1001;
+  logcie_net_close(&net);
+
+  // UDP: newline framed records are packed into one datagram, newline is added where it is missing
+  listener = loopback_listener(SOCK_DGRAM, &port);
+  memset(&net, 0, sizeof(net));
+  net.host      = "::ffff:127.0.0.1";
+  net.port      = port;
+  net.transport = LOGCIE_NET_UDP;
+  net.linger_ms = 60000;
+  logcie_add_sink(&sink);
+  LOGCIE_INFO("a");
+  LOGCIE_INFO("b");
+  logcie_net_writer(&net, "%s", NULL, "c");
+  logcie_net_flush(&net);
+  len = recv(listener, received, sizeof(received), MSG_DONTWAIT);
+  ok  = ok && len == 16 && memcmp(received, "INFO a\nINFO b\nc\n", 16) == 0 && net.sent == 3;
+  logcie_remove_sink(&sink);
+  logcie_net_close(&net);
+  close(listener);
+
+  // Message longer than LOGCIE_MESSAGE_MAX is still one record with both framings
+  static char long_message[LOGCIE_MESSAGE_MAX * 3];
+  static char long_record[LOGCIE_MESSAGE_MAX * 4];
+  memset(long_message, 'x', sizeof(long_message) - 1);
+  size_t long_len = strlen("INFO ") + sizeof(long_message) - 1;
+
+  for (int framing = LOGCIE_NET_NEWLINE; framing <= LOGCIE_NET_LENGTH_PREFIX; framing++) {
+    listener = loopback_listener(SOCK_STREAM, &port);
+    memset(&net, 0, sizeof(net));
+    net.host      = "127.0.0.1";
+    net.port      = port;
+    net.framing   = (Logcie_NetFraming)framing;
+    net.linger_ms = 60000;
+    logcie_add_sink(&sink);
+    LOGCIE_INFO("%s", long_message);
+    LOGCIE_INFO("end");
+
+    for (int i = 0; i < 100 && net.sent < 2; i++) {
+      logcie_net_flush(&net);
+    }
+
+    size_t prefix = framing == LOGCIE_NET_LENGTH_PREFIX ? 4 : 0;
+    size_t total  = prefix + long_len + 1 + prefix + strlen("INFO end\n");
+    peer          = accept(listener, NULL, NULL);
+    len           = recv(peer, long_record, total, MSG_WAITALL);
+    ok            = ok && net.sent == 2 && len == (ssize_t)total;
+
+    if (framing == LOGCIE_NET_LENGTH_PREFIX) {
+      uint32_t size = ((uint32_t)(unsigned char)long_record[0] << 24) | ((uint32_t)(unsigned char)long_record[1] << 16) |
+                      ((uint32_t)(unsigned char)long_record[2] << 8) | (uint32_t)(unsigned char)long_record[3];
+      ok = ok && size == long_len + 1;
+    }
+
+    ok = ok && memcmp(long_record + prefix, "INFO xxx", 8) == 0 && long_record[prefix + long_len] == '\n';
+    ok = ok && memcmp(long_record + total - 9, "INFO end\n", 9) == 0;
+    logcie_remove_sink(&sink);
+    logcie_net_close(&net);
+    close(peer);
+    close(listener);
+  }
+
+  return ok;
+}
+#endif
+
+#ifdef _LOGCIE_THREADS
+static pthread_mutex_t async_gate = PTHREAD_MUTEX_INITIALIZER;
+
+// Writer that waits while test holds async_gate
+static size_t gated_writev(void *data, const Logcie_Segment *segments, size_t count) {
+  pthread_mutex_lock(&async_gate);
+  size_t written = logcie_buffer_writev(data, segments, count);
+  pthread_mutex_unlock(&async_gate);
+  return written;
+}
+
+static uint8_t async_busy(Logcie_Async *async) {
+  pthread_mutex_lock(&async->lock);
+  uint8_t busy = async->busy;
+  pthread_mutex_unlock(&async->lock);
+  return busy;
+}
+
+// Logs line of 996 bytes with number first. Logs in [warn_from, warn_to) are WARN, the rest are INFO
+static void async_log(int number, int warn_from, int warn_to) {
+  if (number >= warn_from && number < warn_to) {
+    LOGCIE_WARN("%04d %.*d", number, 990, 0);
+  } else {
+    LOGCIE_INFO("%04d %.*d", number, 990, 0);
+  }
+}
+
+// Logs `count` lines to async sink configured in `async`, optionally while its writer is stuck
+static bool async_overflow(Logcie_Async *async, int count, int warn_from, int warn_to, Logcie_Buffer *output, uint8_t stuck) {
+  static char        memory[1 << 20];
+  static Logcie_Sink sink;
+
+  *output = (Logcie_Buffer){memory, 0, sizeof(memory), 0};
+  sink    = (Logcie_Sink){{logcie_printf_formatter, (void *)"$m"}, {logcie_buffer_writer, output, gated_writev, NULL}, {NULL, NULL}, NULL, NULL};
+
+  if (!logcie_async_start(&sink, async)) {
+    return false;
+  }
+
+  logcie_add_sink(&sink);
+
+  if (stuck) {
+    pthread_mutex_lock(&async_gate);
+    async_log(0, warn_from, warn_to);
+
+    while (!async_busy(async)) {
+      sched_yield();
+    }
+  }
+
+  for (int i = stuck; i < count; i++) {
+    async_log(i, warn_from, warn_to);
+  }
+
+  if (stuck) {
+    pthread_mutex_unlock(&async_gate);
+  }
+
+  logcie_remove_sink(&sink);
+  logcie_async_stop(async);
+  return true;
+}
+
+// Zero initializes async sink state with given policy, WARN is important
+static Logcie_Async *async_config(Logcie_OverflowPolicy policy) {
+  static Logcie_Async async;
+  memset(&async, 0, sizeof(async));
+  async.policy = policy;
+  async.level  = LOGCIE_LEVEL_WARN;
+  return &async;
+}
+
+// Checks number of `index`-th line written by async_overflow
+static bool async_line_is(const Logcie_Buffer *output, size_t index, int number) {
+  char prefix[8];
+  snprintf(prefix, sizeof(prefix), "%04d ", number);
+  return (index + 1) * 996 <= output->len && strncmp(output->data + index * 996, prefix, 5) == 0;
+}
+
+static bool test_async_sink(void) {
+  Logcie_Buffer output;
+  bool          ok    = true;
+  const int     queue = LOGCIE_ASYNC_BUFFER / (8 + 1000);  // Lines are 996 bytes, aligned to 8
+
+  // Stuck writer does not stall logging, queue keeps the first lines
+  Logcie_Async *async = async_config(LOGCIE_OVERFLOW_DROP_NEWEST);
+  ok                  = ok && async_overflow(async, 200, 199, 200, &output, 1);
+  ok                  = ok && async->written == 1 + (uint64_t)queue && async->dropped == 200 - 1 - (uint64_t)queue;
+  ok                  = ok && output.len == async->written * 996 && async_line_is(&output, queue, queue);
+
+  // Oldest lines give room to the newest
+  async = async_config(LOGCIE_OVERFLOW_DROP_OLDEST);
+  ok    = ok && async_overflow(async, 200, 199, 200, &output, 1);
+  ok    = ok && async->written == 1 + (uint64_t)queue && async->dropped == 200 - 1 - (uint64_t)queue;
+  ok    = ok && async_line_is(&output, 0, 0) && async_line_is(&output, 1, 200 - queue) && async_line_is(&output, queue, 199);
+
+  // Only the last log is WARN, it replaces the oldest line, INFO lines are dropped
+  async = async_config(LOGCIE_OVERFLOW_DROP_BELOW_LEVEL);
+  ok    = ok && async_overflow(async, 200, 199, 200, &output, 1);
+  ok    = ok && async->written == 1 + (uint64_t)queue && async_line_is(&output, 1, 2);
+  ok    = ok && async_line_is(&output, queue - 1, queue) && async_line_is(&output, queue, 199);
+
+  // Logging thread waits for the worker, nothing is lost
+  async = async_config(LOGCIE_OVERFLOW_BLOCK);
+  ok    = ok && async_overflow(async, 1000, 0, 0, &output, 0);
+  ok    = ok && async->written == 1000 && async->dropped == 0 && output.len == 1000 * 996;
+  ok    = ok && async_line_is(&output, 500, 500) && async_line_is(&output, 999, 999);
+
+  // Waiting is limited by timeout
+  async                   = async_config(LOGCIE_OVERFLOW_BLOCK);
+  async->block_timeout_ms = 1;
+  ok                      = ok && async_overflow(async, 100, 0, 0, &output, 1);
+  ok                      = ok && async->written == 1 + (uint64_t)queue && logcie_async_dropped(async, LOGCIE_LEVEL_INFO) == 100 - 1 - (uint64_t)queue;
+
+  // INFO can't use reserved part of the queue, WARN can
+  async          = async_config(LOGCIE_OVERFLOW_DROP_NEWEST);
+  async->reserve = 4 * 1008;
+  ok             = ok && async_overflow(async, 200, 197, 200, &output, 1);
+  ok             = ok && async->written == 1 + (uint64_t)queue - 4 + 3 && async_line_is(&output, queue - 3, 197);
+  ok             = ok && logcie_async_dropped(async, LOGCIE_LEVEL_WARN) == 0 && logcie_async_dropped(async, LOGCIE_LEVEL_INFO) == 200 - 1 - (uint64_t)queue + 4 - 3;
+  ok             = ok && logcie_async_dropped(async, Count_LOGCIE_LEVEL) == async->dropped_levels[LOGCIE_LEVEL_INFO];
+
+  // INFO does not replace WARN lines, WARN lines replace each other
+  async = async_config(LOGCIE_OVERFLOW_DROP_OLDEST);
+  ok    = ok && async_overflow(async, 200, 0, 199, &output, 1);
+  ok    = ok && async->written == 1 + (uint64_t)queue && async_line_is(&output, queue, 198);
+  ok    = ok && async->dropped_levels[LOGCIE_LEVEL_INFO] == 1 && async->dropped_levels[LOGCIE_LEVEL_WARN] == 199 - 1 - (uint64_t)queue;
+
+  // Line longer than LOGCIE_LINE_MAX is cut for async sink and counted, sync sink gets all of it
+  static char   async_memory[1 << 14];
+  static char   sync_memory[1 << 14];
+  Logcie_Buffer async_output = {async_memory, 0, sizeof(async_memory), 0};
+  Logcie_Buffer sync_output  = {sync_memory, 0, sizeof(sync_memory), 0};
+  Logcie_Sink   async_sink   = {{logcie_printf_formatter, (void *)"$m"}, {logcie_buffer_writer, &async_output, logcie_buffer_writev, NULL}, {NULL, NULL}, NULL, NULL};
+  Logcie_Sink   sync_sink    = {{logcie_printf_formatter, (void *)"$m"}, {logcie_buffer_writer, &sync_output, logcie_buffer_writev, NULL}, {NULL, NULL}, NULL, NULL};
+  async                      = async_config(LOGCIE_OVERFLOW_BLOCK);
+
+  if (!logcie_async_start(&async_sink, async)) {
+    return false;
+  }
+
+  logcie_add_sink(&async_sink);
+  logcie_add_sink(&sync_sink);
+  LOGCIE_INFO("%.*d", 6000, 0);
+  logcie_remove_sink(&sync_sink);
+  logcie_remove_sink(&async_sink);
+  logcie_async_stop(async);
+
+  ok = ok && sync_output.len == 6001 && async_output.len == LOGCIE_LINE_MAX - 1 && async_output.data[async_output.len - 1] == '\n';
+  ok = ok && async->written == 1 && async->truncated == 1 && async->dropped == 0;
+
+  return ok;
+}
+
+static int flushes = 0;
+
+static void counting_flush(void *data) {
+  (void)data;
+  flushes++;
+}
+
+static bool test_fatal_flush(void) {
+  static char         memory[1 << 16];
+  static Logcie_Async async;
+  Logcie_Buffer       output = {memory, 0, sizeof(memory), 0};
+  Logcie_Sink         sink   = {{logcie_printf_formatter, (void *)"$L $m"}, {logcie_buffer_writer, &output, gated_writev, counting_flush}, {NULL, NULL}, NULL, NULL};
+  bool                ok     = true;
+
+  memset(&async, 0, sizeof(async));
+  flushes = 0;
+
+  if (!logcie_async_start(&sink, &async)) {
+    return false;
+  }
+
+  logcie_add_sink(&sink);
+
+  for (int i = 0; i < 100; i++) {
+    LOGCIE_INFO("line %d", i);
+  }
+
+  // Queue is written and writer flushed before LOGCIE_FATAL returns
+  LOGCIE_FATAL("the end");
+  ok = ok && async.written == 101 && flushes == 1;
+  ok = ok && output.len > 14 && memcmp(output.data + output.len - 14, "FATAL the end\n", 14) == 0;
+
+  // Worker flushes the writer on request even when queue is empty
+  logcie_flush();
+  ok = ok && flushes == 2;
+
+  logcie_remove_sink(&sink);
+  logcie_async_stop(&async);
+  return ok;
+}
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+static bool test_crash_handler(void) {
+  uint16_t port;
+  char     received[64];
+  bool     ok       = true;
+  int      listener = loopback_listener(SOCK_STREAM, &port);
+
+  fflush(stdout);
+  pid_t child = fork();
+
+  if (child == 0) {
+    static Logcie_Net net;
+    net.host         = "127.0.0.1";
+    net.port         = port;
+    net.linger_ms    = 60000;
+    Logcie_Sink sink = logcie_net_sink(&net, "$m");
+    logcie_add_sink(&sink);
+    LOGCIE_INFO("connect");
+
+    for (int i = 0; i < 100 && net.sent < 1; i++) {
+      logcie_net_flush(&net);
+    }
+
+    // Kept in memory until the crash
+    LOGCIE_INFO("before");
+    LOGCIE_ERROR("crash");
+    logcie_install_crash_handler();
+    abort();
+  }
+
+  struct pollfd pending = {listener, POLLIN, 0};
+  ok                    = ok && child > 0 && poll(&pending, 1, 5000) == 1;
+  int     peer          = ok ? accept(listener, NULL, NULL) : -1;
+  ssize_t len           = peer >= 0 ? recv(peer, received, 21, MSG_WAITALL) : -1;
+  ok                    = ok && len == 21 && memcmp(received, "connect\nbefore\ncrash\n", 21) == 0;
+
+  if (peer >= 0) {
+    close(peer);
+  }
+
+  close(listener);
+
+  int status = 0;
+  ok         = ok && child > 0 && waitpid(child, &status, 0) == child && WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+  return ok;
+}
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+
+static bool test_shm_sink(void) {
+  static Logcie_Shm       shm;
+  static Logcie_ShmReader reader;
+  char                    name[64];
+  Logcie_Log              log;
+  bool                    ok = true;
+
+  snprintf(name, sizeof(name), "/logcie-test-%ld", (long)getpid());
+  memset(&shm, 0, sizeof(shm));
+  memset(&reader, 0, sizeof(reader));
+  shm.name         = name;
+  shm.capacity     = 1024;
+  reader.name      = name;
+  Logcie_Sink sink = logcie_shm_sink(&shm);
+
+  if (!logcie_shm_open(&shm) || !logcie_shm_reader_open(&reader)) {
+    shm_unlink(name);
+    return false;
+  }
+
+  // Records keep metadata, reader formats them itself
+  logcie_add_sink(&sink);
+  LOGCIE_WARN("disk %d%% full", 93);
+  unsigned line = __LINE__ - 1;
+  ok            = ok && logcie_shm_read(&reader, &log) && !logcie_shm_read(&reader, &log);
+  ok            = ok && log.level == LOGCIE_LEVEL_WARN && log.message_len == 13 && strncmp(log.message, "disk 93% full", 13) == 0;
+  ok            = ok && log.location.line == line && strstr(log.location.file, "test.c") && log.time > 0;
+  ok            = ok && (logcie_module ? log.module && strcmp(log.module, logcie_module) == 0 : log.module == NULL);
+
+  // Text written directly is a TRACE record
+  Logcie_Segment segment = {"raw", 3};
+  logcie_shm_writev(&shm, &segment, 1);
+  ok = ok && logcie_shm_read(&reader, &log) && log.level == LOGCIE_LEVEL_TRACE && log.message_len == 3;
+
+  // Writer does not wait for reader, reader skips overwritten records and counts them
+  for (int i = 0; i < 100; i++) {
+    LOGCIE_INFO("record %d", i);
+  }
+
+  int first = -1;
+  int last  = -1;
+  int read  = 0;
+
+  while (logcie_shm_read(&reader, &log)) {
+    sscanf(log.message, "record %d", first < 0 ? &first : &last);
+    read++;
+  }
+
+  ok = ok && shm.written == 102 && read > 1 && last == 99 && last - first + 1 == read;
+  ok = ok && reader.lost == (uint64_t)(100 - read);
+
+  // Ring created again is read from its beginning
+  logcie_remove_sink(&sink);
+  logcie_shm_close(&shm);
+  ok = ok && logcie_shm_open(&shm);
+  logcie_add_sink(&sink);
+  LOGCIE_ERROR("restarted");
+  ok = ok && logcie_shm_read(&reader, &log) && log.message_len == 9 && strncmp(log.message, "restarted", 9) == 0;
+  ok = ok && reader.lost == (uint64_t)(100 - read);
+
+  // Message longer than LOGCIE_MESSAGE_MAX is kept whole, too long one is cut to fit the record
+  static char long_message[LOGCIE_SHM_RECORD_MAX * 2];
+  memset(long_message, 'x', sizeof(long_message) - 1);
+  logcie_remove_sink(&sink);
+  logcie_shm_reader_close(&reader);
+  logcie_shm_close(&shm);
+  shm.capacity = LOGCIE_SHM_RECORD_MAX * 4;
+  ok           = ok && logcie_shm_open(&shm) && logcie_shm_reader_open(&reader);
+  logcie_add_sink(&sink);
+  LOGCIE_INFO("%.*s", LOGCIE_MESSAGE_MAX + 100, long_message);
+  ok = ok && logcie_shm_read(&reader, &log) && log.message_len == LOGCIE_MESSAGE_MAX + 100;
+  LOGCIE_INFO("%s", long_message);
+  ok = ok && logcie_shm_read(&reader, &log) && log.message_len > LOGCIE_MESSAGE_MAX && log.message[0] == 'x';
+  ok = ok && shm.dropped == 0;
+
+  logcie_remove_sink(&sink);
+  logcie_shm_reader_close(&reader);
+  logcie_shm_close(&shm);
+  shm_unlink(name);
+  return ok;
+}
+#endif
+
+static bool test_flight_recorder(void) {
+  static char                  memory[1 << 16];
+  static Logcie_FlightRecorder recorder;
+  Logcie_Buffer                output    = {memory, 0, sizeof(memory), 0};
+  Logcie_Sink                  target    = {{logcie_printf_formatter, (void *)"$m"}, {logcie_buffer_writer, &output, logcie_buffer_writev, NULL}, {NULL, NULL}, NULL, NULL};
+  Logcie_LogLevel              min_level = LOGCIE_LEVEL_DEBUG;
+  bool                         ok        = true;
+
+  memset(&recorder, 0, sizeof(recorder));
+  recorder.target    = &target;
+  Logcie_Sink sink   = logcie_flight_recorder_sink(&recorder);
+  sink.filter        = (Logcie_Filter){logcie_filter_level_min_fn, &min_level};
+  logcie_add_sink(&sink);
+
+  // Nothing is written until an error, then the last records are
+  for (int i = 0; i < LOGCIE_FLIGHT_RECORDS + 44; i++) {
+    LOGCIE_DEBUG("line %d", i);
+    LOGCIE_TRACE("filtered out");
+  }
+
+  ok = ok && output.len == 0;
+  LOGCIE_ERROR("boom");
+  ok = ok && recorder.dumps == 1 && recorder.dumped == LOGCIE_FLIGHT_RECORDS;
+  ok = ok && strncmp(output.data, "DEBUG line 45\nDEBUG line 46\n", 28) == 0;
+  ok = ok && output.len > 11 && memcmp(output.data + output.len - 11, "ERROR boom\n", 11) == 0;
+
+  // Records are dumped once, manual dump writes only new ones
+  output.len = 0;
+  LOGCIE_WARN("after");
+  ok = ok && logcie_flight_recorder_dump(&recorder) == 1 && logcie_flight_recorder_dump(&recorder) == 0;
+  ok = ok && output.len == 11 && memcmp(output.data, "WARN after\n", 11) == 0;
+
+  // Long records are truncated, but stay lines
+  output.len = 0;
+  LOGCIE_INFO("%.*d", LOGCIE_FLIGHT_RECORD_MAX + 1000, 0);
+  ok = ok && logcie_flight_recorder_dump(&recorder) == 1 && output.len == LOGCIE_FLIGHT_RECORD_MAX - 1;
+  ok = ok && output.data[output.len - 1] == '\n';
+
+  // TRACE can be configured as dump level
+  uint64_t dumps          = recorder.dumps;
+  output.len              = 0;
+  min_level               = LOGCIE_LEVEL_TRACE;
+  recorder.dump_level     = LOGCIE_LEVEL_TRACE;
+  recorder.dump_level_set = 1;
+  LOGCIE_TRACE("trace");
+  ok = ok && recorder.dumps == dumps + 1 && output.len == 12 && memcmp(output.data, "TRACE trace\n", 12) == 0;
+
+#ifdef _LOGCIE_THREADS
+  // Record longer than async queue takes is cut to LOGCIE_LINE_MAX and stays a line
+  static Logcie_Async async;
+  memset(&async, 0, sizeof(async));
+  output.len = 0;
+
+  if (!logcie_async_start(&target, &async)) {
+    return false;
+  }
+
+  LOGCIE_INFO("%.*d", LOGCIE_LINE_MAX + 1000, 0);
+  logcie_async_stop(&async);
+  ok = ok && async.written == 1 && async.truncated == 1 && output.len == LOGCIE_LINE_MAX;
+  ok = ok && memcmp(output.data, "INFO 000", 8) == 0 && output.data[output.len - 1] == '\n';
+#endif
+
+  logcie_remove_sink(&sink);
+  return ok;
+}
+
+static bool test_scope(void) {
+  static char   memory[1 << 16];
+  Logcie_Buffer output = {memory, 0, sizeof(memory), 0};
+  Logcie_Sink   sink   = {{logcie_printf_formatter, (void *)"$L $m"}, {logcie_buffer_writer, &output, logcie_buffer_writev, NULL}, {NULL, NULL}, NULL, NULL};
+  bool          ok     = true;
+
+  logcie_add_sink(&sink);
+
+  // Successful scope drops held logs, buffer goes back to the pool every time
+  for (int i = 0; i < LOGCIE_SCOPE_BUFFERS + 1; i++) {
+    logcie_scope_begin(LOGCIE_LEVEL_INFO);
+    LOGCIE_DEBUG("held %d", i);
+    LOGCIE_INFO("passed %d", i);
+    ok = ok && logcie_scope_end(1) == 0;
+  }
+
+  ok = ok && output.len == strlen("INFO passed 0\n") * 10 + strlen("INFO passed 10\n") * (LOGCIE_SCOPE_BUFFERS - 9);
+  ok = ok && strncmp(output.data, "INFO passed 0\nINFO passed 1\n", 28) == 0;
+
+  // Failed scope emits held logs in order
+  output.len = 0;
+  logcie_scope_begin(LOGCIE_LEVEL_INFO);
+  LOGCIE_DEBUG("a");
+  LOGCIE_TRACE("b");
+  ok = ok && output.len == 0 && logcie_scope_end(0) == 2;
+  ok = ok && output.len == 16 && strncmp(output.data, "DEBUG a\nTRACE b\n", 16) == 0;
+
+  // Error emits held logs before itself, the rest of the scope is not held
+  output.len = 0;
+  logcie_scope_begin(LOGCIE_LEVEL_INFO);
+  logcie_scope_begin(LOGCIE_LEVEL_WARN);
+  LOGCIE_DEBUG("c");
+  ok = ok && logcie_scope_end(1) == 0 && output.len == 0;
+  LOGCIE_ERROR("d");
+  LOGCIE_DEBUG("e");
+  ok = ok && logcie_scope_end(1) == 1;
+  ok = ok && output.len == 24 && strncmp(output.data, "DEBUG c\nERROR d\nDEBUG e\n", 24) == 0;
+
+  // Logs that don't fit are counted
+  output.len = 0;
+  logcie_scope_begin(LOGCIE_LEVEL_INFO);
+
+  for (int i = 0; i < 100; i++) {
+    LOGCIE_DEBUG("%.*d", 500, i);
+  }
+
+  size_t held = LOGCIE_SCOPE_BUFFER / (sizeof(Logcie_Log) + 500);
+  char   dropped[64];
+  snprintf(dropped, sizeof(dropped), "DEBUG %u logs of the scope were dropped\n", (unsigned)(100 - held));
+  ok = ok && logcie_scope_end(0) == held;
+  ok = ok && output.len == held * 507 + strlen(dropped) && strncmp(output.data + held * 507, dropped, strlen(dropped)) == 0;
+
+  logcie_remove_sink(&sink);
+  return ok;
+}
+
+// Allocator is interposed only where it can be forwarded to libc (glibc) and
+// is not replaced by a sanitizer already
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer) || __has_feature(thread_sanitizer)
+#define TEST_SANITIZER
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define TEST_SANITIZER
+#endif
+
+#if defined(__GLIBC__) && !defined(TEST_SANITIZER)
+#define TEST_ALLOCATIONS
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void  __libc_free(void *ptr);
+
+// Number of allocator calls made by any thread while tracking is on
+static volatile uint8_t allocations_tracked;
+static uint64_t         allocations;
+
+void *malloc(size_t size) {
+  if (allocations_tracked) {
+    _LOGCIE_ATOMIC_ADD(&allocations, 1);
+  }
+
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  if (allocations_tracked) {
+    _LOGCIE_ATOMIC_ADD(&allocations, 1);
+  }
+
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  if (allocations_tracked) {
+    _LOGCIE_ATOMIC_ADD(&allocations, 1);
+  }
+
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+  if (allocations_tracked && ptr) {
+    _LOGCIE_ATOMIC_ADD(&allocations, 1);
+  }
+
+  __libc_free(ptr);
+}
+
+#define ALLOCATION_TEST_LOGS 100000
+
+// Reads everything the socket has, so senders never see it full
+static void drain_socket(int fd) {
+  static char drained[1 << 16];
+
+  while (recv(fd, drained, sizeof(drained), MSG_DONTWAIT) > 0) {
+  }
+}
+
+static bool test_no_allocations(void) {
+  static char                  memory[1 << 14];
+  static char                  long_message[LOGCIE_MESSAGE_MAX * 2];
+  static Logcie_Syslog         rfc5424;
+  static Logcie_Syslog         journal;
+  static Logcie_Net            udp;
+  static Logcie_Net            tcp;
+  static Logcie_Shm            shm;
+  static Logcie_FlightRecorder recorder;
+  static Logcie_Dedup          dedup;
+  static Logcie_RateLimit      limit = {.burst = 1000, .per_second = 1000000, .key = LOGCIE_RATE_LIMIT_PER_CALLSITE};
+  static Logcie_PatternSet     patterns;
+  static Logcie_Regex          regex;
+  static const char *const     words[] = {"request", "failed"};
+  Logcie_Buffer                output  = {memory, 0, sizeof(memory), 0};
+  char                         path[64];
+  char                         name[64];
+  uint16_t                     udp_port;
+  uint16_t                     tcp_port;
+  bool                         ok = true;
+
+  memset(long_message, 'x', sizeof(long_message) - 1);
+  snprintf(path, sizeof(path), "/tmp/logcie_alloc_%ld.sock", (long)getpid());
+  snprintf(name, sizeof(name), "/logcie-alloc-%ld", (long)getpid());
+  unlink(path);
+
+  struct sockaddr_un address = {0};
+  address.sun_family        = AF_UNIX;
+  strcpy(address.sun_path, path);
+  int syslog_listener = socket(AF_UNIX, SOCK_DGRAM, 0);
+  int udp_listener    = loopback_listener(SOCK_DGRAM, &udp_port);
+  int tcp_listener    = loopback_listener(SOCK_STREAM, &tcp_port);
+  int null_fd         = open("/dev/null", O_WRONLY);
+  FILE *null_file     = fopen("/dev/null", "w");
+
+  if (syslog_listener < 0 || bind(syslog_listener, (struct sockaddr *)&address, sizeof(address)) != 0 || udp_listener < 0 ||
+      tcp_listener < 0 || null_fd < 0 || null_file == NULL) {
+    return false;
+  }
+
+  memset(&rfc5424, 0, sizeof(rfc5424));
+  memset(&journal, 0, sizeof(journal));
+  memset(&udp, 0, sizeof(udp));
+  memset(&tcp, 0, sizeof(tcp));
+  memset(&shm, 0, sizeof(shm));
+  memset(&recorder, 0, sizeof(recorder));
+  memset(&dedup, 0, sizeof(dedup));
+  rfc5424.path      = path;
+  rfc5424.linger_ms = 60000;
+  journal.path      = path;
+  journal.protocol  = LOGCIE_SYSLOG_JOURNAL;
+  udp.host          = "127.0.0.1";
+  udp.port          = udp_port;
+  udp.transport     = LOGCIE_NET_UDP;
+  tcp.host          = "127.0.0.1";
+  tcp.port          = tcp_port;
+  tcp.framing       = LOGCIE_NET_LENGTH_PREFIX;
+  shm.name          = name;
+  shm.capacity      = 1 << 16;
+  logcie_patterns_compile(&patterns, words, 2, 1);
+  logcie_regex_compile(&regex, "^request [0-9]+", LOGCIE_REGEX_MESSAGE);
+
+  // Every built-in formatter and writer, with filters and duplicate suppression
+  const char *format = "$d $t $z [$L] ($M) $f:$x:$<40 $m";
+  Logcie_Sink sinks[] = {
+    {{logcie_printf_formatter, (void *)format}, {logcie_printf_writer, null_file, logcie_printf_writev, logcie_printf_flush}, {NULL, NULL}, NULL, NULL},
+    {{logcie_printf_formatter, (void *)format}, {logcie_printf_writer, null_file, NULL, NULL}, {logcie_filter_patterns_fn, &patterns}, NULL, NULL},
+    {{logcie_printf_formatter, (void *)format}, {logcie_fd_writer, (void *)(intptr_t)null_fd, logcie_fd_writev, NULL}, {logcie_filter_regex_fn, &regex}, NULL, NULL},
+    {{logcie_printf_formatter, (void *)"$L $m"}, {logcie_buffer_writer, &output, logcie_buffer_writev, NULL}, {logcie_filter_rate_limit_fn, &limit}, &dedup, NULL},
+    logcie_syslog_sink(&rfc5424),
+    logcie_syslog_sink(&journal),
+    logcie_net_sink(&udp, format),
+    logcie_net_sink(&tcp, format),
+    logcie_shm_sink(&shm),
+    logcie_flight_recorder_sink(&recorder),
+#ifdef _LOGCIE_THREADS
+    {{logcie_printf_formatter, (void *)format}, {logcie_fd_writer, (void *)(intptr_t)null_fd, logcie_fd_writev, NULL}, {NULL, NULL}, NULL, NULL},
+#endif
+  };
+  size_t count    = sizeof(sinks) / sizeof(sinks[0]);
+  recorder.target = &sinks[3];
+
+#ifdef _LOGCIE_THREADS
+  static Logcie_Async async;
+  memset(&async, 0, sizeof(async));
+  async.policy = LOGCIE_OVERFLOW_BLOCK;
+  ok           = ok && logcie_async_start(&sinks[count - 1], &async);
+#endif
+
+  ok = ok && logcie_shm_open(&shm);
+
+  for (size_t i = 0; i < count; i++) {
+    logcie_add_sink(&sinks[i]);
+  }
+
+  // Warm up: stdio buffers, timezone, connections
+  LOGCIE_INFO("warm up");
+  logcie_flush();
+  int peer = accept(tcp_listener, NULL, NULL);
+  ok       = ok && peer >= 0;
+
+  allocations_tracked = 1;
+
+  for (uint32_t i = 0; i < ALLOCATION_TEST_LOGS && ok; i++) {
+    LOGCIE_INFO("request %u from %s took %.3f ms", i, "10.0.0.1", i * 0.001);
+    LOGCIE_DEBUG("cache %s: key %x at %p", i & 1 ? "hit" : "miss", i, (void *)&output);
+    LOGCIE_TRACE("same line");
+
+    if (i % 1024 == 0) {
+      LOGCIE_WARN("%s", long_message);
+      logcie_scope_begin(LOGCIE_LEVEL_INFO);
+      LOGCIE_DEBUG("held %u", i);
+      logcie_scope_end(i % 2048 == 0);
+    }
+
+    if (i % 8192 == 0) {
+      LOGCIE_ERROR("request %u failed", i);
+    }
+
+    if (i % 64 == 0) {
+      output.len = 0;
+      drain_socket(syslog_listener);
+      drain_socket(udp_listener);
+      drain_socket(peer);
+    }
+  }
+
+  logcie_flush();
+  allocations_tracked = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    logcie_remove_sink(&sinks[i]);
+  }
+
+#ifdef _LOGCIE_THREADS
+  logcie_async_stop(&async);
+  ok = ok && async.written > ALLOCATION_TEST_LOGS;
+#endif
+
+  // Records went through every sink
+  ok = ok && allocations == 0;
+  ok = ok && rfc5424.sent > 0 && journal.sent > 0 && udp.sent > 0 && tcp.sent > 0;
+  ok = ok && shm.written > ALLOCATION_TEST_LOGS && recorder.dumps > 0;
+
+  if (allocations) {
+    printf("  %llu allocator calls while logging\n", (unsigned long long)allocations);
+  }
+
+  logcie_syslog_close(&rfc5424);
+  logcie_syslog_close(&journal);
+  logcie_net_close(&udp);
+  logcie_net_close(&tcp);
+  logcie_shm_close(&shm);
+  shm_unlink(name);
+  close(peer);
+  close(tcp_listener);
+  close(udp_listener);
+  close(syslog_listener);
+  close(null_fd);
+  fclose(null_file);
+  unlink(path);
+  return ok;
+}
+#endif
+
+static Logcie_FeatureTest feature_tests[] = {
+  {"Call site disabled by file:line", test_callsite_rules},
+  {"Call site cache invalidated by sinks", test_callsite_generation},
+  {"Call sites are enumerable", test_callsite_enumeration},
+  {"Rate limit per call site", test_rate_limit},
+  {"Duplicate suppression", test_dedup},
+  {"Multi-pattern filter", test_patterns},
+  {"Regex filter", test_regex},
+  {"Message is rendered once", test_render_once},
+  {"Shared formatter renders once", test_shared_formatter},
+  {"Gather writer", test_gather_writer},
+  {"Formatting kernels match libc", test_format_kernels},
+  {"Call site format cache", test_format_cache},
+#if defined(__unix__) || defined(__APPLE__)
+  {"Syslog sink", test_syslog_sink},
+  {"Network sink", test_net_sink},
+#endif
+#ifdef _LOGCIE_THREADS
+  {"Async sink overflow policies", test_async_sink},
+  {"Fatal log flushes sinks", test_fatal_flush},
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+  {"Crash handler writes pending logs", test_crash_handler},
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+  {"Shared memory ring sink", test_shm_sink},
+#endif
+  {"Flight recorder dumps on error", test_flight_recorder},
+  {"Scope holds logs until failure", test_scope},
+#ifdef TEST_ALLOCATIONS
+  {"Logging does not allocate", test_no_allocations},
+#endif
+};
+
 bool is_test_passed(Logcie_TestCase testcase, int ok) {
   return (testcase.expected && ok) || (!testcase.expected && !ok);
 }
@@ -300,6 +1653,18 @@ int main(void) {
     }
   }
 
+  int features = sizeof(feature_tests) / sizeof(feature_tests[0]);
+  total += features;
+
+  for (int i = 0; i < features; i++) {
+    if (feature_tests[i].run()) {
+      printf("[PASS] %s\n", feature_tests[i].name);
+      passed++;
+    } else {
+      printf("[FAIL] %s\n", feature_tests[i].name);
+    }
+  }
+
   printf("\nResult: %d/%d passed\n", passed, total);
   return passed == total ? 0 : 1;
 }
@@ -0,0 +1,107 @@
+// logcie-tail: prints logs of a shared memory sink (see Logcie_Shm)
+//
+//   logcie-tail [-f format] [-i interval_ms] [-o] name
+//
+// Reads records from shared memory ring `name` and writes them to stdout with
+// logcie_printf_formatter, so formatting and shipping cost nothing to the program
+// that logs. Waits for the ring to appear and follows it until killed; with -o
+// prints records that are in the ring and exits.
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOGCIE_IMPLEMENTATION
+#include "logcie.h"
+
+static void usage(void) {
+  fprintf(stderr, "Usage: logcie-tail [-f format] [-i interval_ms] [-o] name\n");
+  fprintf(stderr, "  -f  Format of printed logs (default: \"$d $t [$L] ($M) $m\")\n");
+  fprintf(stderr, "  -i  How often to check for new records (default: 10 ms)\n");
+  fprintf(stderr, "  -o  Print records that are in the ring and exit\n");
+}
+
+int main(int argc, char **argv) {
+  const char *format   = "$d $t [$L] ($M) $m";
+  int         interval = 10;
+  int         once     = 0;
+  const char *name     = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      format = argv[++i];
+    } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+      interval = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-o") == 0) {
+      once = 1;
+    } else if (argv[i][0] != '-' && name == NULL) {
+      name = argv[i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  if (name == NULL) {
+    usage();
+    return 1;
+  }
+
+  Logcie_Sink stdout_sink = {
+    .formatter = {logcie_printf_formatter, (void *)format},
+    .writer    = {logcie_printf_writer, stdout, logcie_printf_writev, logcie_printf_flush},
+    .filter    = {NULL, NULL},
+    .dedup     = NULL,
+    .async     = NULL,
+  };
+  logcie_add_sink(&stdout_sink);
+
+  static Logcie_ShmReader reader;
+  uint64_t                lost = 0;
+  reader.name                  = name;
+
+  for (;;) {
+    if (reader.header == NULL && !logcie_shm_reader_open(&reader)) {
+      if (once) {
+        fprintf(stderr, "logcie-tail: no ring '%s'\n", name);
+        return 1;
+      }
+
+      poll(NULL, 0, interval);
+      continue;
+    }
+
+    Logcie_Log log;
+    size_t     count = 0;
+
+    while (logcie_shm_read(&reader, &log)) {
+      logcie_log_rendered(log, log.message, log.message_len);
+      count++;
+    }
+
+    if (reader.lost != lost) {
+      fprintf(stderr, "logcie-tail: %llu records lost\n", (unsigned long long)(reader.lost - lost));
+      lost = reader.lost;
+    }
+
+    if (count) {
+      fflush(stdout);
+    }
+
+    if (once) {
+      break;
+    }
+
+    // Ring was created again with other size
+    if (reader.header->capacity != reader.capacity) {
+      logcie_shm_reader_close(&reader);
+      continue;
+    }
+
+    poll(NULL, 0, interval);
+  }
+
+  logcie_shm_reader_close(&reader);
+  return 0;
+}